@@ -32,7 +32,6 @@
 #include "IAutoGUI.h"
 
 #include <math.h>
-#include "../../WDL/denormal.h"
 
 
 inline double fast_tanh(double x)
@@ -48,9 +47,7 @@ IPlugDistortion::IPlugDistortion(IPlugInstanceInfo instanceInfo):
 {
   TRACE;
 
-  mAntiAlias.Calc(0.5 / (double)mOversampling);
-  mUpsample.Reset();
-  mDownsample.Reset();
+  mOversampler.Setup(mOversampling, 1, WDL_Oversampler::LINEAR_PHASE); // its latency is PLUG_LATENCY
 
   mDistortedDC = fast_tanh(mDC);
 
@@ -63,6 +60,16 @@ IPlugDistortion::IPlugDistortion(IPlugInstanceInfo instanceInfo):
 }
 
 
+void IPlugDistortion::Reset()
+{
+  TRACE;
+  IMutexLock lock(this);
+
+  mOversampler.Reset();
+  mOversampler.SetMaxBlockSize(GetBlockSize());
+}
+
+
 void IPlugDistortion::OnParamChange(int paramIdx)
 {
   IMutexLock lock(this);
@@ -84,29 +91,24 @@ void IPlugDistortion::ProcessDoubleReplacing(double** inputs, double** outputs,
 {
   bool isMono = !IsInChannelConnected(1);
 
+  double* mono = outputs[0];
   for (int i = 0; i < nFrames; ++i)
   {
-    double sample = isMono ? inputs[0][i] : 0.5 * (inputs[0][i] + inputs[1][i]);
-    double output;
+    mono[i] = isMono ? inputs[0][i] : 0.5 * (inputs[0][i] + inputs[1][i]);
+  }
 
-    for (int j = 0; j < mOversampling; ++j)
-    {
-      // Upsample
-      if (j > 0) sample = 0.;
-      mUpsample.Process(sample, mAntiAlias.Coeffs());
-      sample = (double)mOversampling * mUpsample.Output();
-
-      // Distortion
-      if (WDL_DENORMAL_OR_ZERO_DOUBLE_AGGRESSIVE(&sample))
-        sample = 0.;
-      else
-        sample = mGain * (fast_tanh(mDC + mDrive * sample) - mDistortedDC);
-
-      // Downsample
-      mDownsample.Process(sample, mAntiAlias.Coeffs());
-      if (j == 0) output = mDownsample.Output();
-    }
+  // Upsample, distort the whole oversampled block, downsample
+  mOversampler.Upsample(&mono, nFrames);
 
-    outputs[0][i] = outputs[1][i] = output;
+  double* buf = mOversampler.GetBuf(0);
+  const int n = nFrames * mOversampling;
+  // no per-sample denormal test, IPlugBase flushes denormals to zero around this call
+  for (int i = 0; i < n; ++i)
+  {
+    buf[i] = mGain * (fast_tanh(mDC + mDrive * buf[i]) - mDistortedDC);
   }
+
+  mOversampler.Downsample(&mono, nFrames);
+
+  memcpy(outputs[1], mono, nFrames * sizeof(double));
 }
@@ -32,9 +32,7 @@
 
 #include "IPlug_include_in_plug_hdr.h"
 
-#define WDL_BESSEL_FILTER_ORDER 8
-#define WDL_BESSEL_DENORMAL_AGGRESSIVE
-#include "../../WDL/besselfilter.h"
+#include "../../WDL/oversampler.h"
 
 
 enum EParams
@@ -50,6 +48,7 @@ public:
   IPlugDistortion(IPlugInstanceInfo instanceInfo);
   ~IPlugDistortion() {}
 
+  void Reset();
   void OnParamChange(int paramIdx);
   void ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames);
 
@@ -61,8 +60,7 @@ private:
 
   double mDrive, mGain;
 
-  WDL_BesselFilterCoeffs mAntiAlias;
-  WDL_BesselFilterStage mUpsample, mDownsample;
+  WDL_Oversampler mOversampler;
 };
 
 
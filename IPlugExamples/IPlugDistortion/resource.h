@@ -46,7 +46,8 @@ instrument determined by PLUG _IS _INST
 
 #define PLUG_CHANNEL_IO "1-1 2-2"
 
-#define PLUG_LATENCY 0
+// mOversampler: 8x, linear phase (73.75 samples, rounded)
+#define PLUG_LATENCY 74
 #define PLUG_IS_INST 0
 
 // if this is 0 RTAS can't get tempo info
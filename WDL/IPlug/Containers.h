@@ -66,10 +66,21 @@ public:
   ByteChunk() {}
   ~ByteChunk() {}
 
+  // Preallocates size bytes, so that putting up to that many after Clear() doesn't allocate.
+  inline void Reserve(int size)
+  {
+    int n = mBytes.GetSize();
+    if (size > n)
+    {
+      mBytes.Resize(size, false);
+      mBytes.Resize(n, false);
+    }
+  }
+
   inline int PutBytes(const void* pBuf, int size)
   {
     int n = mBytes.GetSize();
-    mBytes.Resize(n + size);
+    mBytes.Resize(n + size, false);
     memcpy(mBytes.Get() + n, pBuf, size);
     return mBytes.GetSize();
   }
@@ -211,7 +222,7 @@ public:
   {
     Put(&numItems);
     int n = mBytes.GetSize();
-    mBytes.Resize(n + numItems * sizeof(double));
+    mBytes.Resize(n + numItems * sizeof(double), false);
     memcpy(mBytes.Get() + n, (BYTE*) data, numItems * sizeof(double));
     return mBytes.GetSize();
   }
@@ -235,7 +246,7 @@ public:
   inline int PutBool(bool b)
   {
     int n = mBytes.GetSize();
-    mBytes.Resize(n + 1);
+    mBytes.Resize(n + 1, false);
     *(mBytes.Get() + n) = (BYTE) (b ? 1 : 0);
     return mBytes.GetSize();
   }
@@ -257,9 +268,10 @@ public:
     return PutBytes(pRHS->GetBytes(), pRHS->Size());
   }
 
+  // Keeps the memory, see Reserve().
   inline void Clear()
   {
-    mBytes.Resize(0);
+    mBytes.Resize(0, false);
   }
 
   inline int Size()
@@ -73,6 +73,11 @@ void MyPlug::ProcessDoubleReplacing(double** inputs, double** outputs, int nFram
   mMidiQueue.Flush(nFrames);
 }
 
+
+Add() expands the queue when it is full, which allocates on the audio thread.
+Define DONT_EXPAND_IMIDIQUEUE to drop the MIDI message instead, and size the
+queue in Reset() for the most messages you expect per block.
+
 */
 
 
@@ -83,14 +88,18 @@ public:
   ~IMidiQueue() { free(mBuf); }
 
   // Adds a MIDI message add the back of the queue. If the queue is full,
-  // it will automatically expand itself.
+  // it will automatically expand itself (unless DONT_EXPAND_IMIDIQUEUE).
   void Add(IMidiMsg* pMsg)
   {
     if (mBack >= mSize)
     {
       if (mFront > 0)
         Compact();
+#ifndef DONT_EXPAND_IMIDIQUEUE
       else if (!Expand()) return;
+#else
+      else return;
+#endif
     }
 
 #ifndef DONT_SORT_IMIDIQUEUE
@@ -0,0 +1,115 @@
+#ifndef _IPARAMQUEUE_
+#define _IPARAMQUEUE_
+
+/*
+
+IParamQueue is a lock-free multiple producer, single consumer queue of
+parameter changes. IPlugBase uses two of them when IPLUG_LOCKFREE_PARAMS is
+defined: one filled by the GUI thread (SetParameterFromGUI), one by the host's
+parameter calls, both emptied by the audio thread at the start of each block,
+so that neither side ever waits for the other. Hosts call VST2 setParameter()
+and AU SetParameter() from the audio thread and the UI thread alike, so Push()
+may be called from several threads at once: each slot carries a sequence
+number, producers claim a slot by compare-and-swap on the write position, and
+the consumer only takes a slot once its producer has marked it complete.
+
+The capacity is fixed at construction, so Push() and Pop() never allocate.
+Push() returns false when the queue is full; the caller then has to make sure
+the change isn't lost (IPlugBase keeps the latest such value per parameter).
+
+*/
+
+#include <stdlib.h>
+#include "../wdlatomic.h"
+
+#define DEFAULT_PARAM_QUEUE_SIZE 1024 // must be a power of 2
+
+struct IParamChange
+{
+  int mIdx;        // Parameter index.
+  int mOffset;     // Sample offset in the block, 0 if not known.
+  double mValue;   // Normalized value.
+};
+
+class IParamQueue
+{
+public:
+  IParamQueue(int size = DEFAULT_PARAM_QUEUE_SIZE): mReadPos(0), mWritePos(0)
+  {
+    mMask = 1;
+    while (mMask < size) mMask <<= 1;
+    mBuf = (Slot*) malloc(mMask * sizeof(Slot));
+    if (!mBuf) mMask = 1;
+    --mMask;
+    Clear();
+  }
+  ~IParamQueue() { free(mBuf); }
+
+  // Any thread.
+  bool Push(int idx, double normalizedValue, int offset = 0)
+  {
+    if (!mBuf) return false;
+
+    Slot* pSlot;
+    int w = mWritePos;
+    for (;;)
+    {
+      pSlot = mBuf + (w & mMask);
+      const int diff = Diff(pSlot->mSeq, w);
+      if (diff < 0) return false; // full, the slot's previous change wasn't popped yet
+      if (!diff && wdl_atomic_cas_int((int*) &mWritePos, w, Next(w))) break;
+      w = mWritePos; // another producer claimed it first
+    }
+
+    pSlot->mChange.mIdx = idx;
+    pSlot->mChange.mOffset = offset;
+    pSlot->mChange.mValue = normalizedValue;
+    wdl_memory_barrier(); // the item is complete before it becomes visible
+    pSlot->mSeq = Next(w);
+    return true;
+  }
+
+  // Consumer thread only.
+  bool Pop(IParamChange* pChange)
+  {
+    if (!mBuf) return false;
+
+    const int r = mReadPos;
+    Slot* pSlot = mBuf + (r & mMask);
+    if (Diff(pSlot->mSeq, Next(r)) < 0) return false; // empty, or its producer is still writing
+
+    wdl_memory_barrier();
+    *pChange = pSlot->mChange;
+    wdl_memory_barrier(); // done reading before the slot can be reused
+    pSlot->mSeq = (int) ((unsigned int) r + mMask + 1); // free for the Push() one lap later
+    mReadPos = Next(r);
+    return true;
+  }
+
+  // Any thread, only a hint while others are running.
+  bool Empty() const { return mReadPos == mWritePos; }
+
+  // Not thread safe, for use while no audio is processed.
+  void Clear()
+  {
+    mReadPos = mWritePos = 0;
+    for (int i = 0; mBuf && i <= mMask; ++i) mBuf[i].mSeq = i;
+  }
+
+private:
+  struct Slot
+  {
+    volatile int mSeq; // == position: free for that Push(), == position + 1: ready for that Pop()
+    IParamChange mChange;
+  };
+
+  // Positions count up and wrap around, compared as distances.
+  static int Next(int pos) { return (int) ((unsigned int) pos + 1); }
+  static int Diff(int a, int b) { return (int) ((unsigned int) a - (unsigned int) b); }
+
+  Slot* mBuf;
+  int mMask;
+  volatile int mReadPos, mWritePos;
+}; // class IParamQueue
+
+#endif
@@ -85,7 +85,14 @@ ComponentResult IPlugAU::IPlugAUEntry(ComponentParameters *params, void* pPlug)
     return noErr;
   }
 
+#ifdef IPLUG_LOCKFREE_PARAMS
+  // parameter changes go through the lock-free queue, rendering doesn't wait for the GUI
+  const bool lockSelect = select != kAudioUnitRenderSelect && select != kAudioUnitGetParameterSelect &&
+                          select != kAudioUnitSetParameterSelect && select != kAudioUnitScheduleParametersSelect;
+  IPlugBase::IMutexLock lock(_this, lockSelect);
+#else
   IPlugBase::IMutexLock lock(_this);
+#endif
 
   switch (select)
   {
@@ -1577,7 +1584,7 @@ ComponentResult IPlugAU::GetParamProc(void* pPlug, AudioUnitParameterID paramID,
 
   ASSERT_SCOPE(kAudioUnitScope_Global);
   IPlugAU* _this = (IPlugAU*) pPlug;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   *pValue = _this->GetParam(paramID)->Value();
   return noErr;
 }
@@ -1591,14 +1598,20 @@ ComponentResult IPlugAU::SetParamProc(void* pPlug, AudioUnitParameterID paramID,
   // In the SDK, offset frames is only looked at in group scope.
   ASSERT_SCOPE(kAudioUnitScope_Global);
   IPlugAU* _this = (IPlugAU*) pPlug;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   IParam* pParam = _this->GetParam(paramID);
+#ifdef IPLUG_LOCKFREE_PARAMS
+  _this->QueueParamChangeFromHost(paramID, pParam->GetNormalized(value), offsetFrames);
+#else
   pParam->Set(value);
+#endif
   if (_this->GetGUI())
   {
     _this->GetGUI()->SetParameterFromPlug(paramID, value, false);
   }
+#ifndef IPLUG_LOCKFREE_PARAMS
   _this->OnParamChange(paramID);
+#endif
   return noErr;
 }
 
@@ -2123,8 +2136,8 @@ void IPlugAU::SetBlockSize(int blockSize)
   TRACE;
   int nIn = NInChannels() * blockSize;
   int nOut = NOutChannels() * blockSize;
-  mInScratchBuf.Resize(nIn);
-  mOutScratchBuf.Resize(nOut);
+  mInScratchBuf.Resize(nIn, false);
+  mOutScratchBuf.Resize(nOut, false);
   memset(mInScratchBuf.Get(), 0, nIn * sizeof(AudioSampleType));
   memset(mOutScratchBuf.Get(), 0, nOut * sizeof(AudioSampleType));
   IPlugBase::SetBlockSize(blockSize);
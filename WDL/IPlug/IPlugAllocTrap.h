@@ -0,0 +1,234 @@
+#ifndef _IPLUGALLOCTRAP_
+#define _IPLUGALLOCTRAP_
+
+/*
+
+Debug aid for realtime safety. Define IPLUG_TRAP_ALLOCATIONS (for both the plugin and
+the IPlug sources) and any malloc, realloc or free on a thread that is inside
+IPlugBase::ProcessBuffers(), PassThroughBuffers() etc aborts with a message, so that
+allocations on the audio thread fail in testing rather than glitch on stage.
+
+The hooks are installed by the first IPlugBase constructor:
+  Windows:  the debug CRT allocation hook (_CrtSetAllocHook), so _DEBUG builds only.
+  OS X:     the default malloc zone's functions.
+  glibc:    malloc, calloc, realloc and free themselves (forwarded to __libc_malloc etc).
+            This only works when IPlug is linked into the executable (e.g. a test host):
+            in a dlopen()ed plugin the calls bind to libc's definitions and nothing is
+            trapped. posix_memalign, aligned_alloc and memalign are not hooked.
+operator new and delete go through these on all three.
+
+Code that has to allocate anyway can use an IAllowAllocations scope, e.g.
+
+  void MyPlug::ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames)
+  {
+    ...
+    {
+      IAllowAllocations allow; // known to happen once, after a preset change
+      mBigTable.Resize(n);
+    }
+  }
+
+Everything IPlug itself needs is allocated by SetBlockSize(), which the API classes call
+before Reset(): scratch buffers, parameter ramps, the bypass delay (see SetMaxLatency())
+and the list of the block's parameter changes (which coalesces changes when full). See also DONT_EXPAND_IMIDIQUEUE and
+ByteChunk::Reserve().
+
+*/
+
+#ifdef IPLUG_TRAP_ALLOCATIONS
+
+// Marks the current thread as the audio thread for the scope's lifetime.
+class IAudioThreadScope
+{
+public:
+  IAudioThreadScope();
+  ~IAudioThreadScope();
+
+  static void InstallHooks(); // once per process, not thread safe
+  static bool IsAudioThread();
+};
+
+// Suspends the trap on this thread for the scope's lifetime.
+class IAllowAllocations
+{
+public:
+  IAllowAllocations();
+  ~IAllowAllocations();
+
+private:
+  int mDepth;
+};
+
+  #define IPLUG_ALLOC_TRAP_SCOPE IAudioThreadScope audioThreadScope;
+#else
+  #define IPLUG_ALLOC_TRAP_SCOPE
+
+class IAllowAllocations
+{
+public:
+  IAllowAllocations() {}
+};
+#endif // IPLUG_TRAP_ALLOCATIONS
+
+#endif // _IPLUGALLOCTRAP_
+
+// Defined once, by IPlugBase.cpp (outside the include guard, IPlugBase.h includes this first).
+#if defined(IPLUG_TRAP_ALLOCATIONS) && defined(IPLUG_ALLOC_TRAP_IMPL) && !defined(_IPLUGALLOCTRAP_IMPL_)
+#define _IPLUGALLOCTRAP_IMPL_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+  #define IPLUG_THREAD_LOCAL __declspec(thread)
+#else
+  #define IPLUG_THREAD_LOCAL __thread
+#endif
+
+static IPLUG_THREAD_LOCAL int sAudioThreadDepth = 0;
+
+static void IAllocTrapFired(const char* what)
+{
+  sAudioThreadDepth = 0; // reporting may allocate
+  fprintf(stderr, "IPLUG_TRAP_ALLOCATIONS: %s on the audio thread\n", what);
+  fflush(stderr);
+  abort();
+}
+
+#define IPLUG_CHECK_ALLOC(what) if (sAudioThreadDepth > 0) { IAllocTrapFired(what); }
+
+IAudioThreadScope::IAudioThreadScope() { ++sAudioThreadDepth; }
+IAudioThreadScope::~IAudioThreadScope() { --sAudioThreadDepth; }
+bool IAudioThreadScope::IsAudioThread() { return sAudioThreadDepth > 0; }
+
+IAllowAllocations::IAllowAllocations() : mDepth(sAudioThreadDepth) { sAudioThreadDepth = 0; }
+IAllowAllocations::~IAllowAllocations() { sAudioThreadDepth = mDepth; }
+
+#if defined(_WIN32)
+
+#include <crtdbg.h>
+
+#ifdef _DEBUG
+static int __cdecl IAllocTrapCrtHook(int allocType, void* pData, size_t size, int blockType, long requestNumber, const unsigned char* filename, int lineNumber)
+{
+  if (blockType != _CRT_BLOCK) // the CRT's own bookkeeping
+  {
+    IPLUG_CHECK_ALLOC(allocType == _HOOK_FREE ? "free" : (allocType == _HOOK_REALLOC ? "realloc" : "malloc"))
+  }
+  return 1;
+}
+#endif
+
+void IAudioThreadScope::InstallHooks()
+{
+#ifdef _DEBUG
+  static bool installed = false;
+  if (!installed)
+  {
+    installed = true;
+    _CrtSetAllocHook(IAllocTrapCrtHook);
+  }
+#endif
+}
+
+#elif defined(__APPLE__)
+
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+
+static malloc_zone_t sOrigZone; // the default zone's functions before InstallHooks()
+
+static void* IAllocTrapMalloc(malloc_zone_t* zone, size_t size)
+{
+  IPLUG_CHECK_ALLOC("malloc")
+  return sOrigZone.malloc(zone, size);
+}
+
+static void* IAllocTrapCalloc(malloc_zone_t* zone, size_t n, size_t size)
+{
+  IPLUG_CHECK_ALLOC("calloc")
+  return sOrigZone.calloc(zone, n, size);
+}
+
+static void* IAllocTrapValloc(malloc_zone_t* zone, size_t size)
+{
+  IPLUG_CHECK_ALLOC("valloc")
+  return sOrigZone.valloc(zone, size);
+}
+
+static void* IAllocTrapRealloc(malloc_zone_t* zone, void* ptr, size_t size)
+{
+  IPLUG_CHECK_ALLOC("realloc")
+  return sOrigZone.realloc(zone, ptr, size);
+}
+
+static void IAllocTrapFree(malloc_zone_t* zone, void* ptr)
+{
+  IPLUG_CHECK_ALLOC("free")
+  sOrigZone.free(zone, ptr);
+}
+
+void IAudioThreadScope::InstallHooks()
+{
+  static bool installed = false;
+  if (installed) return;
+  installed = true;
+
+  malloc_zone_t* zone = malloc_default_zone();
+  memcpy(&sOrigZone, zone, sizeof(malloc_zone_t));
+
+  // the zone is read-only on 10.7 and later
+  vm_protect(mach_task_self(), (vm_address_t) zone, sizeof(malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE);
+  zone->malloc = IAllocTrapMalloc;
+  zone->calloc = IAllocTrapCalloc;
+  zone->valloc = IAllocTrapValloc;
+  zone->realloc = IAllocTrapRealloc;
+  zone->free = IAllocTrapFree;
+  vm_protect(mach_task_self(), (vm_address_t) zone, sizeof(malloc_zone_t), 0, VM_PROT_READ);
+}
+
+#elif defined(__GLIBC__)
+
+extern "C"
+{
+  extern void* __libc_malloc(size_t size);
+  extern void* __libc_calloc(size_t n, size_t size);
+  extern void* __libc_realloc(void* ptr, size_t size);
+  extern void __libc_free(void* ptr);
+
+  void* malloc(size_t size)
+  {
+    IPLUG_CHECK_ALLOC("malloc")
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t n, size_t size)
+  {
+    IPLUG_CHECK_ALLOC("calloc")
+    return __libc_calloc(n, size);
+  }
+
+  void* realloc(void* ptr, size_t size)
+  {
+    IPLUG_CHECK_ALLOC("realloc")
+    return __libc_realloc(ptr, size);
+  }
+
+  void free(void* ptr)
+  {
+    IPLUG_CHECK_ALLOC("free")
+    __libc_free(ptr);
+  }
+}
+
+void IAudioThreadScope::InstallHooks() {} // linked in, executables only (see above)
+
+#else
+
+void IAudioThreadScope::InstallHooks() {} // not supported, the scopes are no-ops
+
+#endif
+
+#undef IPLUG_CHECK_ALLOC
+
+#endif // IPLUG_ALLOC_TRAP_IMPL
@@ -7,6 +7,9 @@
 #include "../wdlendian.h"
 #include "../base64encdec.h"
 
+#define IPLUG_ALLOC_TRAP_IMPL
+#include "IPlugAllocTrap.h"
+
 #ifndef VstInt32
   #ifdef WIN32
     typedef int VstInt32;
@@ -27,6 +30,31 @@ void CastCopy(DEST* pDest, SRC* pSrc, int n)
   }
 }
 
+template <class SRC, class DEST>
+void CastAdd(DEST* pDest, SRC* pSrc, int n)
+{
+  for (int i = 0; i < n; ++i, ++pDest, ++pSrc)
+  {
+    *pDest += (DEST) *pSrc;
+  }
+}
+
+// Default passthrough for ProcessDoubleReplacing() and ProcessSingleReplacing().
+template <class SAMPLETYPE>
+static void PassThroughCopy(SAMPLETYPE** inputs, SAMPLETYPE** outputs, int nIn, int nOut, int nFrames)
+{
+  int i;
+  for (i = 0; i < nOut && i < nIn; ++i)
+  {
+    memcpy(outputs[i], inputs[i], nFrames * sizeof(SAMPLETYPE));
+  }
+  // zero remaining outs
+  for (/* same i */; i < nOut; ++i)
+  {
+    memset(outputs[i], 0, nFrames * sizeof(SAMPLETYPE));
+  }
+}
+
 void GetVersionParts(int version, int* pVer, int* pMaj, int* pMin)
 {
   *pVer = (version & 0xFFFF0000) >> 16;
@@ -72,6 +100,7 @@ IPlugBase::IPlugBase(int nParams,
   , mSampleRate(DEFAULT_SAMPLE_RATE)
   , mBlockSize(0)
   , mLatency(latency)
+  , mMaxLatency(0)
   , mHost(kHostUninit)
   , mHostVersion(0)
   , mStateChunks(plugDoesChunks)
@@ -83,13 +112,32 @@ IPlugBase::IPlugBase(int nParams,
   , mIsBypassed(false)
   , mDelay(0)
   , mTailSize(0)
+  , mNBlockParamChanges(0)
+  , mSegmentOffset(0)
+  , mSplitMinFrames(32)
+  , mSplitAtParamChanges(false)
+  , mProcessSingleReplacing(false)
+#ifdef IPLUG_LOCKFREE_PARAMS
+  , mParamRefreshCount(0)
+  , mParamRefreshSeen(0)
+  , mParamOverflowCount(0)
+  , mParamOverflowSeen(0)
+#endif
 {
   Trace(TRACELOC, "%s:%s", effectName, CurrentTime());
 
+#ifdef IPLUG_TRAP_ALLOCATIONS
+  IAudioThreadScope::InstallHooks();
+#endif
+
   for (int i = 0; i < nParams; ++i)
   {
     mParams.Add(new IParam);
   }
+#ifdef IPLUG_LOCKFREE_PARAMS
+  mOverflowValues.Resize(nParams);
+  memset(mOverflowFlags.Resize(nParams), 0, nParams * sizeof(int));
+#endif
 
   for (int i = 0; i < nPresets; ++i)
   {
@@ -124,24 +172,35 @@ IPlugBase::IPlugBase(int nParams,
 
   mInData.Resize(nInputs);
   mOutData.Resize(nOutputs);
+  mSegInData.Resize(nInputs);
+  mSegOutData.Resize(nOutputs);
+  mFInData.Resize(nInputs);
+  mFOutData.Resize(nOutputs);
+  mFSegInData.Resize(nInputs);
+  mFSegOutData.Resize(nOutputs);
+  mBlockParamChanges.Resize(DEFAULT_BLOCK_PARAM_CHANGES);
   
   double** ppInData = mInData.Get();
+  float** ppFInData = mFInData.Get();
 
-  for (int i = 0; i < nInputs; ++i, ++ppInData)
+  for (int i = 0; i < nInputs; ++i, ++ppInData, ++ppFInData)
   {
     InChannel* pInChannel = new InChannel;
     pInChannel->mConnected = false;
     pInChannel->mSrc = ppInData;
+    pInChannel->mFSrc = ppFInData;
     mInChannels.Add(pInChannel);
   }
 
   double** ppOutData = mOutData.Get();
+  float** ppFOutData = mFOutData.Get();
 
-  for (int i = 0; i < nOutputs; ++i, ++ppOutData)
+  for (int i = 0; i < nOutputs; ++i, ++ppOutData, ++ppFOutData)
   {
     OutChannel* pOutChannel = new OutChannel;
     pOutChannel->mConnected = false;
     pOutChannel->mDest = ppOutData;
+    pOutChannel->mFOut = ppFOutData;
     pOutChannel->mFDest = 0;
     mOutChannels.Add(pOutChannel);
   }
@@ -158,6 +217,7 @@ IPlugBase::~IPlugBase()
   mChannelIO.Empty(true);
   mInputBusLabels.Empty(true);
   mOutputBusLabels.Empty(true);
+  mParamRamps.Empty(true);
  
   if (mDelay) 
   {
@@ -301,6 +361,8 @@ void IPlugBase::SetSampleRate(double sampleRate)
   mSampleRate = sampleRate;
 }
 
+// Everything the audio thread needs is allocated here, before the API classes call Reset().
+// The buffers don't shrink, so calling this again with a smaller size doesn't allocate.
 void IPlugBase::SetBlockSize(int blockSize)
 {
   if (blockSize != mBlockSize)
@@ -310,16 +372,35 @@ void IPlugBase::SetBlockSize(int blockSize)
     for (i = 0; i < nIn; ++i)
     {
       InChannel* pInChannel = mInChannels.Get(i);
-      pInChannel->mScratchBuf.Resize(blockSize);
+      pInChannel->mScratchBuf.Resize(blockSize, false);
       memset(pInChannel->mScratchBuf.Get(), 0, blockSize * sizeof(double));
+      pInChannel->mFScratchBuf.Resize(blockSize, false);
+      memset(pInChannel->mFScratchBuf.Get(), 0, blockSize * sizeof(float));
     }
     
     for (i = 0; i < nOut; ++i)
     {
       OutChannel* pOutChannel = mOutChannels.Get(i);
-      pOutChannel->mScratchBuf.Resize(blockSize);
+      pOutChannel->mScratchBuf.Resize(blockSize, false);
       memset(pOutChannel->mScratchBuf.Get(), 0, blockSize * sizeof(double));
+      pOutChannel->mFScratchBuf.Resize(blockSize, false);
+      memset(pOutChannel->mFScratchBuf.Get(), 0, blockSize * sizeof(float));
+    }
+
+    for (i = 0; i < mParamRamps.GetSize(); ++i)
+    {
+      WDL_TypedBuf<double>* pRamp = mParamRamps.Get(i);
+      if (pRamp) pRamp->Resize(blockSize, false);
     }
+
+    if (mDelay)
+    {
+      mDelay->Reserve(IPMAX(mLatency, mMaxLatency), blockSize);
+    }
+
+    // parameters are added after the constructor, so the list of changes is sized here
+    mBlockParamChanges.Resize(IPMAX(DEFAULT_BLOCK_PARAM_CHANGES, 2 * NParams()), false);
+    mNBlockParamChanges = IPMIN(mNBlockParamChanges, mBlockParamChanges.GetSize());
     
     mBlockSize = blockSize;
   }
@@ -337,6 +418,7 @@ void IPlugBase::SetInputChannelConnections(int idx, int n, bool connected)
     if (!connected)
     {
       *(pInChannel->mSrc) = pInChannel->mScratchBuf.Get();
+      *(pInChannel->mFSrc) = pInChannel->mFScratchBuf.Get();
     }
   }
 }
@@ -353,6 +435,7 @@ void IPlugBase::SetOutputChannelConnections(int idx, int n, bool connected)
     if (!connected)
     {
       *(pOutChannel->mDest) = pOutChannel->mScratchBuf.Get();
+      *(pOutChannel->mFOut) = pOutChannel->mFScratchBuf.Get();
     }
   }
 }
@@ -381,6 +464,7 @@ void IPlugBase::AttachInputBuffers(int idx, int n, double** ppData, int nFrames)
   }
 }
 
+// 32 bit inputs are converted to double by ProcessBuffers(), if at all.
 void IPlugBase::AttachInputBuffers(int idx, int n, float** ppData, int nFrames)
 {
   int iEnd = IPMIN(idx + n, mInChannels.GetSize());
@@ -389,9 +473,7 @@ void IPlugBase::AttachInputBuffers(int idx, int n, float** ppData, int nFrames)
     InChannel* pInChannel = mInChannels.Get(i);
     if (pInChannel->mConnected)
     {
-      double* pScratch = pInChannel->mScratchBuf.Get();
-      CastCopy(pScratch, *(ppData++), nFrames);
-      *(pInChannel->mSrc) = pScratch;
+      *(pInChannel->mFSrc) = *(ppData++);
     }
   }
 }
@@ -418,49 +500,79 @@ void IPlugBase::AttachOutputBuffers(int idx, int n, float** ppData)
     if (pOutChannel->mConnected)
     {
       *(pOutChannel->mDest) = pOutChannel->mScratchBuf.Get();
-      pOutChannel->mFDest = *(ppData++);
+      *(pOutChannel->mFOut) = pOutChannel->mFDest = *(ppData++);
     }
   }
 }
 
-void IPlugBase::PassThroughBuffers(double sampleType, int nFrames)
+void IPlugBase::ConvertInputBuffers(int nFrames)
+{
+  int i, n = NInChannels();
+  InChannel** ppInChannel = mInChannels.GetList();
+
+  for (i = 0; i < n; ++i, ++ppInChannel)
+  {
+    InChannel* pInChannel = *ppInChannel;
+    if (pInChannel->mConnected)
+    {
+      double* pScratch = pInChannel->mScratchBuf.Get();
+      CastCopy(pScratch, *(pInChannel->mFSrc), nFrames);
+      *(pInChannel->mSrc) = pScratch;
+    }
+  }
+}
+
+template <class SAMPLETYPE>
+void IPlugBase::PassThroughBlock(SAMPLETYPE** ppIn, SAMPLETYPE** ppOut, int nFrames)
 {
+  IPLUG_ALLOC_TRAP_SCOPE
+  ApplyQueuedParamChanges();
+  ApplyParamChangesInBlock(0, mNBlockParamChanges);
+  mNBlockParamChanges = 0;
   if (mLatency && mDelay) 
   {
-    mDelay->ProcessBlock(mInData.Get(), mOutData.Get(), nFrames);
+    mDelay->ProcessBlock(ppIn, ppOut, nFrames);
   }
   else 
   {
-    IPlugBase::ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+    PassThroughCopy(ppIn, ppOut, NInChannels(), NOutChannels(), nFrames);
   }
 }
 
+void IPlugBase::PassThroughBuffers(double sampleType, int nFrames)
+{
+  PassThroughBlock(mInData.Get(), mOutData.Get(), nFrames);
+}
+
 void IPlugBase::PassThroughBuffers(float sampleType, int nFrames)
 {
-  // for 32 bit buffers, first run the delay (if mLatency) on the 64bit IPlug buffers
-  PassThroughBuffers(0., nFrames);
-  
-  int i, n = NOutChannels();
-  OutChannel** ppOutChannel = mOutChannels.GetList();
-  
-  for (i = 0; i < n; ++i, ++ppOutChannel)
-  {
-    OutChannel* pOutChannel = *ppOutChannel;
-    if (pOutChannel->mConnected)
-    {
-      CastCopy(pOutChannel->mFDest, *(pOutChannel->mDest), nFrames);
-    }
-  }
+  // the delay (if mLatency) runs on the host's 32 bit buffers directly. hosts often process
+  // in place, which relies on NChanDelayLine storing a block's input before reading its output
+  PassThroughBlock(mFInData.Get(), mFOutData.Get(), nFrames);
 }
 
 void IPlugBase::ProcessBuffers(double sampleType, int nFrames)
 {
-  ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+  IPLUG_DENORMAL_FLUSH_SCOPE
+  IPLUG_ALLOC_TRAP_SCOPE
+  ApplyQueuedParamChanges();
+  ProcessBlock(mInData.Get(), mOutData.Get(), mSegInData.Get(), mSegOutData.Get(), nFrames);
 }
 
 void IPlugBase::ProcessBuffers(float sampleType, int nFrames)
 {
-  ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+  IPLUG_DENORMAL_FLUSH_SCOPE
+  IPLUG_ALLOC_TRAP_SCOPE
+  ApplyQueuedParamChanges();
+
+  if (mProcessSingleReplacing)
+  {
+    ProcessBlock(mFInData.Get(), mFOutData.Get(), mFSegInData.Get(), mFSegOutData.Get(), nFrames);
+    return;
+  }
+
+  ConvertInputBuffers(nFrames);
+  ProcessBlock(mInData.Get(), mOutData.Get(), mSegInData.Get(), mSegOutData.Get(), nFrames);
   int i, n = NOutChannels();
   OutChannel** ppOutChannel = mOutChannels.GetList();
   
@@ -477,24 +589,232 @@ void IPlugBase::ProcessBuffers(float sampleType, int nFrames)
 
 void IPlugBase::ProcessBuffersAccumulating(float sampleType, int nFrames)
 {
-  ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
+  IPLUG_DENORMAL_FLUSH_SCOPE
+  IPLUG_ALLOC_TRAP_SCOPE
+  ApplyQueuedParamChanges();
   int i, n = NOutChannels();
   OutChannel** ppOutChannel = mOutChannels.GetList();
+
+  if (mProcessSingleReplacing)
+  {
+    // process into the 32 bit scratch buffers, then add them to the host's
+    for (i = 0; i < n; ++i)
+    {
+      OutChannel* pOutChannel = ppOutChannel[i];
+      if (pOutChannel->mConnected)
+      {
+        *(pOutChannel->mFOut) = pOutChannel->mFScratchBuf.Get();
+      }
+    }
+    ProcessBlock(mFInData.Get(), mFOutData.Get(), mFSegInData.Get(), mFSegOutData.Get(), nFrames);
+  }
+  else
+  {
+    ConvertInputBuffers(nFrames);
+    ProcessBlock(mInData.Get(), mOutData.Get(), mSegInData.Get(), mSegOutData.Get(), nFrames);
+  }
   
   for (i = 0; i < n; ++i, ++ppOutChannel)
   {
     OutChannel* pOutChannel = *ppOutChannel;
     if (pOutChannel->mConnected)
     {
-      float* pDest = pOutChannel->mFDest;
-      double* pSrc = *(pOutChannel->mDest);
-      
-      for (int j = 0; j < nFrames; ++j, ++pDest, ++pSrc)
+      if (mProcessSingleReplacing)
+      {
+        CastAdd(pOutChannel->mFDest, *(pOutChannel->mFOut), nFrames);
+      }
+      else
+      {
+        CastAdd(pOutChannel->mFDest, *(pOutChannel->mDest), nFrames);
+      }
+    }
+  }
+}
+
+void IPlugBase::AddParamChangeInBlock(int idx, int offset, double normalizedValue)
+{
+  if (idx < 0 || idx >= NParams()) return;
+  if (offset < 0) offset = 0;
+
+  IParamChange* pChanges = mBlockParamChanges.Get();
+  int i = mNBlockParamChanges;
+  if (i >= mBlockParamChanges.GetSize()) // full, make room without allocating
+  {
+    if (!CoalesceParamChangesInBlock(idx, offset)) return; // superseded by a later change
+    i = mNBlockParamChanges;
+  }
+
+  // keep the list sorted by offset, and in order of arrival at the same offset
+  while (i > 0 && pChanges[i - 1].mOffset > offset)
+  {
+    pChanges[i] = pChanges[i - 1];
+    --i;
+  }
+  pChanges[i].mIdx = idx;
+  pChanges[i].mOffset = offset;
+  pChanges[i].mValue = normalizedValue;
+  ++mNBlockParamChanges;
+}
+
+// Drops the earliest change that a later one to the same parameter overrides, counting the
+// one about to be added. With room for NParams() changes there always is one. Returns false
+// if that is the new change itself.
+bool IPlugBase::CoalesceParamChangesInBlock(int idx, int offset)
+{
+  IParamChange* pChanges = mBlockParamChanges.Get();
+  const int n = mNBlockParamChanges;
+  for (int i = 0; i < n; ++i)
+  {
+    const int iIdx = pChanges[i].mIdx;
+    bool superseded = iIdx == idx && offset >= pChanges[i].mOffset;
+    for (int j = i + 1; j < n && !superseded; ++j)
+    {
+      superseded = pChanges[j].mIdx == iIdx;
+    }
+    if (superseded)
+    {
+      memmove(pChanges + i, pChanges + i + 1, (n - i - 1) * sizeof(IParamChange));
+      --mNBlockParamChanges;
+      return true;
+    }
+  }
+  return false;
+}
+
+void IPlugBase::ApplyParamChangesInBlock(int from, int to)
+{
+  const IParamChange* pChanges = mBlockParamChanges.Get();
+  for (int i = from; i < to; ++i)
+  {
+    const int idx = pChanges[i].mIdx;
+    GetParam(idx)->SetNormalized(pChanges[i].mValue);
+
+    // one OnParamChange() per parameter, after its last change
+    int j;
+    for (j = i + 1; j < to && pChanges[j].mIdx != idx; ++j);
+    if (j == to)
+    {
+      OnParamChange(idx);
+    }
+  }
+}
+
+void IPlugBase::EnableParamRamp(int paramIdx, bool enable)
+{
+  if (paramIdx < 0 || paramIdx >= NParams()) return;
+  while (mParamRamps.GetSize() < NParams())
+  {
+    mParamRamps.Add(0);
+  }
+
+  WDL_TypedBuf<double>* pRamp = mParamRamps.Get(paramIdx);
+  if (enable && !pRamp)
+  {
+    pRamp = new WDL_TypedBuf<double>;
+    pRamp->Resize(mBlockSize > 0 ? mBlockSize : DEFAULT_BLOCK_SIZE);
+    mParamRamps.Set(paramIdx, pRamp);
+  }
+  else if (!enable && pRamp)
+  {
+    mParamRamps.Set(paramIdx, 0);
+    delete pRamp;
+  }
+}
+
+const double* IPlugBase::GetParamRamp(int paramIdx)
+{
+  WDL_TypedBuf<double>* pRamp = mParamRamps.Get(paramIdx);
+  return pRamp ? pRamp->Get() + mSegmentOffset : 0;
+}
+
+void IPlugBase::SetSplitAtParamChanges(bool split, int minFrames)
+{
+  mSplitAtParamChanges = split;
+  mSplitMinFrames = wdl_max(minFrames, 1);
+}
+
+void IPlugBase::RenderParamRamps(int nFrames)
+{
+  const IParamChange* pChanges = mBlockParamChanges.Get();
+  int i, n = mParamRamps.GetSize();
+
+  for (i = 0; i < n; ++i)
+  {
+    WDL_TypedBuf<double>* pRamp = mParamRamps.Get(i);
+    if (!pRamp) continue;
+    const int nRamp = wdl_min(nFrames, pRamp->GetSize()); // hosts don't exceed the block size they set
+
+    // linear from the value at the start of the block through each of the host's points,
+    // reaching each point's value at its offset
+    IParam* pParam = GetParam(i);
+    double* pBuf = pRamp->Get();
+    double v = pParam->Value();
+    int last = 0, s;
+    if (nRamp > 0) pBuf[0] = v;
+    for (int c = 0; c < mNBlockParamChanges && last < nRamp; ++c)
+    {
+      if (pChanges[c].mIdx != i) continue;
+
+      const double target = pParam->GetNonNormalized(pChanges[c].mValue);
+      const int offset = pChanges[c].mOffset;
+      if (offset > last)
+      {
+        const double step = (target - v) / (double) (offset - last);
+        for (s = last + 1; s <= offset && s < nRamp; ++s)
+        {
+          pBuf[s] = v + step * (s - last);
+        }
+      }
+      else
       {
-        *pDest += (float) *pSrc;
+        pBuf[last] = target;
       }
+      v = target;
+      last = offset;
+    }
+    for (s = last + 1; s < nRamp; ++s)
+    {
+      pBuf[s] = v;
+    }
+  }
+}
+
+template <class SAMPLETYPE>
+void IPlugBase::ProcessBlock(SAMPLETYPE** ppIn, SAMPLETYPE** ppOut, SAMPLETYPE** ppSegIn, SAMPLETYPE** ppSegOut, int nFrames)
+{
+  const int n = mNBlockParamChanges;
+  mSegmentOffset = 0;
+  RenderParamRamps(nFrames);
+
+  if (!mSplitAtParamChanges || !n)
+  {
+    ApplyParamChangesInBlock(0, n);
+    ProcessReplacing(ppIn, ppOut, nFrames);
+  }
+  else
+  {
+    const IParamChange* pChanges = mBlockParamChanges.Get();
+    int c, i = 0, pos = 0, nIn = NInChannels(), nOut = NOutChannels();
+
+    while (pos < nFrames)
+    {
+      // changes within minFrames of the segment start are applied together at its start
+      int j = i;
+      while (j < n && pChanges[j].mOffset < pos + mSplitMinFrames) ++j;
+      ApplyParamChangesInBlock(i, j);
+      i = j;
+
+      const int end = i < n ? wdl_min(pChanges[i].mOffset, nFrames) : nFrames;
+      for (c = 0; c < nIn; ++c) ppSegIn[c] = ppIn[c] + pos;
+      for (c = 0; c < nOut; ++c) ppSegOut[c] = ppOut[c] + pos;
+      mSegmentOffset = pos;
+      ProcessReplacing(ppSegIn, ppSegOut, end - pos);
+      pos = end;
     }
+    ApplyParamChangesInBlock(i, n); // any past the end of the block
+    mSegmentOffset = 0;
   }
+  mNBlockParamChanges = 0;
 }
 
 void IPlugBase::ZeroScratchBuffers()
@@ -505,16 +825,30 @@ void IPlugBase::ZeroScratchBuffers()
   {
     InChannel* pInChannel = mInChannels.Get(i);
     memset(pInChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(double));
+    memset(pInChannel->mFScratchBuf.Get(), 0, mBlockSize * sizeof(float));
   }
 
   for (i = 0; i < nOut; ++i)
   {
     OutChannel* pOutChannel = mOutChannels.Get(i);
     memset(pOutChannel->mScratchBuf.Get(), 0, mBlockSize * sizeof(double));
+    memset(pOutChannel->mFScratchBuf.Get(), 0, mBlockSize * sizeof(float));
+  }
+}
+
+// Preallocates the bypass delay, for plugins that change their latency while processing.
+void IPlugBase::SetMaxLatency(int samples)
+{
+  mMaxLatency = samples;
+
+  if (mDelay)
+  {
+    mDelay->Reserve(IPMAX(mLatency, mMaxLatency), IPMAX(mBlockSize, 1));
   }
 }
 
 // If latency changes after initialization (often not supported by the host).
+// Only allocates if samples > SetMaxLatency().
 void IPlugBase::SetLatency(int samples)
 {
   mLatency = samples;
@@ -529,40 +863,114 @@ void IPlugBase::SetLatency(int samples)
 void IPlugBase::SetParameterFromGUI(int idx, double normalizedValue)
 {
   Trace(TRACELOC, "%d:%f", idx, normalizedValue);
+#ifdef IPLUG_LOCKFREE_PARAMS
+  InformHostOfParamChange(idx, normalizedValue);
+  PushParamChange(&mGUIParamQueue, idx, normalizedValue, 0);
+#else
   WDL_MutexLock lock(&mMutex);
   GetParam(idx)->SetNormalized(normalizedValue);
   InformHostOfParamChange(idx, normalizedValue);
   OnParamChange(idx);
+#endif
 }
 
 void IPlugBase::OnParamReset()
 {
+#ifdef IPLUG_LOCKFREE_PARAMS
+  // the audio thread picks this up at the start of the next block
+  wdl_atomic_incr(&mParamRefreshCount);
+#else
   for (int i = 0; i < mParams.GetSize(); ++i)
   {
     OnParamChange(i);
   }
+#endif
   //Reset();
 }
 
-// Default passthrough.
-void IPlugBase::ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames)
+#ifdef IPLUG_LOCKFREE_PARAMS
+void IPlugBase::QueueParamChangeFromHost(int idx, double normalizedValue, int offset)
 {
-  // Mutex is already locked.
-  int i, nIn = mInChannels.GetSize(), nOut = mOutChannels.GetSize();
-  int j = 0;
-  for (i = 0; i < nOut; ++i)
+  PushParamChange(&mHostParamQueue, idx, normalizedValue, offset);
+}
+
+// A change that doesn't fit in the queue (the audio thread hasn't run for a while) is kept as
+// the parameter's latest overflow value instead. Until the audio thread has taken that, later
+// changes to the parameter replace it rather than being queued, so that none overtakes it.
+void IPlugBase::PushParamChange(IParamQueue* pQueue, int idx, double normalizedValue, int offset)
+{
+  if (idx < 0 || idx >= mOverflowFlags.GetSize()) return;
+
+  volatile int* pFlag = mOverflowFlags.Get() + idx;
+  if (*pFlag || !pQueue->Push(idx, normalizedValue, offset))
   {
-    if (i < nIn)
+    mOverflowValues.Get()[idx] = normalizedValue;
+    wdl_memory_barrier(); // the value is complete before it is flagged
+    *pFlag = 1;
+    wdl_atomic_incr(&mParamOverflowCount);
+  }
+}
+#endif
+
+void IPlugBase::ApplyQueuedParamChanges()
+{
+#ifdef IPLUG_LOCKFREE_PARAMS
+  // the values are set, and OnParamChange() called, at their offsets by ProcessBlock() etc
+  IParamChange change;
+  while (mGUIParamQueue.Pop(&change))
+  {
+    AddParamChangeInBlock(change.mIdx, change.mOffset, change.mValue);
+  }
+  while (mHostParamQueue.Pop(&change))
+  {
+    AddParamChangeInBlock(change.mIdx, change.mOffset, change.mValue);
+  }
+
+  const int overflow = *(volatile int*) &mParamOverflowCount;
+  if (overflow != mParamOverflowSeen)
+  {
+    mParamOverflowSeen = overflow;
+    const IParamChange* pChanges = mBlockParamChanges.Get();
+    for (int i = 0; i < mOverflowFlags.GetSize(); ++i)
     {
-      memcpy(outputs[i], inputs[i], nFrames * sizeof(double));
-      j++;
+      // a producer sets the flag again after each value it writes
+      if (!wdl_atomic_cas_int(mOverflowFlags.Get() + i, 1, 0)) continue;
+      wdl_memory_barrier();
+      const double value = *(volatile double*) (mOverflowValues.Get() + i);
+
+      // newer than the parameter's queued changes, so it goes after them
+      int offset = 0;
+      for (int c = 0; c < mNBlockParamChanges; ++c)
+      {
+        if (pChanges[c].mIdx == i) offset = pChanges[c].mOffset;
+      }
+      AddParamChangeInBlock(i, offset, value);
     }
   }
-  // zero remaining outs
-  for (/* same j */; j < nOut; ++j)
+
+  const int refresh = *(volatile int*) &mParamRefreshCount;
+  if (refresh != mParamRefreshSeen)
   {
-    memset(outputs[j], 0, nFrames * sizeof(double));
+    mParamRefreshSeen = refresh;
+    for (int i = 0; i < mParams.GetSize(); ++i)
+    {
+      OnParamChange(i);
+    }
   }
+#endif
+}
+
+// Default passthrough.
+void IPlugBase::ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames)
+{
+  // Mutex is already locked.
+  PassThroughCopy(inputs, outputs, NInChannels(), NOutChannels(), nFrames);
+}
+
+void IPlugBase::ProcessSingleReplacing(float** inputs, float** outputs, int nFrames)
+{
+  // Mutex is already locked.
+  PassThroughCopy(inputs, outputs, NInChannels(), NOutChannels(), nFrames);
 }
 
 // Default passthrough.
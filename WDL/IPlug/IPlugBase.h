@@ -10,6 +10,9 @@
 #include "Hosts.h"
 #include "Log.h"
 #include "NChanDelay.h"
+#include "../denormal.h"
+#include "IParamQueue.h"
+#include "IPlugAllocTrap.h"
 
 // Uncomment to enable IPlug::OnIdle() and IGraphics::OnGUIIdle().
 // #define USE_IDLE_CALLS
@@ -17,6 +20,35 @@
 #define MAX_EFFECT_NAME_LEN 128
 #define DEFAULT_BLOCK_SIZE 1024
 #define DEFAULT_TEMPO 120.0
+#define DEFAULT_BLOCK_PARAM_CHANGES 256 // at least, or 2 per parameter, see SetBlockSize()
+
+// ProcessDoubleReplacing() is called with denormals flushed to zero (FTZ/DAZ, see
+// WDL_DenormalFlushScope), so it doesn't need per-sample denormal checks.
+// Define IPLUG_NO_DENORMAL_FLUSH to leave the FPU mode alone.
+#ifndef IPLUG_NO_DENORMAL_FLUSH
+  #define IPLUG_DENORMAL_FLUSH_SCOPE WDL_DenormalFlushScope denormalFlushScope;
+#else
+  #define IPLUG_DENORMAL_FLUSH_SCOPE
+#endif
+
+// Define IPLUG_LOCKFREE_PARAMS (for both the plugin and the IPlug sources) to pass parameter
+// changes from the GUI and the host to the audio thread through lock-free queues (see
+// IParamQueue.h) instead of the plugin mutex. Only the audio thread sets the values: the queued
+// changes join the block's changes (see AddParamChangeInBlock()), so OnParamChange() is called on
+// the audio thread at their offsets, and the VST2, VST3, AU and standalone process calls no
+// longer lock the mutex. GetParam()->Value() on other threads lags until the next block. Host
+// parameter calls may come from several threads at once (e.g. automation on the audio thread
+// while the host's UI sets a value).
+// #define IPLUG_LOCKFREE_PARAMS
+#ifdef IPLUG_LOCKFREE_PARAMS
+  #define IPLUG_LOCK_PROCESS false // for IMutexLock(pPlug, lock) in the process and parameter calls
+#else
+  #define IPLUG_LOCK_PROCESS true
+#endif
+
+// Define IPLUG_TRAP_ALLOCATIONS (for both the plugin and the IPlug sources, in debug builds) to
+// abort when memory is allocated or freed on the audio thread, see IPlugAllocTrap.h.
+// #define IPLUG_TRAP_ALLOCATIONS
 
 // All version ints are stored as 0xVVVVRRMM: V = version, R = revision, M = minor revision.
 
@@ -49,11 +81,16 @@ public:
 
   // Implementations should set a mutex lock like in the no-op!
   virtual void Reset() { TRACE; IMutexLock lock(this); }
+  // With IPLUG_LOCKFREE_PARAMS this is called on the audio thread, and needn't lock.
   virtual void OnParamChange(int paramIdx) { IMutexLock lock(this); }
 
   // Default passthrough.  Inputs and outputs are [nChannel][nSample].
-  // Mutex is already locked.
+  // Mutex is already locked, and denormals are flushed to zero (see IPLUG_NO_DENORMAL_FLUSH).
   virtual void ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames);
+  // Optional 32 bit version, called instead of ProcessDoubleReplacing() when the host's buffers
+  // are float (VST2 processReplacing, VST3 kSample32, AU, AAX, RTAS) and SetProcessSingleReplacing(true)
+  // was called, so that the buffers aren't converted to double and back. Default passthrough.
+  virtual void ProcessSingleReplacing(float** inputs, float** outputs, int nFrames);
   
   // In case the audio processing thread needs to do anything when the GUI opens
   // (like for example, set some state dependent initial values for controls).
@@ -128,6 +165,27 @@ public:
 
   bool GetIsBypassed() { return mIsBypassed; }
 
+  // Sample-accurate automation, for hosts that send parameter changes with sample offsets
+  // (VST3). During ProcessDoubleReplacing() the current block's changes are available,
+  // sorted by offset (from the start of the host's block), values normalized.
+  int NParamChangesInBlock() { return mNBlockParamChanges; }
+  const IParamChange* GetParamChangesInBlock() { return mBlockParamChanges.Get(); }
+  // EnableParamRamp() (e.g. in your constructor) has IPlug render the parameter's value at
+  // every sample of each block, linear between the host's points, so you needn't smooth it.
+  // GetParamRamp() returns it during ProcessDoubleReplacing(), or 0 if not enabled.
+  void EnableParamRamp(int paramIdx, bool enable = true);
+  const double* GetParamRamp(int paramIdx);
+  // Call ProcessDoubleReplacing() once per segment between parameter changes (segments are at
+  // least minFrames long), after OnParamChange() for the changes at the segment's start.
+  // Note that IMidiMsg offsets stay relative to the host's block, see GetSegmentOffset().
+  void SetSplitAtParamChanges(bool split, int minFrames = 32);
+  int GetSegmentOffset() { return mSegmentOffset; } // of the current ProcessDoubleReplacing() call
+
+  // Call ProcessSingleReplacing() instead of ProcessDoubleReplacing() for 32 bit hosts.
+  // Everything above applies to both.
+  void SetProcessSingleReplacing(bool enable) { mProcessSingleReplacing = enable; }
+  bool GetProcessSingleReplacing() { return mProcessSingleReplacing; }
+
   // In ProcessDoubleReplacing you are always guaranteed to get valid pointers
   // to all the channels the plugin requested.  If the host hasn't connected all the pins,
   // the unconnected channels will be full of zeros.
@@ -194,6 +252,9 @@ protected:
 
   // If latency changes after initialization (often not supported by the host).
   virtual void SetLatency(int samples);
+  // Reserve the bypass delay for latencies up to samples (e.g. in your constructor), so that
+  // SetLatency() on the audio thread doesn't allocate.
+  void SetMaxLatency(int samples);
   
   // set to 0xffffffff for infinite tail (VST3), or 0 for none (default)
   // for VST2 setting to 1 means no tail, but it would be better i think to leave it at 0, the default
@@ -228,7 +289,15 @@ protected:
   // ----------------------------------------
   // Internal IPlug stuff (but API classes need to get at it).
 
-  void OnParamReset();  // Calls OnParamChange(each param) + Reset().
+  void OnParamReset();  // Calls OnParamChange(each param) + Reset() (at the next block with IPLUG_LOCKFREE_PARAMS).
+  // Adds the changes queued since the last block to the block's parameter changes
+  // (IPLUG_LOCKFREE_PARAMS, otherwise does nothing). Audio thread only, called by ProcessBuffers() etc.
+  void ApplyQueuedParamChanges();
+#ifdef IPLUG_LOCKFREE_PARAMS
+  // For host parameter calls: only queues the change, the audio thread sets the value and
+  // calls OnParamChange() at offset in its next block.
+  void QueueParamChangeFromHost(int idx, double normalizedValue, int offset = 0);
+#endif
 
   void PruneUninitializedPresets();
 
@@ -252,6 +321,10 @@ protected:
   void ProcessBuffers(double sampleType, int nFrames);
   void ProcessBuffersAccumulating(float sampleType, int nFrames);
   void ZeroScratchBuffers();
+  // API classes call this for each parameter change in the next block, instead of
+  // OnParamChange(). ProcessBuffers() etc apply them. Never allocates: the list is sized by
+  // SetBlockSize(), and when full, a change that a later one overrides is dropped.
+  void AddParamChangeInBlock(int idx, int offset, double normalizedValue);
   
 public:
   void ModifyCurrentPreset(const char* name = 0);     // Sets the currently active preset to whatever current params are.
@@ -285,6 +358,7 @@ public:
   {
     WDL_Mutex* mpMutex;
     IMutexLock(IPlugBase* pPlug) : mpMutex(&(pPlug->mMutex)) { mpMutex->Enter(); }
+    IMutexLock(IPlugBase* pPlug, bool lock) : mpMutex(lock ? &(pPlug->mMutex) : 0) { if (mpMutex) { mpMutex->Enter(); } }
     ~IMutexLock() { if (mpMutex) { mpMutex->Leave(); } }
     void Destroy() { mpMutex->Leave(); mpMutex = 0; }
   };
@@ -301,7 +375,9 @@ private:
   {
     bool mConnected;
     double** mSrc;   // Points into mInData.
+    float** mFSrc;   // Points into mFInData.
     WDL_TypedBuf<double> mScratchBuf;
+    WDL_TypedBuf<float> mFScratchBuf;
     WDL_String mLabel;
   };
 
@@ -309,8 +385,10 @@ private:
   {
     bool mConnected;
     double** mDest;  // Points into mOutData.
-    float* mFDest;
+    float** mFOut;   // Points into mFOutData.
+    float* mFDest;   // The host's buffer.
     WDL_TypedBuf<double> mScratchBuf;
+    WDL_TypedBuf<float> mFScratchBuf;
     WDL_String mLabel;
   };
 
@@ -318,16 +396,50 @@ protected:
   bool mStateChunks, mIsInst, mDoesMIDI, mIsBypassed;
   int mCurrentPresetIdx;
   double mSampleRate;
-  int mBlockSize, mLatency;
+  int mBlockSize, mLatency, mMaxLatency;
   unsigned int mTailSize;
   NChanDelayLine* mDelay; // for delaying dry signal when mLatency > 0 and plugin is bypassed
   WDL_PtrList<const char> mParamGroups;
 
+  WDL_TypedBuf<IParamChange> mBlockParamChanges; // sorted by offset
+  int mNBlockParamChanges, mSegmentOffset, mSplitMinFrames;
+  bool mSplitAtParamChanges, mProcessSingleReplacing;
+  WDL_PtrList<WDL_TypedBuf<double> > mParamRamps; // per parameter, 0 if not enabled
+
+#ifdef IPLUG_LOCKFREE_PARAMS
+  IParamQueue mGUIParamQueue, mHostParamQueue;
+  // OnParamReset() bumps mParamRefreshCount (from any thread), the audio thread then calls
+  // OnParamChange() for every parameter
+  int mParamRefreshCount, mParamRefreshSeen;
+  // per parameter, the latest change that didn't fit in a queue, flagged once written
+  WDL_TypedBuf<double> mOverflowValues;
+  WDL_TypedBuf<int> mOverflowFlags;
+  int mParamOverflowCount, mParamOverflowSeen;
+#endif
+
 private:
+  // ProcessDoubleReplacing() or ProcessSingleReplacing() on the attached buffers, with the
+  // block's parameter changes
+  template <class SAMPLETYPE>
+  void ProcessBlock(SAMPLETYPE** ppIn, SAMPLETYPE** ppOut, SAMPLETYPE** ppSegIn, SAMPLETYPE** ppSegOut, int nFrames);
+  void ProcessReplacing(double** inputs, double** outputs, int nFrames) { ProcessDoubleReplacing(inputs, outputs, nFrames); }
+  void ProcessReplacing(float** inputs, float** outputs, int nFrames) { ProcessSingleReplacing(inputs, outputs, nFrames); }
+  template <class SAMPLETYPE>
+  void PassThroughBlock(SAMPLETYPE** ppIn, SAMPLETYPE** ppOut, int nFrames);
+  void ConvertInputBuffers(int nFrames); // attached 32 bit inputs to mInData
+#ifdef IPLUG_LOCKFREE_PARAMS
+  void PushParamChange(IParamQueue* pQueue, int idx, double normalizedValue, int offset);
+#endif
+  bool CoalesceParamChangesInBlock(int idx, int offset);
+  void ApplyParamChangesInBlock(int from, int to);
+  void RenderParamRamps(int nFrames);
+
   IGraphics* mGraphics;
   WDL_PtrList<IParam> mParams;
   WDL_PtrList<IPreset> mPresets;
   WDL_TypedBuf<double*> mInData, mOutData;
+  WDL_TypedBuf<double*> mSegInData, mSegOutData; // mInData/mOutData at the segment offset
+  WDL_TypedBuf<float*> mFInData, mFOutData, mFSegInData, mFSegOutData; // 32 bit host buffers
   WDL_PtrList<InChannel> mInChannels;
   WDL_PtrList<OutChannel> mOutChannels;
   WDL_PtrList<WDL_String> mInputBusLabels;
@@ -103,6 +103,9 @@ bool IPlugStandalone::SendSysEx(ISysEx* pSysEx)
 
 void IPlugStandalone::LockMutexAndProcessDoubleReplacing(double** inputs, double** outputs, int nFrames)
 {
-  IMutexLock lock(this);
+  IMutexLock lock(this, IPLUG_LOCK_PROCESS);
+  IPLUG_DENORMAL_FLUSH_SCOPE
+  IPLUG_ALLOC_TRAP_SCOPE
+  ApplyQueuedParamChanges();
   ProcessDoubleReplacing(inputs, outputs, nFrames);
 }
@@ -331,7 +331,11 @@ VstIntPtr VSTCALLBACK IPlugVST::VSTDispatcher(AEffect *pEffect, VstInt32 opCode,
   {
     return 0;
   }
+#ifdef IPLUG_LOCKFREE_PARAMS
+  IPlugBase::IMutexLock lock(_this, opCode != effProcessEvents); // MIDI arrives on the audio thread
+#else
   IPlugBase::IMutexLock lock(_this);
+#endif
 
   // Handle a couple of opcodes here to make debugging easier.
   switch (opCode)
@@ -859,7 +863,7 @@ void VSTCALLBACK IPlugVST::VSTProcess(AEffect* pEffect, float** inputs, float**
 {
   TRACE_PROCESS;
   IPlugVST* _this = (IPlugVST*) pEffect->object;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   _this->VSTPrepProcess(inputs, outputs, nFrames);
   _this->ProcessBuffersAccumulating((float) 0.0f, nFrames);
 }
@@ -868,7 +872,7 @@ void VSTCALLBACK IPlugVST::VSTProcessReplacing(AEffect* pEffect, float** inputs,
 {
   TRACE_PROCESS;
   IPlugVST* _this = (IPlugVST*) pEffect->object;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   _this->VSTPrepProcess(inputs, outputs, nFrames);
   _this->ProcessBuffers((float) 0.0f, nFrames);
 }
@@ -877,7 +881,7 @@ void VSTCALLBACK IPlugVST::VSTProcessDoubleReplacing(AEffect* pEffect, double**
 {
   TRACE_PROCESS;
   IPlugVST* _this = (IPlugVST*) pEffect->object;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   _this->VSTPrepProcess(inputs, outputs, nFrames);
   _this->ProcessBuffers((double) 0.0, nFrames);
 }
@@ -886,7 +890,7 @@ float VSTCALLBACK IPlugVST::VSTGetParameter(AEffect *pEffect, VstInt32 idx)
 {
   Trace(TRACELOC, "%d", idx);
   IPlugVST* _this = (IPlugVST*) pEffect->object;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   if (idx >= 0 && idx < _this->NParams())
   {
     return (float) _this->GetParam(idx)->GetNormalized();
@@ -898,14 +902,18 @@ void VSTCALLBACK IPlugVST::VSTSetParameter(AEffect *pEffect, VstInt32 idx, float
 {
   Trace(TRACELOC, "%d:%f", idx, value);
   IPlugVST* _this = (IPlugVST*) pEffect->object;
-  IMutexLock lock(_this);
+  IMutexLock lock(_this, IPLUG_LOCK_PROCESS);
   if (idx >= 0 && idx < _this->NParams())
   {
     if (_this->GetGUI())
     {
       _this->GetGUI()->SetParameterFromPlug(idx, value, true);
     }
+#ifdef IPLUG_LOCKFREE_PARAMS
+    _this->QueueParamChangeFromHost(idx, value);
+#else
     _this->GetParam(idx)->SetNormalized(value);
     _this->OnParamChange(idx);
+#endif
   }
 }
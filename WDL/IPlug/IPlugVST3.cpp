@@ -351,11 +351,65 @@ tresult PLUGIN_API IPlugVST3::setupProcessing (ProcessSetup& newSetup)
   return kResultOk;
 }
 
+// The host's channel pointers for the processing sample size.
+static inline Sample32** ChannelBuffers(AudioBusBuffers& bus, Sample32) { return bus.channelBuffers32; }
+static inline Sample64** ChannelBuffers(AudioBusBuffers& bus, Sample64) { return bus.channelBuffers64; }
+
+template <class SAMPLETYPE>
+void IPlugVST3::ProcessAudio(ProcessData& data)
+{
+  if (data.numInputs)
+  {
+    if (mScChans)
+    {
+      if (getAudioInput(1)->isActive()) // Sidechain is active
+      {
+        mSidechainActive = true;
+        SetInputChannelConnections(0, NInChannels(), true);
+      }
+      else
+      {
+        if (mSidechainActive)
+        {
+          ZeroScratchBuffers();
+          mSidechainActive = false;
+        }
+
+        SetInputChannelConnections(0, NInChannels(), true);
+        SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - mScChans, false);
+      }
+
+      AttachInputBuffers(0, NInChannels() - mScChans, ChannelBuffers(data.inputs[0], (SAMPLETYPE) 0), data.numSamples);
+      AttachInputBuffers(mScChans, NInChannels() - mScChans, ChannelBuffers(data.inputs[1], (SAMPLETYPE) 0), data.numSamples);
+    }
+    else
+    {
+      SetInputChannelConnections(0, data.inputs[0].numChannels, true);
+      SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - data.inputs[0].numChannels, false);
+      AttachInputBuffers(0, NInChannels(), ChannelBuffers(data.inputs[0], (SAMPLETYPE) 0), data.numSamples);
+    }
+  }
+
+  for (int outBus = 0, chanOffset = 0; outBus < data.numOutputs; outBus++)
+  {
+    int busChannels = data.outputs[outBus].numChannels;
+    SetOutputChannelConnections(chanOffset, busChannels, (bool) getAudioOutput(outBus)->isActive());
+    SetOutputChannelConnections(chanOffset + busChannels, NOutChannels() - (chanOffset + busChannels), false);
+    AttachOutputBuffers(chanOffset, busChannels, ChannelBuffers(data.outputs[outBus], (SAMPLETYPE) 0));
+    chanOffset += busChannels;
+  }
+
+  if (mIsBypassed)
+    PassThroughBuffers((SAMPLETYPE) 0, data.numSamples);
+  else
+    ProcessBuffers((SAMPLETYPE) 0, data.numSamples);
+}
+
 tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
 {
   TRACE_PROCESS;
 
-  IMutexLock lock(this);
+  IMutexLock lock(this, IPLUG_LOCK_PROCESS);
 
   if(data.processContext)
     memcpy(&mProcessContext, data.processContext, sizeof(ProcessContext));
@@ -366,8 +420,8 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
   {
     int32 numParamsChanged = paramChanges->getParameterCount();
 
-    //it is possible to get a finer resolution of control here by retrieving more values (points) from the queue
-    //for now we just grab the last one
+    //bypass and preset changes take the last point, plugin parameters pass every point on
+    //to IPlugBase (see AddParamChangeInBlock), for sample accurate automation
 
     for (int32 i = 0; i < numParamsChanged; i++)
     {
@@ -402,9 +456,16 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
             default:
               if (idx >= 0 && idx < NParams())
               {
-                GetParam(idx)->SetNormalized((double)value);
+                for (int32 p = 0; p < numPoints; p++)
+                {
+                  int32 pointOffset;
+                  double pointValue;
+                  if (paramQueue->getPoint(p, pointOffset, pointValue) == kResultTrue)
+                  {
+                    AddParamChangeInBlock(idx, pointOffset, pointValue);
+                  }
+                }
                 if (GetGUI()) GetGUI()->SetParameterFromPlug(idx, (double)value, true);
-                OnParamChange(idx);
               }
               break;
           }
@@ -448,106 +509,13 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
     }
   }
 
-#pragma mark process single precision
-
   if (processSetup.symbolicSampleSize == kSample32)
   {
-    if (data.numInputs)
-    {
-      if (mScChans)
-      {
-        if (getAudioInput(1)->isActive()) // Sidechain is active
-        {
-          mSidechainActive = true;
-          SetInputChannelConnections(0, NInChannels(), true);
-        }
-        else
-        {
-          if (mSidechainActive)
-          {
-            ZeroScratchBuffers();
-            mSidechainActive = false;
-          }
-
-          SetInputChannelConnections(0, NInChannels(), true);
-          SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - mScChans, false);
-        }
-
-        AttachInputBuffers(0, NInChannels() - mScChans, data.inputs[0].channelBuffers32, data.numSamples);
-        AttachInputBuffers(mScChans, NInChannels() - mScChans, data.inputs[1].channelBuffers32, data.numSamples);
-      }
-      else
-      {
-        SetInputChannelConnections(0, data.inputs[0].numChannels, true);
-        SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - data.inputs[0].numChannels, false);
-        AttachInputBuffers(0, NInChannels(), data.inputs[0].channelBuffers32, data.numSamples);
-      }
-    }
-
-    for (int outBus = 0, chanOffset = 0; outBus < data.numOutputs; outBus++)
-    {
-      int busChannels = data.outputs[outBus].numChannels;
-      SetOutputChannelConnections(chanOffset, busChannels, (bool) getAudioOutput(outBus)->isActive());
-      SetOutputChannelConnections(chanOffset + busChannels, NOutChannels() - (chanOffset + busChannels), false);
-      AttachOutputBuffers(chanOffset, busChannels, data.outputs[outBus].channelBuffers32);
-      chanOffset += busChannels;
-    }
-
-    if (mIsBypassed)
-      PassThroughBuffers(0.0f, data.numSamples);
-    else
-      ProcessBuffers(0.0f, data.numSamples); // process buffers single precision
+    ProcessAudio<Sample32>(data); // process buffers single precision
   }
-
-#pragma mark process double precision
-
   else if (processSetup.symbolicSampleSize == kSample64)
   {
-    if (data.numInputs)
-    {
-      if (mScChans)
-      {
-        if (getAudioInput(1)->isActive()) // Sidechain is active
-        {
-          mSidechainActive = true;
-          SetInputChannelConnections(0, NInChannels(), true);
-        }
-        else
-        {
-          if (mSidechainActive)
-          {
-            ZeroScratchBuffers();
-            mSidechainActive = false;
-          }
-
-          SetInputChannelConnections(0, NInChannels(), true);
-          SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - mScChans, false);
-        }
-
-        AttachInputBuffers(0, NInChannels() - mScChans, data.inputs[0].channelBuffers64, data.numSamples);
-        AttachInputBuffers(mScChans, NInChannels() - mScChans, data.inputs[1].channelBuffers64, data.numSamples);
-      }
-      else
-      {
-        SetInputChannelConnections(0, data.inputs[0].numChannels, true);
-        SetInputChannelConnections(data.inputs[0].numChannels, NInChannels() - data.inputs[0].numChannels, false);
-        AttachInputBuffers(0, NInChannels(), data.inputs[0].channelBuffers64, data.numSamples);
-      }
-    }
-
-    for (int outBus = 0, chanOffset = 0; outBus < data.numOutputs; outBus++)
-    {
-      int busChannels = data.outputs[outBus].numChannels;
-      SetOutputChannelConnections(chanOffset, busChannels, (bool) getAudioOutput(outBus)->isActive());
-      SetOutputChannelConnections(chanOffset + busChannels, NOutChannels() - (chanOffset + busChannels), false);
-      AttachOutputBuffers(chanOffset, busChannels, data.outputs[outBus].channelBuffers64);
-      chanOffset += busChannels;
-    }
-
-    if (mIsBypassed)
-      PassThroughBuffers(0.0, data.numSamples);
-    else
-      ProcessBuffers(0.0, data.numSamples); // process buffers double precision
+    ProcessAudio<Sample64>(data); // process buffers double precision
   }
 
 // Midi Out
@@ -988,8 +956,11 @@ void IPlugVST3::SetLatency(int latency)
 {
   IPlugBase::SetLatency(latency);
 
-  FUnknownPtr<IComponentHandler>handler(componentHandler);
-  handler->restartComponent(kLatencyChanged);  
+  if (componentHandler) // not yet set while constructing
+  {
+    FUnknownPtr<IComponentHandler>handler(componentHandler);
+    handler->restartComponent(kLatencyChanged);
+  }
 }
 
 void IPlugVST3::PopupHostContextMenuForParam(int param, int x, int y)
@@ -130,6 +130,8 @@ private:
   Steinberg::Vst::AudioBus* getAudioInput(Steinberg::int32 index);
   Steinberg::Vst::AudioBus* getAudioOutput(Steinberg::int32 index);
   Steinberg::Vst::SpeakerArrangement getSpeakerArrForChans(Steinberg::int32 chans);
+  template <class SAMPLETYPE>
+  void ProcessAudio(Steinberg::Vst::ProcessData& data); // Sample32 or Sample64
 
   int mScChans;
   bool mSidechainActive;
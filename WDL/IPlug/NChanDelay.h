@@ -2,60 +2,162 @@
 #define _NCHANDELAY_
 
 // A static delayline used to delay bypassed signals to match mLatency in RTAS/AAX/VST3/AU
-class NChanDelayLine
+
+// Each channel has its own ring buffer in one allocation, processed a block at a time: at most two
+// copies in and two out per channel (memcpy when the host's sample type matches the storage).
+// The ring holds the longest delay plus a block, so the input is stored before the output is
+// read, which makes inputs == outputs safe. Longer blocks are processed in parts.
+
+// Call Reserve() before processing, SetDelayTime() and SetChannelDelayTime() then only allocate
+// if the delay exceeds what was reserved.
+
+#define NCHANDELAY_DEFAULT_BLOCK_SIZE 1024
+
+template <class STORAGETYPE>
+class NChanDelayLineT
 {
 private:
-  WDL_TypedBuf<double> mBuffer;
-  unsigned long mWriteAddress;
-  unsigned int mNumInChans, mNumOutChans;
-  unsigned long mDTSamples;
-  
+  WDL_TypedBuf<STORAGETYPE> mBuffer; // mNumInChans * mSize
+  WDL_TypedBuf<int> mDelays;         // per input channel, in samples
+  int mNumInChans, mNumOutChans;
+  int mSize, mMaxDelay, mMaxBlockSize, mWritePos;
+
+  template <class DEST, class SRC>
+  static void Copy(DEST* pDest, const SRC* pSrc, int n)
+  {
+    for (int i = 0; i < n; ++i)
+    {
+      pDest[i] = (DEST) pSrc[i];
+    }
+  }
+  static void Copy(double* pDest, const double* pSrc, int n) { memcpy(pDest, pSrc, n * sizeof(double)); }
+  static void Copy(float* pDest, const float* pSrc, int n) { memcpy(pDest, pSrc, n * sizeof(float)); }
+
+  void UpdateMaxDelay()
+  {
+    mMaxDelay = 0;
+    for (int chan = 0; chan < mNumInChans; ++chan)
+    {
+      mMaxDelay = wdl_max(mMaxDelay, mDelays.Get()[chan]);
+    }
+  }
+
 public:
-  NChanDelayLine(int maxInputChans = 2, int maxOutputChans = 2)
+  NChanDelayLineT(int maxInputChans = 2, int maxOutputChans = 2)
   : mNumInChans(maxInputChans)
-  , mNumOutChans(maxOutputChans) 
-  , mWriteAddress(0)
-  , mDTSamples(0) {}
-  
-  ~NChanDelayLine() {}
-  
+  , mNumOutChans(maxOutputChans)
+  , mSize(0)
+  , mMaxDelay(0)
+  , mMaxBlockSize(NCHANDELAY_DEFAULT_BLOCK_SIZE)
+  , mWritePos(0)
+  {
+    mDelays.Resize(mNumInChans);
+    memset(mDelays.Get(), 0, mNumInChans * sizeof(int));
+  }
+
+  ~NChanDelayLineT() {}
+
+  // Allocates for delays up to maxDelaySamples, processed maxBlockSize samples at a time.
+  // Never shrinks. Clears the buffer if it has to grow.
+  void Reserve(int maxDelaySamples, int maxBlockSize = NCHANDELAY_DEFAULT_BLOCK_SIZE)
+  {
+    mMaxBlockSize = wdl_max(mMaxBlockSize, maxBlockSize);
+    const int size = wdl_max(maxDelaySamples, mMaxDelay) + mMaxBlockSize;
+
+    if (size > mSize)
+    {
+      mBuffer.Resize(mNumInChans * size);
+      mSize = mBuffer.GetSize() == mNumInChans * size ? size : 0;
+      mWritePos = 0;
+      ClearBuffer();
+    }
+  }
+
+  // All channels.
   void SetDelayTime(int delayTimeSamples)
   {
-    mDTSamples = delayTimeSamples;
-    mBuffer.Resize(mNumInChans * delayTimeSamples);
-    mWriteAddress = 0;
+    delayTimeSamples = wdl_max(delayTimeSamples, 0);
+    for (int chan = 0; chan < mNumInChans; ++chan)
+    {
+      mDelays.Get()[chan] = delayTimeSamples;
+    }
+    mMaxDelay = delayTimeSamples;
+    Reserve(delayTimeSamples);
+    mWritePos = 0;
     ClearBuffer();
   }
-  
+
+  // One channel, keeping the others' and the buffer's contents.
+  void SetChannelDelayTime(int chan, int delayTimeSamples)
+  {
+    if (chan < 0 || chan >= mNumInChans) return;
+    delayTimeSamples = wdl_max(delayTimeSamples, 0);
+    Reserve(delayTimeSamples);
+    mDelays.Get()[chan] = delayTimeSamples;
+    UpdateMaxDelay();
+  }
+
+  int GetDelayTime(int chan = 0) const
+  {
+    return chan >= 0 && chan < mNumInChans ? mDelays.Get()[chan] : 0;
+  }
+
   void ClearBuffer()
   {
-    memset(mBuffer.Get(), 0, mNumInChans * mDTSamples * sizeof(double));
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(STORAGETYPE));
   }
-  
-  void ProcessBlock(double** inputs, double** outputs, int nFrames)
+
+  // SAMPLETYPE is that of the host's buffers (float or double). inputs and outputs may be the
+  // same buffers: IPlugBase::PassThroughBuffers() passes a 32 bit host's buffers straight in
+  template <class SAMPLETYPE>
+  void ProcessBlock(SAMPLETYPE** inputs, SAMPLETYPE** outputs, int nFrames)
   {
-    double* buffer = mBuffer.Get();
-    
-    for (int s = 0 ; s < nFrames; ++s)
+    const int nChans = wdl_min(mNumInChans, mNumOutChans);
+    int chan, pos = 0;
+
+    while (pos < nFrames)
     {
-      signed long readAddress = mWriteAddress - mDTSamples;
-      readAddress %= mDTSamples;
-      
-      for (int chan = 0; chan < mNumInChans; chan++) 
+      if (mSize <= mMaxDelay) // not allocated
       {
-        if (chan < mNumOutChans)
+        for (chan = 0; chan < nChans; ++chan)
         {
-          int offset = chan * mDTSamples;
-          outputs[chan][s] = buffer[offset + readAddress];
-          buffer[offset + mWriteAddress] = inputs[chan][s];
+          if (inputs[chan] != outputs[chan]) Copy(outputs[chan], inputs[chan], nFrames);
         }
+        break;
       }
-      
-      mWriteAddress++;
-      mWriteAddress %= mDTSamples;
+
+      const int n = wdl_min(nFrames - pos, mSize - mMaxDelay), w = mWritePos;
+      const int wn = wdl_min(n, mSize - w);
+
+      for (chan = 0; chan < nChans; ++chan)
+      {
+        STORAGETYPE* pBuf = mBuffer.Get() + chan * mSize;
+        const SAMPLETYPE* pIn = inputs[chan] + pos;
+        SAMPLETYPE* pOut = outputs[chan] + pos;
+
+        Copy(pBuf + w, pIn, wn);
+        Copy(pBuf, pIn + wn, n - wn);
+
+        int r = w - mDelays.Get()[chan];
+        if (r < 0) r += mSize;
+        const int rn = wdl_min(n, mSize - r);
+        Copy(pOut, pBuf + r, rn);
+        Copy(pOut + rn, pBuf, n - rn);
+      }
+
+      mWritePos = w + n < mSize ? w + n : w + n - mSize;
+      pos += n;
+    }
+
+    // zero remaining outs
+    for (chan = nChans; chan < mNumOutChans; ++chan)
+    {
+      memset(outputs[chan], 0, nFrames * sizeof(SAMPLETYPE));
     }
   }
-  
+
 } WDL_FIXALIGN;
 
-#endif //_NCHANDELAY_
\ No newline at end of file
+typedef NChanDelayLineT<double> NChanDelayLine;
+
+#endif //_NCHANDELAY_
@@ -19,3 +19,60 @@ const WDL_BesselFilterCoeffs::complex WDL_BesselFilterCoeffs::mPoles[10 * 3] =
 	complex(-1.8421962445659017e+000, 7.2725759775348364e-001), complex(-1.6618102413500957e+000, 1.2211002185915161e+000),
 	complex(-1.3606922783857325e+000, 1.7335057426584299e+000), complex(-8.6575690170894881e-001, 2.2926048309837426e+000)
 };
+
+
+// Calc() results shared by CalcCached(), replaced round-robin when full
+#ifndef WDL_BESSEL_CACHE_SIZE
+#define WDL_BESSEL_CACHE_SIZE 64
+#endif
+
+#include "mutex.h"
+
+static struct
+{
+	double alpha;
+	int order;
+	double coeffs[10 + 1];
+	double sections[(10 + 1) / 2 * 3];
+} s_cache[WDL_BESSEL_CACHE_SIZE];
+static int s_cache_size, s_cache_next;
+static WDL_Mutex s_cache_mutex;
+
+bool WDL_BesselFilterCoeffs::CacheGet(const double alpha, const int order, double* const coeffs, double* const sections)
+{
+	WDL_MutexLock lock(&s_cache_mutex);
+	for (int i = 0; i < s_cache_size; ++i)
+	{
+		if (s_cache[i].alpha == alpha && s_cache[i].order == order)
+		{
+			memcpy(coeffs, s_cache[i].coeffs, (order + 1) * sizeof(double));
+			memcpy(sections, s_cache[i].sections, (order + 1) / 2 * 3 * sizeof(double));
+			return true;
+		}
+	}
+	return false;
+}
+
+void WDL_BesselFilterCoeffs::CacheAdd(const double alpha, const int order, const double* const coeffs, const double* const sections)
+{
+	WDL_MutexLock lock(&s_cache_mutex);
+	for (int i = 0; i < s_cache_size; ++i)
+	{
+		if (s_cache[i].alpha == alpha && s_cache[i].order == order) return;
+	}
+
+	const int i = s_cache_next;
+	if (++s_cache_next >= WDL_BESSEL_CACHE_SIZE) s_cache_next = 0;
+	if (s_cache_size < WDL_BESSEL_CACHE_SIZE) s_cache_size++;
+
+	s_cache[i].alpha = alpha;
+	s_cache[i].order = order;
+	memcpy(s_cache[i].coeffs, coeffs, (order + 1) * sizeof(double));
+	memcpy(s_cache[i].sections, sections, (order + 1) / 2 * 3 * sizeof(double));
+}
+
+int WDL_BesselFilterCoeffs::CacheSize()
+{
+	WDL_MutexLock lock(&s_cache_mutex);
+	return s_cache_size;
+}
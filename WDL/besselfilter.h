@@ -88,6 +88,22 @@
 		outputs[0][i] = bessel.Output();
 	}
 
+  Example #4:
+
+	#include "besselfilter.h"
+
+	int order = 8;
+	int oversampling = 8;
+
+	// one design shared by all instances, two channels filtered a block at a time
+	WDL_BesselFilterCoeffs coeffs;
+	coeffs.CalcCached(0.5 / (double)oversampling, order);
+
+	WDL_BesselFilterBlock filter;
+	filter.Setup(&coeffs, 2);
+
+	filter.Process(inputs, outputs, nFrames);
+
 */
 
 
@@ -104,17 +120,37 @@
 #include <assert.h>
 
 #include "wdltypes.h"
+#include "heapbuf.h"
+
+// WDL_BesselFilterBlock runs two channels per SSE2/NEON vector, or four per
+// AVX vector if compiled with AVX enabled. Defining WDL_BESSEL_NO_SIMD will
+// disable this.
+#if !defined(WDL_BESSEL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define WDL_BESSEL_SSE2
+	#include <emmintrin.h>
+	#ifdef __AVX__
+		#define WDL_BESSEL_AVX
+		#include <immintrin.h>
+	#endif
+#elif !defined(WDL_BESSEL_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+	#define WDL_BESSEL_NEON
+	#include <arm_neon.h>
+#endif
 
 // By default denormals are zeroed to prevent exessive CPU use. Defining
 // WDL_BESSEL_DENORMAL_IGNORE will disable denormal filtering. Defining
 // WDL_BESSEL_DENORMAL_AGGRESSIVE will filter out denormals more
 // aggressively by zeroing anything below 5.6e-017.
+// WDL_BesselFilterBlock instead zeroes its state after each block once it
+// drops below WDL_BESSEL_BLOCK_FLUSH, long before it could become denormal.
 #ifndef WDL_BESSEL_DENORMAL_IGNORE
 	#include "denormal.h"
 	#if defined(WDL_BESSEL_DENORMAL_AGGRESSIVE)
 		#define WDL_BESSEL_FIX_DENORMAL(a) (denormal_fix_double_aggressive(a))
+		#define WDL_BESSEL_BLOCK_FLUSH 5.6e-017
 	#else
 		#define WDL_BESSEL_FIX_DENORMAL(a) (denormal_fix_double(a))
+		#define WDL_BESSEL_BLOCK_FLUSH 1e-030
 	#endif
 #else
 	#define WDL_BESSEL_FIX_DENORMAL(a) ((void)0)
@@ -207,8 +243,53 @@ public:
 		gain = inverse(gain);
 		mCoeffs[0] = 1./hypot(gain.im, gain.re);
 		for (int i = 1, j = order - 1; i <= order; ++i, --j) mCoeffs[i] = -(coeffs[j].re / coeffs[order].re);
+
+		// same poles as 2nd order sections (and a 1st order section for odd
+		// orders), each with unity DC gain, for WDL_BesselFilterBlock
+		double* sec = mSections;
+		n = 0;
+		if (order & 1)
+		{
+			const double r = zplane[n++].re;
+			sec[0] = 1. - r; sec[1] = r; sec[2] = 0.;
+			sec += 3;
+		}
+		for (; n < order; n += 2, sec += 3)
+		{
+			const double a1 = 2. * zplane[n].re;
+			const double a2 = -(zplane[n].re * zplane[n].re + zplane[n].im * zplane[n].im);
+			sec[0] = 1. - a1 - a2; sec[1] = a1; sec[2] = a2;
+		}
 	}
 
+	// Same as Calc(), but looks up the result in a cache shared by all
+	// instances first (and adds it if not found), so that many filters with
+	// the same cutoff only design it once.
+#ifdef WDL_BESSEL_FILTER_ORDER
+	void CalcCached(const double alpha)
+	{
+		const int order = WDL_BESSEL_FILTER_ORDER;
+		if (!CacheGet(alpha, order, mCoeffs, mSections))
+		{
+			Calc(alpha);
+			CacheAdd(alpha, order, mCoeffs, mSections);
+		}
+	}
+#else
+	void CalcCached(const double alpha, const int order)
+	{
+		mOrder = order;
+		if (!CacheGet(alpha, order, mCoeffs, mSections))
+		{
+			Calc(alpha, order);
+			CacheAdd(alpha, order, mCoeffs, mSections);
+		}
+	}
+#endif
+
+	// Number of designs currently cached
+	static int CacheSize();
+
 	inline int Order() const
 	{
 		#ifdef WDL_BESSEL_FILTER_ORDER
@@ -221,8 +302,13 @@ public:
 	inline const double* Coeffs() const { return mCoeffs; }
 	inline double Gain() const { return mCoeffs[0]; }
 
+	// {gain, a1, a2} per section, y = gain*x + a1*y[-1] + a2*y[-2]
+	inline int NumSections() const { return (Order() + 1) / 2; }
+	inline const double* Sections() const { return mSections; }
+
 protected:
 	double mCoeffs[WDL_BESSEL_FILTER_MAX + 1];
+	double mSections[(WDL_BESSEL_FILTER_MAX + 1) / 2 * 3];
 
 	#ifndef WDL_BESSEL_FILTER_ORDER
 		int mOrder;
@@ -283,6 +369,11 @@ protected:
 
 	// Precalculated Bessel poles
 	static const complex mPoles[10 * 3];
+
+	// Shared design cache (besselfilter.cpp), copies order + 1 coeffs and
+	// (order + 1) / 2 * 3 section coeffs
+	static bool CacheGet(double alpha, int order, double* coeffs, double* sections);
+	static void CacheAdd(double alpha, int order, const double* coeffs, const double* sections);
 } WDL_FIXALIGN;
 
 #ifdef WDL_BESSEL_FILTER_ORDER
@@ -409,4 +500,188 @@ public:
 } WDL_FIXALIGN;
 
 
+// Processes whole blocks of any number of channels through the filter split
+// into 2nd order sections, with channels side by side in SIMD lanes.
+class WDL_BesselFilterBlock
+{
+public:
+	inline WDL_BesselFilterBlock(): mNumSections(0), mNumChannels(0) {}
+
+	// Copies the section coeffs, so bessel need not outlive this. Keeps the
+	// filter state unless the order or number of channels changes.
+	void Setup(const WDL_BesselFilterCoeffs* const bessel, const int nch)
+	{
+		const int ns = bessel->NumSections();
+		memcpy(mSections, bessel->Sections(), ns * 3 * sizeof(double));
+		if (ns != mNumSections || nch != mNumChannels)
+		{
+			mNumSections = ns;
+			mNumChannels = nch;
+			mState.Resize(nch * ns * 2, false);
+			Reset();
+		}
+	}
+
+	// Sections have unity DC gain, so a steady input of value is matched by
+	// value in every section.
+	void Reset(const double value = 0.)
+	{
+		double* const state = mState.Get();
+		for (int i = 0; i < mState.GetSize(); ++i) state[i] = value;
+	}
+
+	inline int NumChannels() const { return mNumChannels; }
+
+	// in and out may be the same buffers
+	void Process(const double* const* const in, double* const* const out, const int nFrames)
+	{
+		const int nch = mNumChannels, n2 = mNumSections * 2;
+		double* const state = mState.Get();
+		int ch = 0;
+		#ifdef WDL_BESSEL_AVX
+			for (; ch + 4 <= nch; ch += 4) ProcessQuad(in + ch, out + ch, state + ch * n2, nFrames);
+		#endif
+		#if defined(WDL_BESSEL_SSE2) || defined(WDL_BESSEL_NEON)
+			for (; ch + 2 <= nch; ch += 2) ProcessPair(in + ch, out + ch, state + ch * n2, nFrames);
+		#endif
+		for (; ch < nch; ++ch) ProcessOne(in[ch], out[ch], state + ch * n2, nFrames);
+
+		#ifdef WDL_BESSEL_BLOCK_FLUSH
+			for (int i = 0; i < mState.GetSize(); ++i)
+			{
+				if (fabs(state[i]) < WDL_BESSEL_BLOCK_FLUSH) state[i] = 0.;
+			}
+		#endif
+	}
+
+protected:
+	// state per channel: {y[-1], y[-2]} per section
+	void ProcessOne(const double* const in, double* const out, double* const state, const int nFrames)
+	{
+		const int ns = mNumSections;
+		for (int i = 0; i < nFrames; ++i)
+		{
+			double x = in[i];
+			const double* sec = mSections;
+			double* st = state;
+			for (int s = 0; s < ns; ++s, sec += 3, st += 2)
+			{
+				const double y = sec[0] * x + sec[1] * st[0] + sec[2] * st[1];
+				st[1] = st[0];
+				st[0] = x = y;
+			}
+			out[i] = x;
+		}
+	}
+
+#if defined(WDL_BESSEL_SSE2) || defined(WDL_BESSEL_NEON)
+	#ifdef WDL_BESSEL_SSE2
+		#define WDL_BESSEL_VEC __m128d
+		#define WDL_BESSEL_SPLAT(x) _mm_set1_pd(x)
+		#define WDL_BESSEL_ADD(a, b) _mm_add_pd(a, b)
+		#define WDL_BESSEL_MUL(a, b) _mm_mul_pd(a, b)
+		#define WDL_BESSEL_GET(v, i) (i ? _mm_cvtsd_f64(_mm_unpackhi_pd(v, v)) : _mm_cvtsd_f64(v))
+		#define WDL_BESSEL_SET(p0, p1) _mm_set_pd(p1, p0)
+	#else
+		#define WDL_BESSEL_VEC float64x2_t
+		#define WDL_BESSEL_SPLAT(x) vdupq_n_f64(x)
+		#define WDL_BESSEL_ADD(a, b) vaddq_f64(a, b)
+		#define WDL_BESSEL_MUL(a, b) vmulq_f64(a, b)
+		#define WDL_BESSEL_GET(v, i) (i ? vgetq_lane_f64(v, 1) : vgetq_lane_f64(v, 0))
+		#define WDL_BESSEL_SET(p0, p1) vcombine_f64(vdup_n_f64(p0), vdup_n_f64(p1))
+	#endif
+
+	// Same arithmetic as ProcessOne() for channels ch and ch + 1
+	void ProcessPair(const double* const* const in, double* const* const out, double* const state, const int nFrames)
+	{
+		const int ns = mNumSections, n2 = ns * 2;
+		WDL_BESSEL_VEC y1[(WDL_BESSEL_FILTER_MAX + 1) / 2], y2[(WDL_BESSEL_FILTER_MAX + 1) / 2];
+		for (int s = 0; s < ns; ++s)
+		{
+			y1[s] = WDL_BESSEL_SET(state[s * 2], state[n2 + s * 2]);
+			y2[s] = WDL_BESSEL_SET(state[s * 2 + 1], state[n2 + s * 2 + 1]);
+		}
+
+		const double* const in0 = in[0], * const in1 = in[1];
+		double* const out0 = out[0], * const out1 = out[1];
+		for (int i = 0; i < nFrames; ++i)
+		{
+			WDL_BESSEL_VEC x = WDL_BESSEL_SET(in0[i], in1[i]);
+			const double* sec = mSections;
+			for (int s = 0; s < ns; ++s, sec += 3)
+			{
+				const WDL_BESSEL_VEC y = WDL_BESSEL_ADD(WDL_BESSEL_ADD(WDL_BESSEL_MUL(WDL_BESSEL_SPLAT(sec[0]), x),
+					WDL_BESSEL_MUL(WDL_BESSEL_SPLAT(sec[1]), y1[s])), WDL_BESSEL_MUL(WDL_BESSEL_SPLAT(sec[2]), y2[s]));
+				y2[s] = y1[s];
+				y1[s] = x = y;
+			}
+			out0[i] = WDL_BESSEL_GET(x, 0);
+			out1[i] = WDL_BESSEL_GET(x, 1);
+		}
+
+		for (int s = 0; s < ns; ++s)
+		{
+			state[s * 2] = WDL_BESSEL_GET(y1[s], 0);
+			state[n2 + s * 2] = WDL_BESSEL_GET(y1[s], 1);
+			state[s * 2 + 1] = WDL_BESSEL_GET(y2[s], 0);
+			state[n2 + s * 2 + 1] = WDL_BESSEL_GET(y2[s], 1);
+		}
+	}
+
+	#undef WDL_BESSEL_VEC
+	#undef WDL_BESSEL_SPLAT
+	#undef WDL_BESSEL_ADD
+	#undef WDL_BESSEL_MUL
+	#undef WDL_BESSEL_GET
+	#undef WDL_BESSEL_SET
+#endif
+
+#ifdef WDL_BESSEL_AVX
+	// Same as ProcessPair() for channels ch..ch + 3
+	void ProcessQuad(const double* const* const in, double* const* const out, double* const state, const int nFrames)
+	{
+		const int ns = mNumSections, n2 = ns * 2;
+		__m256d y1[(WDL_BESSEL_FILTER_MAX + 1) / 2], y2[(WDL_BESSEL_FILTER_MAX + 1) / 2];
+		for (int s = 0; s < ns; ++s)
+		{
+			y1[s] = _mm256_set_pd(state[3 * n2 + s * 2], state[2 * n2 + s * 2], state[n2 + s * 2], state[s * 2]);
+			y2[s] = _mm256_set_pd(state[3 * n2 + s * 2 + 1], state[2 * n2 + s * 2 + 1], state[n2 + s * 2 + 1], state[s * 2 + 1]);
+		}
+
+		for (int i = 0; i < nFrames; ++i)
+		{
+			__m256d x = _mm256_set_pd(in[3][i], in[2][i], in[1][i], in[0][i]);
+			const double* sec = mSections;
+			for (int s = 0; s < ns; ++s, sec += 3)
+			{
+				const __m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(sec[0]), x),
+					_mm256_mul_pd(_mm256_set1_pd(sec[1]), y1[s])), _mm256_mul_pd(_mm256_set1_pd(sec[2]), y2[s]));
+				y2[s] = y1[s];
+				y1[s] = x = y;
+			}
+			double tmp[4];
+			_mm256_storeu_pd(tmp, x);
+			out[0][i] = tmp[0]; out[1][i] = tmp[1]; out[2][i] = tmp[2]; out[3][i] = tmp[3];
+		}
+
+		for (int s = 0; s < ns; ++s)
+		{
+			double tmp1[4], tmp2[4];
+			_mm256_storeu_pd(tmp1, y1[s]);
+			_mm256_storeu_pd(tmp2, y2[s]);
+			for (int c = 0; c < 4; ++c)
+			{
+				state[c * n2 + s * 2] = tmp1[c];
+				state[c * n2 + s * 2 + 1] = tmp2[c];
+			}
+		}
+	}
+#endif
+
+	double mSections[(WDL_BESSEL_FILTER_MAX + 1) / 2 * 3];
+	int mNumSections, mNumChannels;
+	WDL_TypedBuf<double> mState;
+};
+
+
 #endif // _BESSELFILTER_H_
@@ -31,6 +31,8 @@
 #include "convoengine.h"
 
 #include "denormal.h"
+#include "fnv64.h"
+#include "mutex.h"
 
 //#define TIMING
 #include "timing.c"
@@ -38,59 +40,30 @@
 #define CONVOENGINE_SILENCE_THRESH 1.0e-12 // -240dB
 #define CONVOENGINE_IMPULSE_SILENCE_THRESH 1.0e-15 // -300dB
 
-static void WDL_CONVO_CplxMul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFCPLXf *b, int n)
-{
-  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
-  if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re = t1;
-    c[1].re = t5;
-    c[0].im = t3;
-    c[1].im = t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
-}
-static void WDL_CONVO_CplxMul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_CONVO_IMPULSEBUFCPLXf *b, int n)
-{
-  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
-  if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re += t1;
-    c[1].re += t5;
-    c[0].im += t3;
-    c[1].im += t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
+// frequency-domain delay line accumulation: c = sum over the nlist block pairs of hist[x]*imp[x].
+// bins are processed in tiles, so that the accumulator stays in cache while each spectrum
+// is streamed through once, rather than reading and writing all of c for every block.
+#define WDL_CONVO_FDL_TILE 64
+
+static void WDL_CONVO_FDLMulAccum(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX **hist, WDL_CONVO_IMPULSEBUFCPLXf **imp, int nlist, int n)
+{
+  int tpos;
+  for (tpos = 0; tpos < n; tpos += WDL_CONVO_FDL_TILE)
+  {
+    const int tn = n-tpos < WDL_CONVO_FDL_TILE ? n-tpos : WDL_CONVO_FDL_TILE;
+    int x;
+    for (x = 0; x < nlist; x ++)
+    {
+      // first block replaces the output, the rest add to it
+#ifdef WDL_CONVO_WANT_FULLPRECISION_IMPULSE_STORAGE
+      if (!x) WDL_fft_complexmul2(c+tpos,hist[x]+tpos,imp[x]+tpos,tn);
+      else WDL_fft_complexmul3(c+tpos,hist[x]+tpos,imp[x]+tpos,tn);
+#else
+      if (!x) WDL_fft_complexmul2_f(c+tpos,hist[x]+tpos,(const float *)(imp[x]+tpos),tn);
+      else WDL_fft_complexmul3_f(c+tpos,hist[x]+tpos,(const float *)(imp[x]+tpos),tn);
+#endif
+    }
+  }
 }
 
 static bool CompareQueueToBuf(WDL_FastQueue *q, const void *data, int len)
@@ -121,9 +94,61 @@ static bool CompareQueueToBuf(WDL_FastQueue *q, const void *data, int len)
 }
 
 
+static WDL_PtrList<WDL_ConvolutionEngine_ImpulseData> s_impulsecache;
+static WDL_Mutex s_impulsecache_mutex;
+
+WDL_ConvolutionEngine_ImpulseData *WDL_ConvolutionEngine_ImpulseData::Find(WDL_UINT64 hash, int nch, int fft_size, int len)
+{
+  WDL_MutexLock lock(&s_impulsecache_mutex);
+  int x;
+  for (x = 0; x < s_impulsecache.GetSize(); x ++)
+  {
+    WDL_ConvolutionEngine_ImpulseData *d=s_impulsecache.Get(x);
+    if (d->m_hash == hash && d->m_nch == nch && d->m_fft_size == fft_size && d->m_len == len)
+    {
+      d->m_refcnt++;
+      return d;
+    }
+  }
+  return NULL;
+}
+
+WDL_ConvolutionEngine_ImpulseData *WDL_ConvolutionEngine_ImpulseData::Add(WDL_ConvolutionEngine_ImpulseData *d)
+{
+  WDL_ConvolutionEngine_ImpulseData *ex=Find(d->m_hash,d->m_nch,d->m_fft_size,d->m_len);
+  if (ex)
+  {
+    delete d;
+    return ex;
+  }
+  WDL_MutexLock lock(&s_impulsecache_mutex);
+  d->m_refcnt=1;
+  s_impulsecache.Add(d);
+  return d;
+}
+
+void WDL_ConvolutionEngine_ImpulseData::Release(WDL_ConvolutionEngine_ImpulseData *d)
+{
+  if (!d) return;
+  WDL_MutexLock lock(&s_impulsecache_mutex);
+  if (--d->m_refcnt < 1)
+  {
+    s_impulsecache.Delete(s_impulsecache.Find(d));
+    delete d;
+  }
+}
+
+int WDL_ConvolutionEngine_ImpulseData::GetCacheSize()
+{
+  WDL_MutexLock lock(&s_impulsecache_mutex);
+  return s_impulsecache.GetSize();
+}
+
+
 WDL_ConvolutionEngine::WDL_ConvolutionEngine()
 {
   WDL_fft_init();
+  m_impdata=NULL;
   m_impulse_nch=1;
   m_fft_size=0;
   m_impulse_len=0;
@@ -132,6 +157,7 @@ WDL_ConvolutionEngine::WDL_ConvolutionEngine()
 
 WDL_ConvolutionEngine::~WDL_ConvolutionEngine()
 {
+  WDL_ConvolutionEngine_ImpulseData::Release(m_impdata);
 }
 
 int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size, bool forceBrute)
@@ -162,22 +188,44 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
   m_impulse_len=impulse_len;
   m_proc_nch=-1;
 
-
-  if (forceBrute)
+  if (forceBrute) fft_size=0;
+  else if (fft_size<=0)
   {
-    m_fft_size=0;
+    int msz=fft_size<=-16? -fft_size*2 : 32768;
 
-    // save impulse
-    for (x = 0; x < m_impulse_nch; x ++)
-    {
-      WDL_FFT_REAL *imp=impulse->impulses[x].Get()+impulse_sample_offset;
-      int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
-      if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
+    fft_size=32;
+    while (fft_size < impulse_len*2 && fft_size < msz) fft_size*=2;
+  }
 
-      WDL_CONVO_IMPULSEBUFf *impout=m_impulse[x].Resize(lenout)+lenout;
-      while (lenout-->0) *--impout = (WDL_CONVO_IMPULSEBUFf) *imp++;
-    }
+  m_fft_size=fft_size;
+
+  // engines loading the same impulse content with the same layout share one copy of its spectra
+  WDL_UINT64 hash=WDL_FNV64_IV;
+  for (x = 0; x < m_impulse_nch; x ++)
+  {
+    int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
+    if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
+    if (lenout<0) lenout=0;
+    hash=WDL_FNV64(hash,(const unsigned char *)&lenout,sizeof(lenout));
+    if (lenout>0) hash=WDL_FNV64(hash,(const unsigned char *)(impulse->impulses[x].Get()+impulse_sample_offset),lenout*sizeof(WDL_FFT_REAL));
+  }
+
+  WDL_ConvolutionEngine_ImpulseData *olddata=m_impdata;
+  m_impdata=WDL_ConvolutionEngine_ImpulseData::Find(hash,m_impulse_nch,fft_size,impulse_len);
+  if (!m_impdata)
+  {
+    WDL_ConvolutionEngine_ImpulseData *d=new WDL_ConvolutionEngine_ImpulseData;
+    d->m_hash=hash;
+    d->m_nch=m_impulse_nch;
+    d->m_fft_size=fft_size;
+    d->m_len=impulse_len;
+    BuildImpulseData(d,impulse,impulse_sample_offset,max_imp_size);
+    m_impdata=WDL_ConvolutionEngine_ImpulseData::Add(d);
+  }
+  WDL_ConvolutionEngine_ImpulseData::Release(olddata);
 
+  if (!fft_size)
+  {
     for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++)
     {
       m_samplesin[x].Clear();
@@ -188,19 +236,31 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
     return 0;
   }
 
- 
-  if (fft_size<=0)
+  return m_fft_size/2;
+}
+
+void WDL_ConvolutionEngine::BuildImpulseData(WDL_ConvolutionEngine_ImpulseData *d, WDL_ImpulseBuffer *impulse, int impulse_sample_offset, int max_imp_size)
+{
+  int x;
+  const int fft_size=d->m_fft_size;
+
+  if (!fft_size)
   {
-    int msz=fft_size<=-16? -fft_size*2 : 32768;
+    // save impulse
+    for (x = 0; x < d->m_nch; x ++)
+    {
+      WDL_FFT_REAL *imp=impulse->impulses[x].Get()+impulse_sample_offset;
+      int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
+      if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
 
-    fft_size=32;
-    while (fft_size < impulse_len*2 && fft_size < msz) fft_size*=2;
+      WDL_CONVO_IMPULSEBUFf *impout=d->m_impulse[x].Resize(lenout)+lenout;
+      while (lenout-->0) *--impout = (WDL_CONVO_IMPULSEBUFf) *imp++;
+    }
+    return;
   }
 
-  m_fft_size=fft_size;
-
   int impchunksize=fft_size/2;
-  int nblocks=(impulse_len+impchunksize-1)/impchunksize;
+  int nblocks=(d->m_len+impchunksize-1)/impchunksize;
   //char buf[512];
   //sprintf(buf,"il=%d, ffts=%d, cs=%d, nb=%d\n",impulse_len,fft_size,impchunksize,nblocks);
   //OutputDebugString(buf);
@@ -208,14 +268,14 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
   const bool smallerSizeMode=sizeof(WDL_CONVO_IMPULSEBUFf)!=sizeof(WDL_FFT_REAL);
  
   WDL_FFT_REAL scale=(WDL_FFT_REAL) (1.0/fft_size);
-  for (x = 0; x < m_impulse_nch; x ++)
+  for (x = 0; x < d->m_nch; x ++)
   {
     WDL_FFT_REAL *imp=impulse->impulses[x].Get()+impulse_sample_offset;
 
-    WDL_FFT_REAL *imp2=x < m_impulse_nch-1 ? impulse->impulses[x+1].Get()+impulse_sample_offset : NULL;
+    WDL_FFT_REAL *imp2=x < d->m_nch-1 ? impulse->impulses[x+1].Get()+impulse_sample_offset : NULL;
 
-    WDL_CONVO_IMPULSEBUFf *impout=m_impulse[x].Resize((nblocks+!!smallerSizeMode)*fft_size*2);
-    char *zbuf=m_impulse_zflag[x].Resize(nblocks);
+    WDL_CONVO_IMPULSEBUFf *impout=d->m_impulse[x].Resize((nblocks+!!smallerSizeMode)*fft_size*2);
+    char *zbuf=d->m_impulse_zflag[x].Resize(nblocks);
     int lenout=impulse->impulses[x].GetSize()-impulse_sample_offset;  
     if (max_imp_size && lenout>max_imp_size) lenout=max_imp_size;
       
@@ -270,7 +330,6 @@ int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size,
       impout+=fft_size*2;
     }
   }
-  return m_fft_size/2;
 }
 
 
@@ -299,8 +358,8 @@ void WDL_ConvolutionEngine::Add(WDL_FFT_REAL **bufs, int len, int nch)
     {
       int wch=ch;
       if (wch >=m_impulse_nch) wch-=m_impulse_nch;
-      WDL_CONVO_IMPULSEBUFf *imp=m_impulse[wch].Get();
-      int imp_len = m_impulse[wch].GetSize();
+      WDL_CONVO_IMPULSEBUFf *imp=m_impdata ? m_impdata->m_impulse[wch].Get() : NULL;
+      int imp_len = m_impdata ? m_impdata->m_impulse[wch].GetSize() : 0;
 
 
       if (imp_len>0) 
@@ -465,6 +524,39 @@ void WDL_ConvolutionEngine::AddSilenceToOutput(int len, int nch)
   }
 }
 
+void WDL_ConvolutionEngine::Reserve(int blocksize, int nch)
+{
+  if (nch<1 || nch>WDL_CONVO_MAX_PROC_NCH) return;
+  if (nch != m_proc_nch) Add(NULL,0,nch); // sizes the per channel history
+
+  // either queue can hold the whole span from input to output: m_zl_delaypos of silence plus the 
+  // FFT latency, the staggering silence and a block. WDL_Queue compacts once half is read
+  const int span=(m_zl_delaypos + m_fft_size*2 + blocksize)*(int)sizeof(WDL_FFT_REAL);
+  const int histlen=m_fft_size<1 ? (m_impulse_len + blocksize)*(int)sizeof(WDL_FFT_REAL) : 0;
+  int ch;
+  for (ch = 0; ch < nch; ch ++)
+  {
+    m_samplesin[ch].Prealloc(span,blocksize*(int)sizeof(WDL_FFT_REAL));
+
+    m_samplesout[ch].Add(NULL,span*2);
+    m_samplesout[ch].Clear();
+
+    if (histlen>0)
+    {
+      m_samplesin2[ch].Add(NULL,histlen*2);
+      m_samplesin2[ch].Clear();
+    }
+  }
+
+  if (m_fft_size>0)
+  {
+    const int nblocks=(m_impulse_len+m_fft_size/2-1)/(m_fft_size/2);
+    m_combinebuf.Resize(m_fft_size*4);
+    m_fdl_hist.Resize(nblocks,false);
+    m_fdl_imp.Resize(nblocks,false);
+  }
+}
+
 int WDL_ConvolutionEngine::Avail(int want)
 {
   if (m_fft_size<1)
@@ -508,7 +600,8 @@ int WDL_ConvolutionEngine::Avail(int want)
            m_samplesout[ch].Available() < want*(int)sizeof(WDL_FFT_REAL))
     {
       int histpos;
-      if ((histpos=++m_hist_pos[ch]) >= nblocks) histpos=m_hist_pos[ch]=0;
+      // history is written newest-first, so older blocks follow at increasing addresses
+      if ((histpos=--m_hist_pos[ch]) < 0) histpos=m_hist_pos[ch]=nblocks-1;
 
       // get samples from input, to history
       WDL_FFT_REAL *optr = m_samplehist[ch].Get()+histpos*m_fft_size*2;   
@@ -522,7 +615,7 @@ int WDL_ConvolutionEngine::Avail(int want)
       bool nonzflag=false;
       if (mono_impulse_mode)
       {
-        if (++m_hist_pos[ch+1] >= nblocks) m_hist_pos[ch+1]=0;
+        if (--m_hist_pos[ch+1] < 0) m_hist_pos[ch+1]=nblocks-1;
         m_samplesin[ch+1].GetToBuf(0,workbuf2,sz*sizeof(WDL_FFT_REAL));
         m_samplesin[ch+1].Advance(sz*sizeof(WDL_FFT_REAL));
         int i;
@@ -561,8 +654,8 @@ int WDL_ConvolutionEngine::Avail(int want)
       int i;
       for (i = 1; mono_input_mode && i < nblocks; i ++) // start @ 1, since hist[histpos] is no longer used for here
       {
-        int srchistpos = histpos-i;
-        if (srchistpos < 0) srchistpos += nblocks;
+        int srchistpos = histpos+i;
+        if (srchistpos >= nblocks) srchistpos -= nblocks;
         if (!useSilentList || useSilentList[srchistpos]==2) mono_input_mode=false;
       }
 
@@ -585,35 +678,40 @@ int WDL_ConvolutionEngine::Avail(int want)
         m_samplesin[ch+1].Advance(sz*sizeof(WDL_FFT_REAL));
 
         // save a valid copy in sample hist incase we switch from mono to stereo
-        if (++m_hist_pos[ch+1] >= nblocks) m_hist_pos[ch+1]=0;
+        if (--m_hist_pos[ch+1] < 0) m_hist_pos[ch+1]=nblocks-1;
         WDL_FFT_REAL *optr2 = m_samplehist[ch+1].Get()+m_hist_pos[ch+1]*m_fft_size*2;   
         memcpy(optr2,optr,m_fft_size*2*sizeof(WDL_FFT_REAL));
       }
 
-      int applycnt=0;
-      char *useImpSilentList=m_impulse_zflag[srcc].GetSize() == nblocks ? m_impulse_zflag[srcc].Get() : NULL;
+      char *useImpSilentList=m_impdata->m_impulse_zflag[srcc].GetSize() == nblocks ? m_impdata->m_impulse_zflag[srcc].Get() : NULL;
+
+      // gather the non-silent block pairs: impulse blocks 0..nblocks-1 pair with
+      // history blocks histpos..nblocks-1 followed by 0..histpos-1
+      WDL_FFT_COMPLEX **fdl_hist=m_fdl_hist.Resize(nblocks,false);
+      WDL_CONVO_IMPULSEBUFCPLXf **fdl_imp=m_fdl_imp.Resize(nblocks,false);
+      int nlist=0;
 
-      WDL_CONVO_IMPULSEBUFf *impulseptr=m_impulse[srcc].Get();
+      WDL_FFT_REAL *samplehist=m_samplehist[ch].Get();
+      WDL_CONVO_IMPULSEBUFf *impulseptr=m_impdata->m_impulse[srcc].Get();
+      int srchistpos=histpos;
       for (i = 0; i < nblocks; i ++, impulseptr+=m_fft_size*2)
       {
-        int srchistpos = histpos-i;
-        if (srchistpos < 0) srchistpos += nblocks;
-
-        if (useImpSilentList && useImpSilentList[i]<mzfl) continue;
-        if (useSilentList && !useSilentList[srchistpos]) continue; // silent block
-
-        WDL_FFT_REAL *samplehist=m_samplehist[ch].Get() + m_fft_size*srchistpos*2;
-
-        if (applycnt++) // add to output
-          WDL_CONVO_CplxMul3((WDL_FFT_COMPLEX*)workbuf2,(WDL_FFT_COMPLEX*)samplehist,(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr,m_fft_size);   
-        else // replace output
-          WDL_CONVO_CplxMul2((WDL_FFT_COMPLEX*)workbuf2,(WDL_FFT_COMPLEX*)samplehist,(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr,m_fft_size);  
-
+        if ((!useImpSilentList || useImpSilentList[i]>=mzfl) && 
+            (!useSilentList || useSilentList[srchistpos])) // skip silent blocks
+        {
+          fdl_hist[nlist]=(WDL_FFT_COMPLEX*)(samplehist + m_fft_size*srchistpos*2);
+          fdl_imp[nlist++]=(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr;
+        }
+        if (++srchistpos >= nblocks) srchistpos=0;
       }
-      if (!applycnt)
+
+      if (!nlist)
         memset(workbuf2,0,m_fft_size*2*sizeof(WDL_FFT_REAL));
       else
+      {
+        WDL_CONVO_FDLMulAccum((WDL_FFT_COMPLEX*)workbuf2,fdl_hist,fdl_imp,nlist,m_fft_size);
         WDL_fft((WDL_FFT_COMPLEX*)workbuf2,m_fft_size,1);
+      }
 
       WDL_FFT_REAL *olhist=m_overlaphist[ch].Get(); // errors from last time
       WDL_FFT_REAL *p1=workbuf2,*p3=workbuf2+m_fft_size,*p1o=workbuf2;
@@ -705,123 +803,18 @@ void WDL_ConvolutionEngine::Advance(int len)
 **  low latency version
 */
 
-WDL_ConvolutionEngine_Div::WDL_ConvolutionEngine_Div()
-{
-  timingInit();
-  m_proc_nch=2;
-  m_need_feedsilence=true;
-}
-
-int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
-{
-  m_need_feedsilence=true;
-
-  m_engines.Empty(true);
-  if (maxfft_size<0)maxfft_size=-maxfft_size;
-  maxfft_size*=2;
-  if (!maxfft_size || maxfft_size>32768) maxfft_size=32768;
-
-
-  const int MAX_SIZE_FOR_BRUTE=64;
-
-  int fftsize = MAX_SIZE_FOR_BRUTE;
-  int impulsechunksize = MAX_SIZE_FOR_BRUTE;
-
-  if (known_blocksize && !(known_blocksize&(known_blocksize-1)) && known_blocksize>MAX_SIZE_FOR_BRUTE*2)
-  {
-    fftsize=known_blocksize/2;
-    impulsechunksize=known_blocksize/2;
-  }
-  if (latency_allowed*2 > fftsize)
-  {
-    int x = 16;
-    while (x <= latency_allowed) x*=2;
-    if (x>32768) x=32768;
-    fftsize=impulsechunksize=x;
-  }
-
-  int offs=0;
-  int samplesleft=impulse->impulses[0].GetSize()-impulse_offset;
-  if (max_imp_size>0 && samplesleft>max_imp_size) samplesleft=max_imp_size;
-
-  do
-  {
-    WDL_ConvolutionEngine *eng=new WDL_ConvolutionEngine;
-
-    bool wantBrute = !latency_allowed && !offs;
-    if (impulsechunksize*(wantBrute ? 2 : 3) >= samplesleft) impulsechunksize=samplesleft; // early-out, no point going to a larger FFT (since if we did this, we wouldnt have enough samples for a complete next pass)
-    if (fftsize>=maxfft_size) { impulsechunksize=samplesleft; fftsize=maxfft_size; } // if FFTs are as large as possible, finish up
-
-    eng->SetImpulse(impulse,fftsize,offs+impulse_offset,impulsechunksize, wantBrute);
-    eng->m_zl_delaypos = offs;
-    eng->m_zl_dumpage=0;
-    m_engines.Add(eng);
-
-#ifdef WDLCONVO_ZL_ACCOUNTING
-    char buf[512];
-    wsprintf(buf,"ce%d: offs=%d, len=%d, fftsize=%d\n",m_engines.GetSize(),offs,impulsechunksize,fftsize);
-    OutputDebugString(buf);
-#endif
-
-    samplesleft -= impulsechunksize;
-    offs+=impulsechunksize;
-
-#if 1 // this seems about 10% faster (maybe due to better cache use from less sized ffts used?)
-    impulsechunksize=offs*3;
-    fftsize=offs*2;
-#else
-    impulsechunksize=fftsize;
-
-    fftsize*=2;
-#endif
-  }
-  while (samplesleft > 0);
-  
-  return GetLatency();
-}
-
-int WDL_ConvolutionEngine_Div::GetLatency()
-{
-  return m_engines.GetSize() ? m_engines.Get(0)->GetLatency() : 0;
-}
-
-
-void WDL_ConvolutionEngine_Div::Reset()
-{
-  int x;
-  for (x = 0; x < m_engines.GetSize(); x ++)
-  {
-    WDL_ConvolutionEngine *eng=m_engines.Get(x);
-    eng->Reset();
-  }
-  for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++)
-  {
-    m_samplesout[x].Clear();
-  }
-
-  m_need_feedsilence=true;
-}
-
-WDL_ConvolutionEngine_Div::~WDL_ConvolutionEngine_Div()
-{
-  timingPrint();
-  m_engines.Empty(true);
-}
+// these operate on a list of engines which are fed the same input and whose outputs are
+// summed, each at its own delay. used by WDL_ConvolutionEngine_Div and its worker thread.
 
-void WDL_ConvolutionEngine_Div::Add(WDL_FFT_REAL **bufs, int len, int nch)
+static void WDL_CONVO_EnginesAdd(WDL_PtrList<WDL_ConvolutionEngine> *engines, bool feedsilence, WDL_FFT_REAL **bufs, int len, int nch)
 {
-  m_proc_nch=nch;
-
-  bool ns=m_need_feedsilence;
-  m_need_feedsilence=false;
-
   int x;
-  for (x = 0; x < m_engines.GetSize(); x ++)
+  for (x = 0; x < engines->GetSize(); x ++)
   {
-    WDL_ConvolutionEngine *eng=m_engines.Get(x);
-    if (ns)
+    WDL_ConvolutionEngine *eng=engines->Get(x);
+    if (feedsilence)
     {
-      eng->m_zl_dumpage = (x>0 && x < m_engines.GetSize()-1) ? (eng->GetLatency()/4) : 0; // reduce max number of ffts per block by staggering them
+      eng->m_zl_dumpage = (x>0 && x < engines->GetSize()-1) ? (eng->GetLatency()/4) : 0; // reduce max number of ffts per block by staggering them
 
       if (eng->m_zl_dumpage>0)
         eng->Add(NULL,eng->m_zl_dumpage,nch); // added silence to input (to control when fft happens)
@@ -829,33 +822,13 @@ void WDL_ConvolutionEngine_Div::Add(WDL_FFT_REAL **bufs, int len, int nch)
 
     eng->Add(bufs,len,nch);
 
-    if (ns) eng->AddSilenceToOutput(eng->m_zl_delaypos,nch); // add silence to output (to delay output to its correct time)
-
-  }
-}
-WDL_FFT_REAL **WDL_ConvolutionEngine_Div::Get() 
-{
-  int x;
-  for (x = 0; x < m_proc_nch; x ++)
-  {
-    m_get_tmpptrs[x]=(WDL_FFT_REAL *)m_samplesout[x].Get();
-  }
-  return m_get_tmpptrs;
-}
+    if (feedsilence) eng->AddSilenceToOutput(eng->m_zl_delaypos,nch); // add silence to output (to delay output to its correct time)
 
-void WDL_ConvolutionEngine_Div::Advance(int len)
-{
-  int x;
-  for (x = 0; x < m_proc_nch; x ++)
-  {
-    m_samplesout[x].Advance(len*sizeof(WDL_FFT_REAL));
-    m_samplesout[x].Compact();
   }
 }
 
-int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
+static int WDL_CONVO_EnginesAvail(WDL_PtrList<WDL_ConvolutionEngine> *engines, int wantSamples)
 {
-  timingEnter(1);
   int wso=wantSamples;
   int x;
 #ifdef WDLCONVO_ZL_ACCOUNTING
@@ -863,9 +836,9 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
   static int maxcnt=-1;
   int h=0;
 #endif
-  for (x = 0; x < m_engines.GetSize(); x ++)
+  for (x = 0; x < engines->GetSize(); x ++)
   {
-    WDL_ConvolutionEngine *eng=m_engines.Get(x);
+    WDL_ConvolutionEngine *eng=engines->Get(x);
 #ifdef WDLCONVO_ZL_ACCOUNTING
     eng->m_zl_fftcnt=0;
 #endif
@@ -877,7 +850,7 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
     if (eng->m_zl_fftcnt)
       h|=1<<x;
     
-    if (eng->m_zl_fftcnt && x==m_engines.GetSize()-1 && cnt>1)
+    if (eng->m_zl_fftcnt && x==engines->GetSize()-1 && cnt>1)
     {
       char buf[512];
       wsprintf(buf,"fft flags=%08x (%08x=max)\n",h,1<<x);
@@ -900,38 +873,1513 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
     maxcnt=-1;
   }
 #endif
-  if (wantSamples>0)
+  return wantSamples;
+}
+
+// adds len samples of output from every engine to tp[], and advances the engines
+static void WDL_CONVO_EnginesMix(WDL_PtrList<WDL_ConvolutionEngine> *engines, WDL_FFT_REAL **tp, int len, int nch)
+{
+  int x;
+  for (x = 0; x < engines->GetSize(); x ++)
   {
-    WDL_FFT_REAL *tp[WDL_CONVO_MAX_PROC_NCH];
-    for (x =0; x < m_proc_nch; x ++)
-    {
-      memset(tp[x]=(WDL_FFT_REAL*)m_samplesout[x].Add(NULL,wantSamples*sizeof(WDL_FFT_REAL)),0,wantSamples*sizeof(WDL_FFT_REAL));
-    }
+    WDL_ConvolutionEngine *eng=engines->Get(x);
+    if (eng->m_zl_dumpage>0) { eng->Advance(eng->m_zl_dumpage); eng->m_zl_dumpage=0; }
 
-    for (x = 0; x < m_engines.GetSize(); x ++)
+    WDL_FFT_REAL **p=eng->Get();
+    if (p)
     {
-      WDL_ConvolutionEngine *eng=m_engines.Get(x);
-      if (eng->m_zl_dumpage>0) { eng->Advance(eng->m_zl_dumpage); eng->m_zl_dumpage=0; }
-
-      WDL_FFT_REAL **p=eng->Get();
-      if (p)
+      int i;
+      for (i =0; i < nch; i ++)
       {
-        int i;
-        for (i =0; i < m_proc_nch; i ++)
-        {
-          WDL_FFT_REAL *o=tp[i];
-          WDL_FFT_REAL *in=p[i];
-          int j=wantSamples;
-          while (j-->0) *o++ += *in++;
-        }
+        WDL_FFT_REAL *o=tp[i];
+        WDL_FFT_REAL *in=p[i];
+        int j=len;
+        while (j-->0) *o++ += *in++;
       }
-      eng->Advance(wantSamples);
     }
+    eng->Advance(len);
   }
-  timingLeave(1);
+}
 
-  int av=m_samplesout[0].Available()/sizeof(WDL_FFT_REAL);
-  return av>wso ? wso : av;
+
+#ifdef WDL_CONVO_THREAD
+
+/*
+  Runs the tail partitions of a WDL_ConvolutionEngine_Div. Input is queued by the caller's thread
+  and processed in the background; since these partitions begin at offset N in the impulse and use
+  blocks of at most N/2 samples, their output is computed at least N/2 samples before it is needed.
+
+  The processing thread and the worker share no lock: input and output go through ring buffers 
+  allocated by Start(), each with one writer and one reader, which publish their positions after 
+  a memory barrier. Positions count samples since the last Reset() and wrap around. MixOutput() 
+  never waits: output the worker has not delivered in time is left out of that block (unless 
+  the Div's m_thread_offline is set), and input that does not fit restarts the worker.
+*/
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "wdlatomic.h"
+
+class WDL_ConvolutionEngine_Thread
+{
+public:
+  WDL_ConvolutionEngine_Thread();
+  ~WDL_ConvolutionEngine_Thread();
+
+  void Start(int known_blocksize); // call once m_engines is populated, allocates the rings
+  void Reset();
+
+  void Add(WDL_FFT_REAL **bufs, int len, int nch);
+  void MixOutput(WDL_FFT_REAL **tp, int len, int nch, bool wait); // adds len samples of output to tp[]
+
+  WDL_PtrList<WDL_ConvolutionEngine> m_engines; // only used by the worker thread once started
+
+private:
+  bool ProcessPending(); // returns false if there was no input queued
+  void ResetAt(int outofs);
+  void Signal();
+  void WaitSignal();
+  void SetPriorityFromCaller();
+
+  static int PosDiff(int a, int b) { return (int) ((unsigned int)a - (unsigned int)b); }
+  WDL_FFT_REAL *RingPtr(WDL_TypedBuf<WDL_FFT_REAL> *ring, int ch, int pos) 
+  { 
+    return ring->Get() + ch*m_ringsize + ((unsigned int)pos & (m_ringsize-1)); 
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void *p);
+  HANDLE m_thread, m_signal;
+#else
+  static void *ThreadProc(void *p);
+  pthread_t m_thread;
+  pthread_mutex_t m_signal_mutex;
+  pthread_cond_t m_signal;
+  bool m_signaled;
+#endif
+  bool m_running;
+  bool m_priority_set; // worker runs at the priority of the thread calling MixOutput()
+  volatile bool m_quit;
+
+  WDL_TypedBuf<WDL_FFT_REAL> m_inring, m_outring; // WDL_CONVO_MAX_PROC_NCH * m_ringsize
+  int m_ringsize; // power of 2
+
+  // written by the processing thread
+  volatile int m_inwrite, m_outread;
+  volatile int m_resetcnt;
+  int m_reset_inpos, m_reset_outpos, m_reset_nch; // where the worker restarts after a Reset()
+  int m_nch;
+  int m_out_skip; // output before m_reset_outpos, silent
+
+  // written by the worker
+  volatile int m_inread, m_outwrite;
+  volatile int m_reset_ack; // == m_resetcnt once the worker has restarted
+
+  // worker state
+  int m_worker_nch;
+  bool m_need_feedsilence;
+  WDL_TypedBuf<WDL_FFT_REAL> m_procbuf[WDL_CONVO_MAX_PROC_NCH];
+};
+
+WDL_ConvolutionEngine_Thread::WDL_ConvolutionEngine_Thread()
+{
+  m_running=false;
+  m_priority_set=false;
+  m_quit=false;
+  m_ringsize=0;
+  m_inwrite=m_outread=m_inread=m_outwrite=0;
+  m_resetcnt=m_reset_ack=0;
+  m_reset_inpos=m_reset_outpos=m_reset_nch=0;
+  m_nch=m_worker_nch=0;
+  m_out_skip=0;
+  m_need_feedsilence=true;
+#ifdef _WIN32
+  m_thread=NULL;
+  m_signal=CreateEvent(NULL,FALSE,FALSE,NULL);
+#else
+  pthread_mutex_init(&m_signal_mutex,NULL);
+  pthread_cond_init(&m_signal,NULL);
+  m_signaled=false;
+#endif
+}
+
+WDL_ConvolutionEngine_Thread::~WDL_ConvolutionEngine_Thread()
+{
+  if (m_running)
+  {
+    m_quit=true;
+    Signal();
+#ifdef _WIN32
+    WaitForSingleObject(m_thread,INFINITE);
+    CloseHandle(m_thread);
+#else
+    pthread_join(m_thread,NULL);
+#endif
+    m_running=false;
+  }
+#ifdef _WIN32
+  CloseHandle(m_signal);
+#else
+  pthread_cond_destroy(&m_signal);
+  pthread_mutex_destroy(&m_signal_mutex);
+#endif
+  m_engines.Empty(true);
+}
+
+void WDL_ConvolutionEngine_Thread::Start(int known_blocksize)
+{
+  if (m_running) return;
+
+  // the input ring holds what arrives while the worker computes a block, the output ring what 
+  // it computes ahead of time: both are bounded by the latest partition's offset plus its FFT
+  int x, need=0;
+  for (x = 0; x < m_engines.GetSize(); x ++)
+  {
+    WDL_ConvolutionEngine *eng=m_engines.Get(x);
+    need=wdl_max(need,eng->m_zl_delaypos + eng->GetLatency()*4);
+  }
+  need += wdl_max(known_blocksize,4096)*2;
+
+  m_ringsize=1;
+  while (m_ringsize < need) m_ringsize*=2;
+  m_inring.Resize(m_ringsize*WDL_CONVO_MAX_PROC_NCH,false);
+  m_outring.Resize(m_ringsize*WDL_CONVO_MAX_PROC_NCH,false);
+  if (m_inring.GetSize() != m_ringsize*WDL_CONVO_MAX_PROC_NCH || 
+      m_outring.GetSize() != m_ringsize*WDL_CONVO_MAX_PROC_NCH) 
+  {
+    m_ringsize=0;
+    return;
+  }
+  for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++) m_procbuf[x].Resize(m_ringsize,false);
+
+  m_quit=false;
+  m_priority_set=false;
+#ifdef _WIN32
+  unsigned id;
+  m_thread=(HANDLE)_beginthreadex(NULL,0,ThreadProc,this,0,&id);
+  m_running = m_thread!=NULL;
+#else
+  m_running = !pthread_create(&m_thread,NULL,ThreadProc,this);
+#endif
+  // if the thread could not be created, MixOutput() processes on the caller's thread
+}
+
+#ifdef _WIN32
+unsigned WINAPI WDL_ConvolutionEngine_Thread::ThreadProc(void *p)
+#else
+void *WDL_ConvolutionEngine_Thread::ThreadProc(void *p)
+#endif
+{
+  WDL_ConvolutionEngine_Thread *_this = (WDL_ConvolutionEngine_Thread *)p;
+  while (!_this->m_quit)
+  {
+    _this->WaitSignal();
+    while (!_this->m_quit && _this->ProcessPending());
+  }
+  return 0;
+}
+
+void WDL_ConvolutionEngine_Thread::Signal()
+{
+#ifdef _WIN32
+  SetEvent(m_signal);
+#else
+  pthread_mutex_lock(&m_signal_mutex);
+  m_signaled=true;
+  pthread_cond_signal(&m_signal);
+  pthread_mutex_unlock(&m_signal_mutex);
+#endif
+}
+
+void WDL_ConvolutionEngine_Thread::WaitSignal()
+{
+#ifdef _WIN32
+  WaitForSingleObject(m_signal,INFINITE);
+#else
+  pthread_mutex_lock(&m_signal_mutex);
+  while (!m_signaled) pthread_cond_wait(&m_signal,&m_signal_mutex);
+  m_signaled=false;
+  pthread_mutex_unlock(&m_signal_mutex);
+#endif
+}
+
+// running the worker at the processing thread's priority keeps it from falling behind
+// because of threads at normal priority
+void WDL_ConvolutionEngine_Thread::SetPriorityFromCaller()
+{
+  m_priority_set=true;
+#ifdef _WIN32
+  SetThreadPriority(m_thread,GetThreadPriority(GetCurrentThread()));
+#else
+  int policy;
+  struct sched_param param;
+  if (!pthread_getschedparam(pthread_self(),&policy,&param))
+  {
+    pthread_setschedparam(m_thread,policy,&param); // may fail without the right privileges
+  }
+#endif
+}
+
+void WDL_ConvolutionEngine_Thread::Reset()
+{
+  ResetAt(0);
+  m_priority_set=false; // may have been processing on another thread, e.g. HotSwap's warm-up
+}
+
+// processing thread. the worker discards its input and output, and continues with the input 
+// written from now on, whose output is read outofs samples from now
+void WDL_ConvolutionEngine_Thread::ResetAt(int outofs)
+{
+  m_reset_inpos=m_inwrite;
+  m_reset_outpos=(int)((unsigned int)m_outread + outofs);
+  m_reset_nch=m_nch;
+  m_out_skip=outofs;
+  wdl_memory_barrier();
+  m_resetcnt=m_resetcnt+1;
+}
+
+void WDL_ConvolutionEngine_Thread::Add(WDL_FFT_REAL **bufs, int len, int nch)
+{
+  if (!m_ringsize || len<1) return;
+  if (nch > WDL_CONVO_MAX_PROC_NCH) nch=WDL_CONVO_MAX_PROC_NCH;
+  if (nch != m_nch)
+  {
+    m_nch=nch;
+    Reset();
+  }
+
+  // until the worker has restarted, the input before the reset counts as consumed
+  const int w=m_inwrite;
+  const int r = m_reset_ack == m_resetcnt ? m_inread : m_reset_inpos;
+  if (PosDiff(w,r) + len > m_ringsize) 
+  {
+    ResetAt(len); // the worker is far behind: drop this block and restart it
+  }
+  else
+  {
+    int x;
+    for (x = 0; x < nch; x ++)
+    {
+      const int n1=wdl_min(len,m_ringsize - (int)((unsigned int)w & (m_ringsize-1)));
+      WDL_FFT_REAL *p1=RingPtr(&m_inring,x,w), *p2=RingPtr(&m_inring,x,0);
+      if (bufs && bufs[x])
+      {
+        memcpy(p1,bufs[x],n1*sizeof(WDL_FFT_REAL));
+        memcpy(p2,bufs[x]+n1,(len-n1)*sizeof(WDL_FFT_REAL));
+      }
+      else
+      {
+        memset(p1,0,n1*sizeof(WDL_FFT_REAL));
+        memset(p2,0,(len-n1)*sizeof(WDL_FFT_REAL));
+      }
+    }
+    wdl_memory_barrier(); // the samples are written before the worker can see them
+    m_inwrite=(int)((unsigned int)w + len);
+  }
+
+  if (m_running) Signal();
+}
+
+bool WDL_ConvolutionEngine_Thread::ProcessPending()
+{
+  if (!m_ringsize) return false;
+
+  const int resetcnt=m_resetcnt;
+  wdl_memory_barrier();
+  if (resetcnt != m_reset_ack)
+  {
+    m_inread=m_reset_inpos;
+    m_outwrite=m_reset_outpos;
+    m_worker_nch=m_reset_nch;
+    int x;
+    for (x = 0; x < m_engines.GetSize(); x ++) m_engines.Get(x)->Reset();
+    m_need_feedsilence=true;
+    wdl_memory_barrier();
+    m_reset_ack=resetcnt; // if there was another Reset() meanwhile, the next call restarts again
+  }
+
+  const int nch=m_worker_nch, r=m_inread;
+  const int len=wdl_min(PosDiff(m_inwrite,r),m_ringsize);
+  if (len<1 || nch<1) return false;
+  wdl_memory_barrier(); // read the samples after their position
+
+  WDL_FFT_REAL *bufs[WDL_CONVO_MAX_PROC_NCH];
+  int x;
+  for (x = 0; x < nch; x ++)
+  {
+    const int n1=wdl_min(len,m_ringsize - (int)((unsigned int)r & (m_ringsize-1)));
+    bufs[x]=m_procbuf[x].Resize(len,false);
+    memcpy(bufs[x],RingPtr(&m_inring,x,r),n1*sizeof(WDL_FFT_REAL));
+    memcpy(bufs[x]+n1,RingPtr(&m_inring,x,0),(len-n1)*sizeof(WDL_FFT_REAL));
+  }
+  wdl_memory_barrier(); // done reading before the slots can be reused
+  m_inread=(int)((unsigned int)r + len);
+
+  WDL_CONVO_EnginesAdd(&m_engines,m_need_feedsilence,bufs,len,nch);
+  m_need_feedsilence=false;
+
+  const int avail=WDL_CONVO_EnginesAvail(&m_engines,1<<24);
+  if (avail<1) return true;
+
+  for (x = 0; x < nch; x ++)
+  {
+    bufs[x]=m_procbuf[x].Resize(avail,false);
+    memset(bufs[x],0,avail*sizeof(WDL_FFT_REAL));
+  }
+  WDL_CONVO_EnginesMix(&m_engines,bufs,avail,nch);
+
+  // skip output the processing thread has already gone past without it, and never overwrite 
+  // output it has not read yet
+  const int w=m_outwrite, rd=m_outread;
+  int skip=PosDiff(rd,w), n=avail;
+  if (skip<0) skip=0;
+  if (skip>n) skip=n;
+  if (PosDiff(w,rd) + n > m_ringsize) n=m_ringsize - PosDiff(w,rd);
+  for (x = 0; x < nch; x ++)
+  {
+    int i;
+    for (i = skip; i < n; i ++) *RingPtr(&m_outring,x,(int)((unsigned int)w + i)) = bufs[x][i];
+  }
+
+  wdl_memory_barrier(); // the samples are written before the processing thread can see them
+  if (resetcnt == m_resetcnt) m_outwrite=(int)((unsigned int)w + avail);
+  return true;
+}
+
+void WDL_ConvolutionEngine_Thread::MixOutput(WDL_FFT_REAL **tp, int len, int nch, bool wait)
+{
+  if (!m_ringsize) return;
+  if (!m_running) ProcessPending();
+  else if (!m_priority_set) SetPriorityFromCaller();
+
+  const int r=m_outread;
+  int avail=0;
+  for (;;)
+  {
+    if (m_reset_ack == m_resetcnt) avail=PosDiff(m_outwrite,r);
+    if (avail >= len || !wait || !m_running) break;
+#ifdef _WIN32
+    Sleep(0);
+#else
+    sched_yield();
+#endif
+  }
+  if (avail>len) avail=len;
+
+  const int skip=wdl_min(m_out_skip,len);
+  m_out_skip-=skip;
+  if (avail>skip)
+  {
+    wdl_memory_barrier(); // read the samples after their position
+    int x;
+    for (x = 0; x < nch && x < m_nch; x ++)
+    {
+      WDL_FFT_REAL *o=tp[x];
+      int i;
+      for (i = skip; i < avail; i ++) o[i] += *RingPtr(&m_outring,x,(int)((unsigned int)r + i));
+    }
+  }
+  wdl_memory_barrier(); // done reading before the slots can be reused
+  m_outread=(int)((unsigned int)r + len);
+}
+
+#endif // WDL_CONVO_THREAD
+
+
+WDL_ConvolutionEngine_Div::WDL_ConvolutionEngine_Div()
+{
+  timingInit();
+  m_proc_nch=2;
+  m_need_feedsilence=true;
+#ifdef WDL_CONVO_THREAD
+  m_thread_enable=false;
+  m_thread_offline=false;
+  m_thread=NULL;
+#endif
+}
+
+void WDL_ConvolutionEngine_Div::AddPartition(WDL_ImpulseBuffer *impulse, int offs, int len, int fftsize, bool brute, int impulse_offset, int known_blocksize)
+{
+  (void)known_blocksize; // only used by WDL_CONVO_THREAD
+  WDL_ConvolutionEngine *eng=new WDL_ConvolutionEngine;
+  eng->SetImpulse(impulse,fftsize,offs+impulse_offset,len,brute);
+  eng->m_zl_delaypos = offs;
+  eng->m_zl_dumpage=0;
+
+#ifdef WDL_CONVO_THREAD
+  // partitions at or beyond this offset go to the worker thread, provided their blocks
+  // leave it at least half of the offset to compute each one
+  int thread_minoffs = 4096;
+  if (known_blocksize*8 > thread_minoffs) thread_minoffs=known_blocksize*8;
+
+  if (m_thread_enable && offs >= thread_minoffs && eng->GetLatency()*2 <= offs)
+  {
+    if (!m_thread) m_thread = new WDL_ConvolutionEngine_Thread;
+    m_thread->m_engines.Add(eng);
+    return;
+  }
+#endif
+  m_engines.Add(eng);
+
+#ifdef WDLCONVO_ZL_ACCOUNTING
+  char buf[512];
+  wsprintf(buf,"ce%d: offs=%d, len=%d, fftsize=%d\n",m_engines.GetSize(),offs,len,fftsize);
+  OutputDebugString(buf);
+#endif
+}
+
+int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
+{
+  m_need_feedsilence=true;
+
+  m_engines.Empty(true);
+#ifdef WDL_CONVO_THREAD
+  delete m_thread;
+  m_thread=NULL;
+
+  int thread_minoffs = 4096; // see AddPartition()
+  if (known_blocksize*8 > thread_minoffs) thread_minoffs=known_blocksize*8;
+#endif
+  if (maxfft_size<0)maxfft_size=-maxfft_size;
+  maxfft_size*=2;
+  if (!maxfft_size || maxfft_size>32768) maxfft_size=32768;
+
+
+  const int MAX_SIZE_FOR_BRUTE=64;
+
+  int fftsize = MAX_SIZE_FOR_BRUTE;
+  int impulsechunksize = MAX_SIZE_FOR_BRUTE;
+
+  if (known_blocksize && !(known_blocksize&(known_blocksize-1)) && known_blocksize>MAX_SIZE_FOR_BRUTE*2)
+  {
+    fftsize=known_blocksize/2;
+    impulsechunksize=known_blocksize/2;
+  }
+  if (latency_allowed*2 > fftsize)
+  {
+    int x = 16;
+    while (x <= latency_allowed) x*=2;
+    if (x>32768) x=32768;
+    fftsize=impulsechunksize=x;
+  }
+
+  int offs=0;
+  int samplesleft=impulse->impulses[0].GetSize()-impulse_offset;
+  if (max_imp_size>0 && samplesleft>max_imp_size) samplesleft=max_imp_size;
+
+  do
+  {
+    bool wantBrute = !latency_allowed && !offs;
+    if (impulsechunksize*(wantBrute ? 2 : 3) >= samplesleft) impulsechunksize=samplesleft; // early-out, no point going to a larger FFT (since if we did this, we wouldnt have enough samples for a complete next pass)
+    if (fftsize>=maxfft_size) { impulsechunksize=samplesleft; fftsize=maxfft_size; } // if FFTs are as large as possible, finish up
+
+    AddPartition(impulse,offs,impulsechunksize,fftsize,wantBrute,impulse_offset,known_blocksize);
+
+    samplesleft -= impulsechunksize;
+    offs+=impulsechunksize;
+
+#if 1 // this seems about 10% faster (maybe due to better cache use from less sized ffts used?)
+    impulsechunksize=offs*3;
+    fftsize=offs*2;
+#else
+    impulsechunksize=fftsize;
+
+    fftsize*=2;
+#endif
+
+#ifdef WDL_CONVO_THREAD
+    // threaded partitions use blocks of half their offset, so their output is ready well ahead of time
+    if (m_thread_enable && offs >= thread_minoffs) fftsize=offs;
+#endif
+  }
+  while (samplesleft > 0);
+
+#ifdef WDL_CONVO_THREAD
+  if (m_thread) m_thread->Start(known_blocksize);
+#endif
+  
+  return GetLatency();
+}
+
+int WDL_ConvolutionEngine_Div::SetImpulsePlan(WDL_ImpulseBuffer *impulse, const WDL_ConvolutionEngine_Plan *plan, int impulse_offset)
+{
+  const int np=plan ? plan->m_parts.GetSize() : 0;
+  if (!np) return SetImpulse(impulse,0,0,0,impulse_offset);
+
+  m_need_feedsilence=true;
+
+  m_engines.Empty(true);
+#ifdef WDL_CONVO_THREAD
+  delete m_thread;
+  m_thread=NULL;
+#endif
+
+  const int samplesleft=impulse->impulses[0].GetSize()-impulse_offset;
+  const WDL_ConvolutionEngine_Plan::Partition *parts=plan->m_parts.Get();
+  int x;
+  for (x = 0; x < np; x ++)
+  {
+    const int offs=parts[x].offset;
+    if (x && offs >= samplesleft) break;
+
+    int len=parts[x].length;
+    if (x == np-1 || offs+len > samplesleft) len=samplesleft-offs; // last partition takes whatever the plan did not anticipate
+
+    AddPartition(impulse,offs,len,parts[x].fft_size,!parts[x].fft_size,impulse_offset,plan->m_blocksize);
+  }
+
+#ifdef WDL_CONVO_THREAD
+  if (m_thread) m_thread->Start(plan->m_blocksize);
+#endif
+
+  return GetLatency();
+}
+
+int WDL_ConvolutionEngine_Div::GetLatency()
+{
+  return m_engines.GetSize() ? m_engines.Get(0)->GetLatency() : 0;
+}
+
+
+void WDL_ConvolutionEngine_Div::Reset()
+{
+  int x;
+  for (x = 0; x < m_engines.GetSize(); x ++)
+  {
+    WDL_ConvolutionEngine *eng=m_engines.Get(x);
+    eng->Reset();
+  }
+  for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++)
+  {
+    m_samplesout[x].Clear();
+  }
+#ifdef WDL_CONVO_THREAD
+  if (m_thread) m_thread->Reset();
+#endif
+
+  m_need_feedsilence=true;
+}
+
+void WDL_ConvolutionEngine_Div::Reserve(int blocksize, int nch)
+{
+  if (nch<1 || nch>WDL_CONVO_MAX_PROC_NCH) return;
+  int x;
+  for (x = 0; x < m_engines.GetSize(); x ++) m_engines.Get(x)->Reserve(blocksize,nch);
+
+  // Avail() adds up to a block of output, Advance() compacts once half is read
+  for (x = 0; x < nch; x ++)
+  {
+    m_samplesout[x].Add(NULL,blocksize*2*(int)sizeof(WDL_FFT_REAL));
+    m_samplesout[x].Clear();
+  }
+}
+
+WDL_ConvolutionEngine_Div::~WDL_ConvolutionEngine_Div()
+{
+  timingPrint();
+#ifdef WDL_CONVO_THREAD
+  delete m_thread;
+#endif
+  m_engines.Empty(true);
+}
+
+void WDL_ConvolutionEngine_Div::Add(WDL_FFT_REAL **bufs, int len, int nch)
+{
+  m_proc_nch=nch;
+
+  bool ns=m_need_feedsilence;
+  m_need_feedsilence=false;
+
+  WDL_CONVO_EnginesAdd(&m_engines,ns,bufs,len,nch);
+
+#ifdef WDL_CONVO_THREAD
+  if (m_thread) m_thread->Add(bufs,len,nch);
+#endif
+}
+WDL_FFT_REAL **WDL_ConvolutionEngine_Div::Get() 
+{
+  int x;
+  for (x = 0; x < m_proc_nch; x ++)
+  {
+    m_get_tmpptrs[x]=(WDL_FFT_REAL *)m_samplesout[x].Get();
+  }
+  return m_get_tmpptrs;
+}
+
+void WDL_ConvolutionEngine_Div::Advance(int len)
+{
+  int x;
+  for (x = 0; x < m_proc_nch; x ++)
+  {
+    m_samplesout[x].Advance(len*sizeof(WDL_FFT_REAL));
+    m_samplesout[x].Compact();
+  }
+}
+
+int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
+{
+  timingEnter(1);
+  const int wso=wantSamples;
+  int x;
+
+  wantSamples=WDL_CONVO_EnginesAvail(&m_engines,wantSamples);
+
+  if (wantSamples>0)
+  {
+    WDL_FFT_REAL *tp[WDL_CONVO_MAX_PROC_NCH];
+    for (x =0; x < m_proc_nch; x ++)
+    {
+      memset(tp[x]=(WDL_FFT_REAL*)m_samplesout[x].Add(NULL,wantSamples*sizeof(WDL_FFT_REAL)),0,wantSamples*sizeof(WDL_FFT_REAL));
+    }
+
+    WDL_CONVO_EnginesMix(&m_engines,tp,wantSamples,m_proc_nch);
+
+#ifdef WDL_CONVO_THREAD
+    if (m_thread) m_thread->MixOutput(tp,wantSamples,m_proc_nch,m_thread_offline);
+#endif
+  }
+  timingLeave(1);
+
+  int av=m_samplesout[0].Available()/sizeof(WDL_FFT_REAL);
+  return av>wso ? wso : av;
+}
+
+
+/****************************************************************
+**  impulse hot-swapping
+*/
+
+#include "wdlatomic.h"
+
+WDL_ConvolutionEngine_HotSwap::WDL_ConvolutionEngine_HotSwap()
+{
+  m_cur=new WDL_ConvolutionEngine_Div;
+  m_fadeout=m_retire_wait=NULL;
+  m_pending=m_retired=NULL;
+  m_fade_len=4096;
+  m_fade_pos=0;
+  m_proc_nch=0;
+}
+
+WDL_ConvolutionEngine_HotSwap::~WDL_ConvolutionEngine_HotSwap()
+{
+  delete m_cur;
+  delete m_fadeout;
+  delete m_retire_wait;
+  delete (WDL_ConvolutionEngine_Div *)m_pending;
+  delete (WDL_ConvolutionEngine_Div *)m_retired;
+}
+
+void WDL_ConvolutionEngine_HotSwap::PrepareImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
+{
+  Collect();
+
+  WDL_ConvolutionEngine_Div *eng=new WDL_ConvolutionEngine_Div;
+  eng->SetImpulse(impulse,maxfft_size,known_blocksize,max_imp_size,impulse_offset,latency_allowed);
+
+  // size the engine's buffers here rather than on the processing thread. m_proc_nch may be 
+  // changing concurrently, in which case the engine resizes itself on the next Add()
+  eng->Reserve(known_blocksize>0 ? known_blocksize : 1024, m_proc_nch>0 ? m_proc_nch : 2);
+
+  delete (WDL_ConvolutionEngine_Div *)wdl_atomic_swap_ptr(&m_pending,eng); // replaces one that was never picked up
+}
+
+void WDL_ConvolutionEngine_HotSwap::Collect()
+{
+  delete (WDL_ConvolutionEngine_Div *)wdl_atomic_swap_ptr(&m_retired,NULL);
+}
+
+void WDL_ConvolutionEngine_HotSwap::Reset()
+{
+  m_cur->Reset();
+  if (m_fadeout)
+  {
+    m_retire_wait=m_fadeout; // m_retire_wait is always empty while fading
+    m_fadeout=NULL;
+  }
+  int x;
+  for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++)
+  {
+    m_samplesout[x].Clear();
+    m_inhist[x].Clear();
+  }
+  m_fade_pos=0;
+}
+
+void WDL_ConvolutionEngine_HotSwap::Add(WDL_FFT_REAL **bufs, int len, int nch)
+{
+  if (m_retire_wait && !m_retired) 
+  {
+    wdl_atomic_swap_ptr(&m_retired,m_retire_wait);
+    m_retire_wait=NULL;
+  }
+
+  int x;
+  if (nch != m_proc_nch)
+  {
+    for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++) m_inhist[x].Clear();
+    m_proc_nch=nch;
+  }
+
+  if (!m_fadeout && !m_retire_wait && m_pending)
+  {
+    WDL_ConvolutionEngine_Div *eng=(WDL_ConvolutionEngine_Div *)wdl_atomic_swap_ptr(&m_pending,NULL);
+    if (eng)
+    {
+      // feed the new engine the input that the old engine has not produced output for yet,
+      // so that both are at the same point in the stream
+      const int histlen=m_inhist[0].Available()/sizeof(WDL_FFT_REAL);
+      if (histlen>0)
+      {
+        WDL_FFT_REAL *tp[WDL_CONVO_MAX_PROC_NCH];
+        for (x = 0; x < nch; x ++) tp[x]=(WDL_FFT_REAL *)m_inhist[x].Get();
+        eng->Add(tp,histlen,nch);
+      }
+
+      m_fadeout=m_cur;
+      m_cur=eng;
+      m_fade_pos=0;
+      if (!m_fade_len)
+      {
+        m_retire_wait=m_fadeout;
+        m_fadeout=NULL;
+      }
+    }
+  }
+
+  m_cur->Add(bufs,len,nch);
+  if (m_fadeout) m_fadeout->Add(bufs,len,nch);
+
+  for (x = 0; x < nch; x ++)
+  {
+    if (bufs && bufs[x]) m_inhist[x].Add(bufs[x],len*sizeof(WDL_FFT_REAL));
+    else memset(m_inhist[x].Add(NULL,len*sizeof(WDL_FFT_REAL)),0,len*sizeof(WDL_FFT_REAL));
+  }
+}
+
+int WDL_ConvolutionEngine_HotSwap::Avail(int wantSamples)
+{
+  int av=m_samplesout[0].Available()/sizeof(WDL_FFT_REAL);
+  if (av < wantSamples)
+  {
+    const int need=wantSamples-av;
+    int a=m_cur->Avail(need);
+    if (m_fadeout)
+    {
+      const int b=m_fadeout->Avail(need);
+      if (b<a) a=b;
+    }
+
+    if (a>0)
+    {
+      const int nch=m_proc_nch;
+      WDL_FFT_REAL **cp=m_cur->Get();
+      WDL_FFT_REAL **fp=m_fadeout ? m_fadeout->Get() : NULL;
+      int x;
+      for (x = 0; x < nch; x ++)
+      {
+        WDL_FFT_REAL *o=(WDL_FFT_REAL *)m_samplesout[x].Add(NULL,a*sizeof(WDL_FFT_REAL));
+        const WDL_FFT_REAL *in=cp[x];
+        if (!fp) 
+        {
+          memcpy(o,in,a*sizeof(WDL_FFT_REAL));
+        }
+        else
+        {
+          const WDL_FFT_REAL *in2=fp[x];
+          const double sc=1.0/m_fade_len;
+          int i,pos=m_fade_pos;
+          for (i = 0; i < a; i ++, pos ++)
+          {
+            if (pos < m_fade_len) o[i] = in2[i] + (WDL_FFT_REAL) ((in[i]-in2[i]) * (pos*sc));
+            else o[i] = in[i];
+          }
+        }
+        m_inhist[x].Advance(a*sizeof(WDL_FFT_REAL));
+        m_inhist[x].Compact();
+      }
+
+      m_cur->Advance(a);
+      if (m_fadeout)
+      {
+        m_fadeout->Advance(a);
+        if ((m_fade_pos += a) >= m_fade_len)
+        {
+          m_retire_wait=m_fadeout; // handed to Collect() on the next Add()
+          m_fadeout=NULL;
+        }
+      }
+      av+=a;
+    }
+  }
+  return av>wantSamples ? wantSamples : av;
+}
+
+WDL_FFT_REAL **WDL_ConvolutionEngine_HotSwap::Get() 
+{
+  int x;
+  for (x = 0; x < m_proc_nch; x ++)
+  {
+    m_get_tmpptrs[x]=(WDL_FFT_REAL *)m_samplesout[x].Get();
+  }
+  return m_get_tmpptrs;
+}
+
+void WDL_ConvolutionEngine_HotSwap::Advance(int len)
+{
+  int x;
+  for (x = 0; x < m_proc_nch; x ++)
+  {
+    m_samplesout[x].Advance(len*sizeof(WDL_FFT_REAL));
+    m_samplesout[x].Compact();
+  }
+}
+
+
+/****************************************************************
+**  matrix version
+*/
+
+// as WDL_CONVO_FDLMulAccum, for WDL_real_fft() spectra, which store bin n/2 in the imaginary part of bin 0
+static void WDL_CONVO_FDLMulAccumReal(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX **hist, WDL_CONVO_IMPULSEBUFCPLXf **imp, int nlist, int n)
+{
+  WDL_CONVO_FDLMulAccum(c,hist,imp,nlist,n);
+
+  WDL_FFT_REAL dc=0.0, nyq=0.0;
+  int x;
+  for (x = 0; x < nlist; x ++)
+  {
+    dc += hist[x][0].re * imp[x][0].re;
+    nyq += hist[x][0].im * imp[x][0].im;
+  }
+  c[0].re=dc;
+  c[0].im=nyq;
+}
+
+WDL_ConvolutionEngine_Matrix::WDL_ConvolutionEngine_Matrix()
+{
+  WDL_fft_init();
+  m_nin=m_nout=0;
+  m_fft_size=0;
+  m_nblocks=0;
+  m_hist_pos=0;
+  m_in_fill=0;
+}
+
+WDL_ConvolutionEngine_Matrix::~WDL_ConvolutionEngine_Matrix()
+{
+  m_samplesout.Empty(true);
+}
+
+int WDL_ConvolutionEngine_Matrix::SetImpulse(const WDL_TypedBuf<WDL_FFT_REAL> *impulses, int nin, int nout, int fft_size)
+{
+  if (nin<0) nin=0;
+  if (nout<0) nout=0;
+  const int npaths=nin*nout;
+
+  int impulse_len=0;
+  int x;
+  for (x = 0; x < npaths; x ++)
+  {
+    if (impulse_len < impulses[x].GetSize()) impulse_len=impulses[x].GetSize();
+  }
+
+  if (fft_size<=0)
+  {
+    int msz=fft_size<=-16? -fft_size*2 : 32768;
+
+    fft_size=32;
+    while (fft_size < impulse_len*2 && fft_size < msz) fft_size*=2;
+  }
+
+  const int chunksize=fft_size/2;
+  int nblocks=(impulse_len+chunksize-1)/chunksize;
+  if (nblocks<1) nblocks=1;
+
+  m_nin=nin;
+  m_nout=nout;
+  m_fft_size=fft_size;
+  m_nblocks=nblocks;
+
+  const bool smallerSizeMode=sizeof(WDL_CONVO_IMPULSEBUFf)!=sizeof(WDL_FFT_REAL);
+
+  // WDL_real_fft() scales by 2 going forward, and by fft_size going back
+  const WDL_FFT_REAL scale=(WDL_FFT_REAL) (0.25/fft_size);
+  WDL_FFT_REAL *tmp=m_combinebuf.Resize(fft_size*(nout>1?nout:1)); // also ProcessBlock() output space
+  WDL_CONVO_IMPULSEBUFf *impout=m_impulse.Resize(npaths*nblocks*fft_size);
+  char *zbuf=m_impulse_zflag.Resize(npaths*nblocks);
+  for (x = 0; x < npaths; x ++)
+  {
+    const WDL_FFT_REAL *imp=impulses[x].Get();
+    int lenout=impulses[x].GetSize();
+    int bl;
+    for (bl = 0; bl < nblocks; bl ++)
+    {
+      int thissz=lenout;
+      if (thissz > chunksize) thissz=chunksize;
+      lenout -= thissz;
+
+      WDL_FFT_REAL *wr = smallerSizeMode ? tmp : (WDL_FFT_REAL *)impout;
+      WDL_FFT_REAL mv=0.0;
+      int i;
+      for (i = 0; i < thissz; i ++)
+      {
+        WDL_FFT_REAL v=*imp++;
+        WDL_FFT_REAL v2=(WDL_FFT_REAL)fabs(v);
+        if (v2 > mv) mv=v2;
+        wr[i]=denormal_filter_aggressive(v * scale);
+      }
+      for (; i < fft_size; i ++) wr[i]=0.0;
+
+      if (mv>CONVOENGINE_IMPULSE_SILENCE_THRESH)
+      {
+        *zbuf++=1;
+        WDL_real_fft(wr,fft_size,0);
+        if (smallerSizeMode) for (i = 0; i < fft_size; i ++) impout[i]=(WDL_CONVO_IMPULSEBUFf)wr[i];
+      }
+      else 
+      {
+        *zbuf++=0;
+        if (smallerSizeMode) memset(impout,0,fft_size*sizeof(WDL_CONVO_IMPULSEBUFf));
+      }
+      impout+=fft_size;
+    }
+  }
+
+  m_inbuf.Resize(nin*chunksize);
+  m_samplehist.Resize(nin*nblocks*fft_size);
+  m_samplehist_zflag.Resize(nin*nblocks);
+  m_overlaphist.Resize(nout*chunksize);
+  m_fdl_hist.Resize(nin*nblocks);
+  m_fdl_imp.Resize(nin*nblocks);
+  m_get_tmpptrs.Resize(nout);
+  m_fftbufs.Resize(nin > nout ? nin : nout);
+
+  while (m_samplesout.GetSize() > nout) m_samplesout.Delete(m_samplesout.GetSize()-1,true);
+  while (m_samplesout.GetSize() < nout) m_samplesout.Add(new WDL_Queue);
+
+  Reset();
+
+  return chunksize;
+}
+
+void WDL_ConvolutionEngine_Matrix::Reset()
+{
+  m_hist_pos=0;
+  m_in_fill=0;
+  memset(m_samplehist_zflag.Get(),0,m_samplehist_zflag.GetSize());
+  memset(m_overlaphist.Get(),0,m_overlaphist.GetSize()*sizeof(WDL_FFT_REAL));
+  int x;
+  for (x = 0; x < m_samplesout.GetSize(); x ++) m_samplesout.Get(x)->Clear();
+}
+
+void WDL_ConvolutionEngine_Matrix::Add(WDL_FFT_REAL **bufs, int len)
+{
+  const int chunksize=m_fft_size/2;
+  if (chunksize<1) return;
+
+  int pos=0;
+  while (pos < len)
+  {
+    int n=chunksize-m_in_fill;
+    if (n > len-pos) n=len-pos;
+
+    int x;
+    for (x = 0; x < m_nin; x ++)
+    {
+      WDL_FFT_REAL *o=m_inbuf.Get()+x*chunksize+m_in_fill;
+      if (bufs && bufs[x]) memcpy(o,bufs[x]+pos,n*sizeof(WDL_FFT_REAL));
+      else memset(o,0,n*sizeof(WDL_FFT_REAL));
+    }
+    pos+=n;
+    if ((m_in_fill+=n) >= chunksize)
+    {
+      ProcessBlock();
+      m_in_fill=0;
+    }
+  }
+}
+
+void WDL_ConvolutionEngine_Matrix::ProcessBlock()
+{
+  const int fft_size=m_fft_size, chunksize=fft_size/2, nblocks=m_nblocks;
+
+  // history is written newest-first, see WDL_ConvolutionEngine::Avail()
+  if (--m_hist_pos < 0) m_hist_pos=nblocks-1;
+
+  // inputs and outputs are each transformed in one batch
+  WDL_FFT_REAL **fftbufs=m_fftbufs.Get();
+  int nfft=0;
+
+  int x;
+  for (x = 0; x < m_nin; x ++)
+  {
+    WDL_FFT_REAL *optr=m_samplehist.Get() + (x*nblocks+m_hist_pos)*fft_size;
+    const WDL_FFT_REAL *in=m_inbuf.Get()+x*chunksize;
+    bool nonzflag=false;
+    int i;
+    for (i = 0; i < chunksize; i ++)
+    {
+      WDL_FFT_REAL f=optr[i]=denormal_filter_aggressive(in[i]);
+      if (!nonzflag && (f<-CONVOENGINE_SILENCE_THRESH || f>CONVOENGINE_SILENCE_THRESH)) nonzflag=true;
+    }
+    m_samplehist_zflag.Get()[x*nblocks+m_hist_pos]=nonzflag;
+    if (nonzflag)
+    {
+      memset(optr+chunksize,0,chunksize*sizeof(WDL_FFT_REAL));
+      fftbufs[nfft++]=optr;
+    }
+  }
+  WDL_real_fft_batch(fftbufs,nfft,fft_size,0);
+  nfft=0;
+
+  WDL_FFT_REAL *workbufs=m_combinebuf.Resize(fft_size*m_nout,false);
+  WDL_FFT_COMPLEX **fdl_hist=m_fdl_hist.Get();
+  WDL_CONVO_IMPULSEBUFCPLXf **fdl_imp=m_fdl_imp.Get();
+  const char *hzflag=m_samplehist_zflag.Get();
+  const char *izflag=m_impulse_zflag.Get();
+
+  int o;
+  for (o = 0; o < m_nout; o ++)
+  {
+    WDL_FFT_REAL *workbuf=workbufs+o*fft_size;
+    // every input spectrum in the history is shared by all outputs
+    int nlist=0;
+    for (x = 0; x < m_nin; x ++)
+    {
+      const int path=x*m_nout+o;
+      WDL_CONVO_IMPULSEBUFf *impulseptr=m_impulse.Get()+path*nblocks*fft_size;
+      WDL_FFT_REAL *samplehist=m_samplehist.Get()+x*nblocks*fft_size;
+      int srchistpos=m_hist_pos;
+      int i;
+      for (i = 0; i < nblocks; i ++, impulseptr+=fft_size)
+      {
+        if (izflag[path*nblocks+i] && hzflag[x*nblocks+srchistpos])
+        {
+          fdl_hist[nlist]=(WDL_FFT_COMPLEX*)(samplehist + srchistpos*fft_size);
+          fdl_imp[nlist++]=(WDL_CONVO_IMPULSEBUFCPLXf*)impulseptr;
+        }
+        if (++srchistpos >= nblocks) srchistpos=0;
+      }
+    }
+
+    if (!nlist)
+      memset(workbuf,0,fft_size*sizeof(WDL_FFT_REAL));
+    else
+    {
+      WDL_CONVO_FDLMulAccumReal((WDL_FFT_COMPLEX*)workbuf,fdl_hist,fdl_imp,nlist,chunksize);
+      fftbufs[nfft++]=workbuf;
+    }
+  }
+  WDL_real_fft_batch(fftbufs,nfft,fft_size,1);
+
+  for (o = 0; o < m_nout; o ++)
+  {
+    const WDL_FFT_REAL *workbuf=workbufs+o*fft_size;
+    WDL_FFT_REAL *olhist=m_overlaphist.Get()+o*chunksize;
+    WDL_FFT_REAL *out=(WDL_FFT_REAL *)m_samplesout.Get(o)->Add(NULL,chunksize*sizeof(WDL_FFT_REAL));
+    int i;
+    for (i = 0; i < chunksize; i ++)
+    {
+      out[i]=workbuf[i]+olhist[i];
+      olhist[i]=workbuf[chunksize+i];
+    }
+  }
+}
+
+int WDL_ConvolutionEngine_Matrix::Avail(int want)
+{
+  if (!m_nout) return 0;
+  int av=m_samplesout.Get(0)->Available()/sizeof(WDL_FFT_REAL);
+  return av>want ? want : av;
+}
+
+WDL_FFT_REAL **WDL_ConvolutionEngine_Matrix::Get() 
+{
+  WDL_FFT_REAL **p=m_get_tmpptrs.Get();
+  int x;
+  for (x = 0; x < m_nout; x ++)
+  {
+    p[x]=(WDL_FFT_REAL *)m_samplesout.Get(x)->Get();
+  }
+  return p;
+}
+
+void WDL_ConvolutionEngine_Matrix::Advance(int len)
+{
+  int x;
+  for (x = 0; x < m_nout; x ++)
+  {
+    m_samplesout.Get(x)->Advance(len*sizeof(WDL_FFT_REAL));
+    m_samplesout.Get(x)->Compact();
+  }
+}
+
+
+/****************************************************************
+**  partition planner
+*/
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+// shared by all plans: Build() may run on several threads at once, each copies the costs
+// (measuring them first if needed) with the mutex held
+static WDL_Mutex s_plan_costs_mutex;
+static double s_plan_costs[1+WDL_ConvolutionEngine_Plan::COST_NUM_FFT*2];
+static bool s_plan_costs_valid;
+
+static double WDL_CONVO_PlanTime()
+{
+#ifdef _WIN32
+  LARGE_INTEGER now,freq;
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&freq);
+  return now.QuadPart / (double)freq.QuadPart;
+#else
+  struct timeval tm={0,0};
+  gettimeofday(&tm,NULL);
+  return tm.tv_sec + tm.tv_usec*0.000001;
+#endif
+}
+
+void WDL_ConvolutionEngine_Plan::MeasureCosts()
+{
+  WDL_MutexLock lock(&s_plan_costs_mutex);
+  WDL_fft_init();
+
+  // brute force, timed through the engine itself
+  {
+    const int taps=64, len=4096, reps=8;
+    WDL_ImpulseBuffer imp;
+    WDL_FFT_REAL *p=imp.impulses[0].Resize(taps);
+    int x;
+    for (x = 0; x < taps; x ++) p[x] = (WDL_FFT_REAL) (1.0/(x+1));
+
+    WDL_ConvolutionEngine eng;
+    eng.SetImpulse(&imp,-1,0,0,true);
+
+    WDL_TypedBuf<WDL_FFT_REAL> buf;
+    WDL_FFT_REAL *bp=buf.Resize(len);
+    for (x = 0; x < len; x ++) bp[x] = (WDL_FFT_REAL) ((x&7)*0.1);
+
+    const double st=WDL_CONVO_PlanTime();
+    for (x = 0; x < reps; x ++)
+    {
+      eng.Add(&bp,len,1);
+      eng.Advance(eng.Avail(len));
+    }
+    s_plan_costs[0] = (WDL_CONVO_PlanTime()-st) / ((double)reps*len*taps);
+  }
+
+  WDL_TypedBuf<WDL_FFT_REAL> src, work, accum;
+  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFf> imp;
+  int lvl;
+  for (lvl = 0; lvl < COST_NUM_FFT; lvl ++)
+  {
+    const int fftsize = 1<<(lvl+COST_MIN_FFT_LOG2);
+    WDL_FFT_REAL *s=src.Resize(fftsize*2), *w=work.Resize(fftsize*2), *a=accum.Resize(fftsize*2);
+    WDL_CONVO_IMPULSEBUFf *ip=imp.Resize(fftsize*2);
+    int x;
+    for (x = 0; x < fftsize*2; x ++)
+    {
+      s[x] = (WDL_FFT_REAL) (((x*7)&31)*(1.0/32.0) - 0.5);
+      ip[x] = (WDL_CONVO_IMPULSEBUFf) (((x*5)&15)*(1.0/64.0));
+      a[x] = 0.0;
+    }
+
+    int reps = (1<<20) / fftsize;
+    if (reps<8) reps=8;
+
+    double st=WDL_CONVO_PlanTime();
+    for (x = 0; x < reps; x ++)
+    {
+      memcpy(w,s,fftsize*2*sizeof(WDL_FFT_REAL));
+      WDL_fft((WDL_FFT_COMPLEX*)w,fftsize,0);
+      WDL_fft((WDL_FFT_COMPLEX*)w,fftsize,1);
+    }
+    const double fftcost = (WDL_CONVO_PlanTime()-st) / reps;
+
+    WDL_FFT_COMPLEX *hl[8];
+    WDL_CONVO_IMPULSEBUFCPLXf *il[8];
+    for (x = 0; x < 8; x ++) { hl[x]=(WDL_FFT_COMPLEX*)s; il[x]=(WDL_CONVO_IMPULSEBUFCPLXf*)ip; }
+
+    st=WDL_CONVO_PlanTime();
+    for (x = 0; x < reps; x += 8)
+    {
+      WDL_CONVO_FDLMulAccum((WDL_FFT_COMPLEX*)a,hl,il,8,fftsize);
+    }
+    const double mulcost = (WDL_CONVO_PlanTime()-st) / reps;
+
+    s_plan_costs[1+lvl*2] = fftcost;
+    s_plan_costs[2+lvl*2] = mulcost;
+  }
+  s_plan_costs_valid=true;
+}
+
+void WDL_ConvolutionEngine_Plan::GetCosts(double *costs)
+{
+  WDL_MutexLock lock(&s_plan_costs_mutex);
+  if (!s_plan_costs_valid) MeasureCosts();
+  memcpy(costs,s_plan_costs,sizeof(s_plan_costs));
+}
+
+void WDL_ConvolutionEngine_Plan::SaveCosts(WDL_FastString *str)
+{
+  double c[1+COST_NUM_FFT*2];
+  GetCosts(c);
+  str->Set("convocosts 1");
+  int x;
+  for (x = 0; x < 1+COST_NUM_FFT*2; x ++) str->AppendFormatted(64," %.0f",c[x]*1.0e12); // picoseconds
+}
+
+bool WDL_ConvolutionEngine_Plan::LoadCosts(const char *str)
+{
+  if (!str || strncmp(str,"convocosts 1",12)) return false;
+  str+=12;
+
+  double c[1+COST_NUM_FFT*2];
+  int x;
+  for (x = 0; x < 1+COST_NUM_FFT*2; x ++)
+  {
+    char *ep=NULL;
+    const double v=strtod(str,&ep);
+    if (!ep || ep==str || v<=0.0) return false;
+    c[x]=v*1.0e-12;
+    str=ep;
+  }
+  WDL_MutexLock lock(&s_plan_costs_mutex);
+  memcpy(s_plan_costs,c,sizeof(c));
+  s_plan_costs_valid=true;
+  return true;
+}
+
+// a partition using fft size 2^(lvl+COST_MIN_FFT_LOG2) runs at most ceil(blocksize/(fftsize/2))
+// times per block, each time doing a forward and inverse FFT plus one complex multiply per sub-block
+double WDL_ConvolutionEngine_Plan::PartCost(int lvl, int nblocks) const
+{
+  const double *c=m_costs;
+  const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+  const int runs = (m_blocksize+chunk-1)/chunk;
+  return runs * (c[1+lvl*2] + nblocks*c[2+lvl*2]);
+}
+
+// lowest cost to cover the impulse from offs onwards, starting with a partition at level lvl
+double WDL_ConvolutionEngine_Plan::Solve(int lvl, int offs)
+{
+  const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+  const int idx = offs/chunk;
+  double *memo = m_memo_cost[lvl].Get()+idx;
+  if (*memo >= 0.0) return *memo;
+
+  const int MAX_BLOCKS_PER_PARTITION=32; // except the last, which takes the remainder at the largest size
+
+  const int remain = (m_impulse_len-offs+chunk-1)/chunk;
+  int maxn = remain;
+  if (lvl < m_maxlvl && maxn > MAX_BLOCKS_PER_PARTITION) maxn=MAX_BLOCKS_PER_PARTITION;
+
+  double best=-1.0;
+  int bestnext=0;
+  int n;
+  for (n = 1; n <= maxn; n ++)
+  {
+    const double c = PartCost(lvl,n);
+    if (best >= 0.0 && c >= best) break; // only gets worse with more blocks
+
+    const int end = offs + n*chunk;
+    if (n == remain)
+    {
+      best=c;
+      bestnext=n*256;
+      break;
+    }
+
+    int nl;
+    for (nl = lvl+1; nl <= m_maxlvl; nl ++)
+    {
+      const int nchunk = 1<<(nl+COST_MIN_FFT_LOG2-1);
+      if (nchunk > end) break; // the next partition's block must not exceed its offset
+      if (end % nchunk) continue;
+
+      const double t = c + Solve(nl,end);
+      if (best < 0.0 || t < best)
+      {
+        best=t;
+        bestnext=n*256 + nl+1;
+      }
+    }
+  }
+
+  *memo=best;
+  m_memo_next[lvl].Get()[idx]=bestnext;
+  return best;
+}
+
+bool WDL_ConvolutionEngine_Plan::Build(int impulse_len, int blocksize, int latency_allowed, int maxfft_size)
+{
+  m_parts.Resize(0);
+  m_impulse_len=impulse_len;
+  m_blocksize=blocksize>0 ? blocksize : 256;
+  m_latency=0;
+  m_cost=0.0;
+  if (impulse_len<1) return false;
+
+  GetCosts(m_costs);
+  const double *c=m_costs;
+
+  if (maxfft_size<0)maxfft_size=-maxfft_size;
+  maxfft_size*=2;
+  if (!maxfft_size || maxfft_size>32768) maxfft_size=32768;
+  m_maxlvl=0;
+  while (m_maxlvl < COST_NUM_FFT-1 && (1<<(m_maxlvl+1+COST_MIN_FFT_LOG2)) <= maxfft_size) m_maxlvl++;
+
+  int lvl;
+  for (lvl = 0; lvl < COST_NUM_FFT; lvl ++)
+  {
+    const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+    const int n = lvl <= m_maxlvl ? impulse_len/chunk+1 : 0;
+    double *p=m_memo_cost[lvl].Resize(n,false);
+    int x;
+    for (x = 0; x < n; x ++) p[x]=-1.0;
+    m_memo_next[lvl].Resize(n,false);
+  }
+
+  double best=-1.0;
+  int bestlvl=0, bestbrute=0;
+  if (latency_allowed>0)
+  {
+    // first partition starts at 0, with blocks no larger than the latency
+    for (lvl = 0; lvl <= m_maxlvl; lvl ++)
+    {
+      const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+      if (lvl && chunk > latency_allowed) break;
+      const double t=Solve(lvl,0);
+      if (best < 0.0 || t < best) { best=t; bestlvl=lvl; }
+    }
+  }
+  else
+  {
+    // zero latency: brute force head, followed by partitions with blocks no larger than it
+    int brute;
+    for (brute = 16; brute <= 4096; brute *= 2)
+    {
+      if (brute >= impulse_len)
+      {
+        const double t = m_blocksize * (double)impulse_len * c[0];
+        if (best < 0.0 || t < best) { best=t; bestbrute=impulse_len; bestlvl=-1; }
+        break;
+      }
+      for (lvl = 0; lvl <= m_maxlvl; lvl ++)
+      {
+        const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+        if (chunk > brute) break;
+        const double t = m_blocksize * (double)brute * c[0] + Solve(lvl,brute);
+        if (best < 0.0 || t < best) { best=t; bestbrute=brute; bestlvl=lvl; }
+      }
+    }
+  }
+
+  m_cost=best;
+
+  int offs=0;
+  if (bestbrute>0)
+  {
+    Partition *p=m_parts.Resize(1);
+    p->offset=0;
+    p->length=bestbrute;
+    p->fft_size=0;
+    offs=bestbrute;
+  }
+  else
+  {
+    m_latency = 1<<(bestlvl+COST_MIN_FFT_LOG2-1);
+  }
+
+  lvl=bestlvl;
+  while (lvl >= 0 && offs < impulse_len)
+  {
+    const int chunk = 1<<(lvl+COST_MIN_FFT_LOG2-1);
+    const int next = m_memo_next[lvl].Get()[offs/chunk];
+    const int n = next/256;
+    if (n<1) break;
+
+    const int np=m_parts.GetSize();
+    Partition *p=m_parts.Resize(np+1)+np;
+    p->offset=offs;
+    p->length=n*chunk;
+    p->fft_size=chunk*2;
+
+    offs+=n*chunk;
+    lvl=(next&255)-1;
+  }
+
+  for (lvl = 0; lvl < COST_NUM_FFT; lvl ++)
+  {
+    m_memo_cost[lvl].Resize(0);
+    m_memo_next[lvl].Resize(0);
+  }
+  return m_parts.GetSize()>0;
+}
+
+void WDL_ConvolutionEngine_Plan::Save(WDL_FastString *str) const
+{
+  str->SetFormatted(128,"convoplan 1 %d %d %d %d",m_impulse_len,m_blocksize,m_latency,m_parts.GetSize());
+  const Partition *p=m_parts.Get();
+  int x;
+  for (x = 0; x < m_parts.GetSize(); x ++)
+    str->AppendFormatted(128," %d %d %d",p[x].offset,p[x].length,p[x].fft_size);
+}
+
+bool WDL_ConvolutionEngine_Plan::Load(const char *str)
+{
+  if (!str || strncmp(str,"convoplan 1 ",12)) return false;
+  str+=12;
+
+  int hdr[4];
+  int x;
+  for (x = 0; x < 4; x ++)
+  {
+    char *ep=NULL;
+    hdr[x]=(int)strtol(str,&ep,10);
+    if (!ep || ep==str || hdr[x]<0) return false;
+    str=ep;
+  }
+  const int np=hdr[3];
+  if (np<1 || np>4096) return false;
+
+  WDL_TypedBuf<Partition> parts;
+  Partition *p=parts.Resize(np,false);
+  int lastend=0;
+  for (x = 0; x < np; x ++)
+  {
+    int v[3],i;
+    for (i = 0; i < 3; i ++)
+    {
+      char *ep=NULL;
+      v[i]=(int)strtol(str,&ep,10);
+      if (!ep || ep==str || v[i]<0) return false;
+      str=ep;
+    }
+    if (v[0] != lastend || v[1]<1) return false;
+    if (v[2] && (v[2]&(v[2]-1))) return false; // fft sizes are powers of two
+    p[x].offset=v[0];
+    p[x].length=v[1];
+    p[x].fft_size=v[2];
+    lastend=v[0]+v[1];
+  }
+
+  m_impulse_len=hdr[0];
+  m_blocksize=hdr[1];
+  m_latency=hdr[2];
+  m_cost=0.0;
+  m_parts.Resize(np,false);
+  memcpy(m_parts.Get(),p,np*sizeof(Partition));
+  return true;
 }
 
 
@@ -33,6 +33,7 @@
 #include "queue.h"
 #include "fastqueue.h"
 #include "fft.h"
+#include "wdlstring.h"
 
 #ifndef WDL_CONVO_MAX_IMPULSE_NCH
 #define WDL_CONVO_MAX_IMPULSE_NCH 2
@@ -78,6 +79,76 @@ private:
 
 };
 
+// FFT'd (or for brute force, reversed) impulse data. Read-only once built, and shared by all engines
+// which load the same impulse content with the same FFT size and partition (see SetImpulse()).
+class WDL_ConvolutionEngine_ImpulseData
+{
+public:
+  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFf> m_impulse[WDL_CONVO_MAX_IMPULSE_NCH]; // FFT'd data blocks per channel
+  WDL_TypedBuf<char> m_impulse_zflag[WDL_CONVO_MAX_IMPULSE_NCH]; // FFT'd data blocks per channel
+
+  // cache key
+  WDL_UINT64 m_hash;
+  int m_nch, m_fft_size, m_len;
+
+  // these add a reference to the returned data, which must be released with Release()
+  static WDL_ConvolutionEngine_ImpulseData *Find(WDL_UINT64 hash, int nch, int fft_size, int len);
+  static WDL_ConvolutionEngine_ImpulseData *Add(WDL_ConvolutionEngine_ImpulseData *d); // d is deleted if an equivalent was added meanwhile
+  static void Release(WDL_ConvolutionEngine_ImpulseData *d);
+
+  static int GetCacheSize(); // number of distinct impulses currently loaded
+
+private:
+  int m_refcnt;
+};
+
+// partition layout for WDL_ConvolutionEngine_Div::SetImpulsePlan()
+class WDL_ConvolutionEngine_Plan
+{
+public:
+  WDL_ConvolutionEngine_Plan() { m_impulse_len=m_blocksize=m_latency=0; m_cost=0.0; }
+  ~WDL_ConvolutionEngine_Plan() { }
+
+  // chooses the layout with the lowest estimated worst-case cost per block of blocksize samples,
+  // using FFT/complex multiply timings measured on this machine (see MeasureCosts())
+  bool Build(int impulse_len, int blocksize, int latency_allowed=0, int maxfft_size=0);
+
+  // text form, for storing alongside the per-machine costs
+  void Save(WDL_FastString *str) const;
+  bool Load(const char *str);
+
+  typedef struct 
+  {
+    int offset, length;
+    int fft_size; // 0 for brute force
+  } Partition;
+  WDL_TypedBuf<Partition> m_parts;
+
+  int m_impulse_len, m_blocksize, m_latency;
+  double m_cost; // estimated worst-case seconds per block
+
+
+  enum { COST_MIN_FFT_LOG2=5, COST_MAX_FFT_LOG2=15, COST_NUM_FFT=COST_MAX_FFT_LOG2-COST_MIN_FFT_LOG2+1 };
+
+  // per-machine timings, measured on first use by Build() unless LoadCosts() succeeded. 
+  // costs are in seconds: [0]=brute force per tap per sample, then for each fft size from 32 to 32768, 
+  // forward+inverse FFT followed by a complex multiply-accumulate of that size.
+  // thread safe. GetCosts() copies 1+COST_NUM_FFT*2 values
+  static void MeasureCosts();
+  static void GetCosts(double *costs);
+  static void SaveCosts(WDL_FastString *str);
+  static bool LoadCosts(const char *str);
+
+private:
+  double Solve(int lvl, int offs);
+  double PartCost(int lvl, int nblocks) const;
+
+  WDL_TypedBuf<double> m_memo_cost[COST_NUM_FFT];
+  WDL_TypedBuf<int> m_memo_next[COST_NUM_FFT];
+  int m_maxlvl;
+  double m_costs[1+COST_NUM_FFT*2]; // copied by Build()
+};
+
 class WDL_ConvolutionEngine
 {
 public:
@@ -90,6 +161,7 @@ public:
   int GetLatency() { return m_fft_size/2; }
   
   void Reset(); // clears out any latent samples
+  void Reserve(int blocksize, int nch); // after SetImpulse() or Reset(): sizes buffers for Add()s of up to blocksize samples
 
   void Add(WDL_FFT_REAL **bufs, int len, int nch);
 
@@ -98,8 +170,9 @@ public:
   void Advance(int len);
 
 private:
-  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFf> m_impulse[WDL_CONVO_MAX_IMPULSE_NCH]; // FFT'd data blocks per channel
-  WDL_TypedBuf<char> m_impulse_zflag[WDL_CONVO_MAX_IMPULSE_NCH]; // FFT'd data blocks per channel
+  void BuildImpulseData(WDL_ConvolutionEngine_ImpulseData *d, WDL_ImpulseBuffer *impulse, int impulse_sample_offset, int max_imp_size);
+
+  WDL_ConvolutionEngine_ImpulseData *m_impdata; // shared, read-only
 
   int m_impulse_nch;
   int m_fft_size;
@@ -116,6 +189,8 @@ private:
   WDL_TypedBuf<char> m_samplehist_zflag[WDL_CONVO_MAX_IMPULSE_NCH];
   WDL_TypedBuf<WDL_FFT_REAL> m_overlaphist[WDL_CONVO_MAX_PROC_NCH]; 
   WDL_TypedBuf<WDL_FFT_REAL> m_combinebuf;
+  WDL_TypedBuf<WDL_FFT_COMPLEX *> m_fdl_hist; // non-silent block pairs for the current block
+  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFCPLXf *> m_fdl_imp;
 
   WDL_FFT_REAL *m_get_tmpptrs[WDL_CONVO_MAX_PROC_NCH];
 
@@ -133,6 +208,10 @@ public:
 
 } WDL_FIXALIGN;
 
+#ifdef WDL_CONVO_THREAD
+class WDL_ConvolutionEngine_Thread;
+#endif
+
 // low latency version
 class WDL_ConvolutionEngine_Div
 {
@@ -141,9 +220,13 @@ public:
   ~WDL_ConvolutionEngine_Div();
 
   int SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size=0, int known_blocksize=0, int max_imp_size=0, int impulse_offset=0, int latency_allowed=0);
+  int SetImpulsePlan(WDL_ImpulseBuffer *impulse, const WDL_ConvolutionEngine_Plan *plan, int impulse_offset=0); // plan->Build() with the impulse length
 
   int GetLatency();
   void Reset();
+  // after SetImpulse() or Reset(): sizes the buffers of the partitions processed on the calling 
+  // thread for Add()s of up to blocksize samples, so that processing does not allocate
+  void Reserve(int blocksize, int nch);
 
   void Add(WDL_FFT_REAL **bufs, int len, int nch);
 
@@ -151,7 +234,18 @@ public:
   WDL_FFT_REAL **Get(); // returns length valid
   void Advance(int len);
 
+#ifdef WDL_CONVO_THREAD
+  // set before SetImpulse(): partitions late enough in the impulse to have spare latency are
+  // processed by a background thread, leaving only the low latency head on the calling thread
+  bool m_thread_enable;
+  // the processing thread never waits for the background thread: the tail of a block it 
+  // delivers late is dropped. set this when rendering faster than realtime to wait instead
+  bool m_thread_offline;
+#endif
+
 private:
+  void AddPartition(WDL_ImpulseBuffer *impulse, int offs, int len, int fftsize, bool brute, int impulse_offset, int known_blocksize);
+
   WDL_PtrList<WDL_ConvolutionEngine> m_engines;
 
   WDL_Queue m_samplesout[WDL_CONVO_MAX_PROC_NCH];
@@ -160,6 +254,105 @@ private:
   int m_proc_nch;
   bool m_need_feedsilence;
 
+#ifdef WDL_CONVO_THREAD
+  WDL_ConvolutionEngine_Thread *m_thread;
+#endif
+
+} WDL_FIXALIGN;
+
+
+// allows changing the impulse of a WDL_ConvolutionEngine_Div while processing, without locking or 
+// allocating on the processing thread. PrepareImpulse() builds the new engine on the calling thread, 
+// reserving its buffers for blocks of up to known_blocksize samples (1024 if 0) and the current 
+// channel count, and publishes it; the processing thread picks it up in 
+// Add(), runs both engines for the crossfade length, then hands the old engine back to be freed 
+// by the next PrepareImpulse() or Collect().
+// the new impulse should be prepared with the same latency parameters as the old one.
+class WDL_ConvolutionEngine_HotSwap
+{
+public:
+  WDL_ConvolutionEngine_HotSwap();
+  ~WDL_ConvolutionEngine_HotSwap();
+
+  // non-processing thread. a prepared impulse that was not picked up yet is replaced
+  void PrepareImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size=0, int known_blocksize=0, int max_imp_size=0, int impulse_offset=0, int latency_allowed=0);
+  void Collect(); // frees engines retired by the processing thread
+
+  void SetCrossfadeLength(int samples) { m_fade_len = samples>0 ? samples : 0; }
+  int GetCrossfadeLength() const { return m_fade_len; }
+
+  // processing thread
+  int GetLatency() { return m_cur->GetLatency(); }
+  void Reset();
+
+  void Add(WDL_FFT_REAL **bufs, int len, int nch);
+
+  int Avail(int wantSamples);
+  WDL_FFT_REAL **Get(); // returns length valid
+  void Advance(int len);
+
+private:
+  WDL_ConvolutionEngine_Div *m_cur, *m_fadeout, *m_retire_wait;
+  void *m_pending; // WDL_ConvolutionEngine_Div *, exchanged atomically
+  void *m_retired;
+
+  int m_fade_len, m_fade_pos;
+  int m_proc_nch;
+
+  WDL_Queue m_samplesout[WDL_CONVO_MAX_PROC_NCH];
+  WDL_Queue m_inhist[WDL_CONVO_MAX_PROC_NCH]; // input not yet matched by output, used to align a new engine
+  WDL_FFT_REAL *m_get_tmpptrs[WDL_CONVO_MAX_PROC_NCH];
+} WDL_FIXALIGN;
+
+
+// N-in x M-out convolution with runtime channel counts, i.e. true stereo (4 paths) or ambisonic 
+// decoding. Uniformly partitioned: each input is transformed once per block, and its spectrum
+// is reused by every output path. Impulses are real-FFT'd, so no channel pairing is needed.
+class WDL_ConvolutionEngine_Matrix
+{
+public:
+  WDL_ConvolutionEngine_Matrix();
+  ~WDL_ConvolutionEngine_Matrix();
+
+  // impulses[in*nout + out] is the impulse from input in to output out (empty for no path).
+  // fft_size<=0 picks one large enough for the whole impulse (see WDL_ConvolutionEngine)
+  int SetImpulse(const WDL_TypedBuf<WDL_FFT_REAL> *impulses, int nin, int nout, int fft_size=-1);
+
+  int GetFFTSize() { return m_fft_size; }
+  int GetLatency() { return m_fft_size/2; }
+  int GetNumInputs() { return m_nin; }
+  int GetNumOutputs() { return m_nout; }
+
+  void Reset(); // clears out any latent samples
+
+  void Add(WDL_FFT_REAL **bufs, int len); // GetNumInputs() channels, bufs or bufs[x] may be NULL for silence
+
+  int Avail(int wantSamples);
+  WDL_FFT_REAL **Get(); // GetNumOutputs() channels, returns length valid
+  void Advance(int len);
+
+private:
+  void ProcessBlock();
+
+  int m_nin, m_nout;
+  int m_fft_size, m_nblocks;
+  int m_hist_pos, m_in_fill;
+
+  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFf> m_impulse; // [path][block][fft_size], real-FFT'd
+  WDL_TypedBuf<char> m_impulse_zflag; // [path][block]
+
+  WDL_TypedBuf<WDL_FFT_REAL> m_inbuf; // [input][fft_size/2], partial block
+  WDL_TypedBuf<WDL_FFT_REAL> m_samplehist; // [input][block][fft_size], newest first from m_hist_pos
+  WDL_TypedBuf<char> m_samplehist_zflag; // [input][block]
+  WDL_TypedBuf<WDL_FFT_REAL> m_overlaphist; // [output][fft_size/2]
+  WDL_TypedBuf<WDL_FFT_REAL> m_combinebuf;
+
+  WDL_TypedBuf<WDL_FFT_COMPLEX *> m_fdl_hist;
+  WDL_TypedBuf<WDL_CONVO_IMPULSEBUFCPLXf *> m_fdl_imp;
+
+  WDL_PtrList<WDL_Queue> m_samplesout;
+  WDL_TypedBuf<WDL_FFT_REAL *> m_get_tmpptrs;
+  WDL_TypedBuf<WDL_FFT_REAL *> m_fftbufs; // for WDL_real_fft_batch()
 } WDL_FIXALIGN;
 
 
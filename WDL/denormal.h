@@ -159,6 +159,125 @@ static bool WDL_DENORMAL_INLINE WDL_DENORMAL_OR_ZERO_AGGRESSIVE(float *a)
 
 
 #endif // cplusplus versions
+
+
+
+////////////////////
+// block versions: flush a whole buffer (e.g. a feedback/delay line) once per block, instead of
+// testing every sample inside the loop. same results as denormal_fix_*() on each item.
+// define WDL_DENORMAL_NO_SIMD to use the scalar code only
+
+#if !defined(WDL_DENORMAL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define WDL_DENORMAL_SSE2
+  #include <emmintrin.h>
+#endif
+
+#define WDL_DENORMAL_DOUBLE_MIN 2.2250738585072014e-308 // smallest normal double
+#define WDL_DENORMAL_FLOAT_MIN 1.17549435e-38f
+#define WDL_DENORMAL_DOUBLE_AGGRESSIVE_MIN 5.5511151231257827e-17 // 2^-54, the smallest value the _aggressive versions keep
+#define WDL_DENORMAL_FLOAT_AGGRESSIVE_MIN 5.5511151e-17f
+
+static void WDL_DENORMAL_INLINE denormal_fix_double_block(double *buf, int len)
+{
+#ifdef WDL_DENORMAL_SSE2
+  const __m128d absmask=_mm_castsi128_pd(_mm_set_epi32(0x7fffffff,-1,0x7fffffff,-1)), thr=_mm_set1_pd(WDL_DENORMAL_DOUBLE_MIN);
+  for (; len >= 2; len -= 2, buf += 2)
+  {
+    const __m128d v=_mm_loadu_pd(buf);
+    _mm_storeu_pd(buf,_mm_and_pd(v,_mm_cmpnlt_pd(_mm_and_pd(v,absmask),thr))); // NaN is kept
+  }
+#endif
+  for (; len > 0; len --, buf ++) denormal_fix_double(buf);
+}
+
+static void WDL_DENORMAL_INLINE denormal_fix_double_block_aggressive(double *buf, int len)
+{
+#ifdef WDL_DENORMAL_SSE2
+  const __m128d absmask=_mm_castsi128_pd(_mm_set_epi32(0x7fffffff,-1,0x7fffffff,-1));
+  const __m128d thr=_mm_set1_pd(WDL_DENORMAL_DOUBLE_AGGRESSIVE_MIN), inf=_mm_castsi128_pd(_mm_set_epi32(0x7ff00000,0,0x7ff00000,0));
+  for (; len >= 2; len -= 2, buf += 2)
+  {
+    const __m128d v=_mm_loadu_pd(buf), a=_mm_and_pd(v,absmask);
+    _mm_storeu_pd(buf,_mm_and_pd(v,_mm_and_pd(_mm_cmpge_pd(a,thr),_mm_cmplt_pd(a,inf)))); // inf and NaN become 0.0
+  }
+#endif
+  for (; len > 0; len --, buf ++) denormal_fix_double_aggressive(buf);
+}
+
+static void WDL_DENORMAL_INLINE denormal_fix_float_block(float *buf, int len)
+{
+#ifdef WDL_DENORMAL_SSE2
+  const __m128 absmask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)), thr=_mm_set1_ps(WDL_DENORMAL_FLOAT_MIN);
+  for (; len >= 4; len -= 4, buf += 4)
+  {
+    const __m128 v=_mm_loadu_ps(buf);
+    _mm_storeu_ps(buf,_mm_and_ps(v,_mm_cmpnlt_ps(_mm_and_ps(v,absmask),thr)));
+  }
+#endif
+  for (; len > 0; len --, buf ++) denormal_fix_float(buf);
+}
+
+static void WDL_DENORMAL_INLINE denormal_fix_float_block_aggressive(float *buf, int len)
+{
+#ifdef WDL_DENORMAL_SSE2
+  const __m128 absmask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 thr=_mm_set1_ps(WDL_DENORMAL_FLOAT_AGGRESSIVE_MIN), inf=_mm_castsi128_ps(_mm_set1_epi32(0x7f800000));
+  for (; len >= 4; len -= 4, buf += 4)
+  {
+    const __m128 v=_mm_loadu_ps(buf), a=_mm_and_ps(v,absmask);
+    _mm_storeu_ps(buf,_mm_and_ps(v,_mm_and_ps(_mm_cmpge_ps(a,thr),_mm_cmplt_ps(a,inf))));
+  }
+#endif
+  for (; len > 0; len --, buf ++) denormal_fix_float_aggressive(buf);
+}
+
+
+
+////////////////////
+// WDL_DenormalFlushScope: sets the FPU to flush denormals to zero (FTZ, and DAZ on x86: denormal
+// inputs read as zero) for its lifetime, then restores the previous mode. put one around audio
+// processing, and loops no longer need per-sample denormal checks (feedback state still wants
+// an occasional block flush if it must be exactly 0.0, e.g. for silence detection).
+// x86 SSE (MXCSR) and ARM64 (FPCR.FZ) only, elsewhere it does nothing. x87 math is unaffected
+
+#ifdef __cplusplus
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+  #include <xmmintrin.h>
+  #define WDL_DENORMAL_HAS_FLUSHSCOPE
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+  #define WDL_DENORMAL_HAS_FLUSHSCOPE
+#endif
+
+class WDL_DenormalFlushScope
+{
+public:
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+  WDL_DenormalFlushScope() { m_old=_mm_getcsr(); _mm_setcsr(m_old | 0x8040); } // FTZ|DAZ
+  ~WDL_DenormalFlushScope() { _mm_setcsr(m_old); }
+private:
+  unsigned int m_old;
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+  WDL_DenormalFlushScope()
+  {
+    unsigned long long v;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(v));
+    m_old=v;
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(v | (1ULL<<24))); // FZ
+  }
+  ~WDL_DenormalFlushScope() { __asm__ __volatile__("msr fpcr, %0" : : "r"(m_old)); }
+private:
+  unsigned long long m_old;
+#else
+  WDL_DenormalFlushScope() { }
+#endif
+
+private: // not copyable
+  WDL_DenormalFlushScope(const WDL_DenormalFlushScope &);
+  WDL_DenormalFlushScope &operator=(const WDL_DenormalFlushScope &);
+};
+
+#endif // __cplusplus
  
 
 
@@ -103,6 +103,32 @@ public:
     return ret;
   }
 
+  // keeps enough empty blocks that up to len bytes can be queued, by Add()s of up to maxadd 
+  // bytes each, without allocating
+  void Prealloc(int len, int maxadd=0)
+  {
+    const int sz=maxadd*2 > m_bsize ? maxadd*2 : m_bsize; // a block always fits at least half its size
+    int x=m_empties.GetSize();
+    while (--x >= 0) if (m_empties.Get(x)->alloc_size < sz) m_empties.Delete(x,true,free); // Add() would toss these
+
+    const int n=len/(sz-maxadd) + 2; // plus the partially read and partially written ends
+    while (m_queue.GetSize()+m_empties.GetSize() < n)
+    {
+      fqBuf *qb=(fqBuf *)malloc(sz + sizeof(fqBuf) - sizeof(qb->data));
+      if (!qb) break;
+      qb->alloc_size=sz;
+      qb->used=0;
+      m_empties.Add(qb);
+    }
+
+    // either list may end up holding every block, and neither shrinks its storage
+    const int qs=m_queue.GetSize(), es=m_empties.GetSize();
+    while (m_queue.GetSize() < n) m_queue.Add(NULL);
+    while (m_empties.GetSize() < n) m_empties.Add(NULL);
+    while (m_queue.GetSize() > qs) m_queue.Delete(m_queue.GetSize()-1);
+    while (m_empties.GetSize() > es) m_empties.Delete(m_empties.GetSize()-1);
+  }
+
   void Clear(int limitmaxempties=-1)
   {
     int x=m_queue.GetSize();
@@ -59,6 +59,14 @@ static WDL_FFT_COMPLEX d32768[4095];
 
 #define sqrthalf (d16[1].re)
 
+/* twiddles for the vectorized passes: for each size 32..32768, the N/4 values that the
+   scalar pass uses at each bin (entries for bins with special-cased butterflies are unused) */
+static WDL_FFT_COMPLEX s_fft_tw[32768/2 - 8];
+#define FFT_TW(q) (s_fft_tw + (q) - 8) /* q = N/4 */
+
+typedef void (*WDL_FFT_PASSFUNC)(WDL_FFT_COMPLEX **bufs, int nbufs, unsigned int offs, const WDL_FFT_COMPLEX *tw, unsigned int k, unsigned int kend, unsigned int q);
+static WDL_FFT_PASSFUNC s_fft_cpass, s_fft_upass; /* 0 for scalar */
+
 #define VOL *(volatile WDL_FFT_REAL *)&
 
 #define TRANSFORM(a0,a1,a2,a3,wre,wim) { \
@@ -419,6 +427,14 @@ static void cpass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   a2 = a + 4 * n;
   a1 = a + 2 * n;
   a3 = a2 + 2 * n;
+
+  if (s_fft_cpass)
+  {
+    WDL_FFT_COMPLEX *buf = a;
+    TRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
+    s_fft_cpass(&buf,1,0,FFT_TW(2*n),1,2*n,2*n);
+    return;
+  }
   --n;
 
   TRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
@@ -490,6 +506,16 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 = a2 + 2 * n;
   k = n - 2;
 
+  if (s_fft_cpass)
+  {
+    WDL_FFT_COMPLEX *buf = a;
+    TRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
+    s_fft_cpass(&buf,1,0,FFT_TW(2*n),1,n,2*n);
+    TRANSFORMHALF(a[n],a1[n],a2[n],a3[n]);
+    s_fft_cpass(&buf,1,0,FFT_TW(2*n),n+1,2*n,2*n);
+    return;
+  }
+
   TRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
   TRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
   a += 2;
@@ -576,87 +602,818 @@ static void c32768(register WDL_FFT_COMPLEX *a)
 }
 
 
+/*
+  complex multiply kernels.
+
+  the SIMD versions perform exactly the same multiplies and adds as the scalar versions (no fused
+  multiply-add, and no reordering), so results are bit-identical at every WDL_fft_set_simd() level.
+*/
+
+#if !defined(WDL_FFT_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+  #define WDL_FFT_SIMD_X86
+  #if !defined(_MSC_VER) || _MSC_VER >= 1910
+    #define WDL_FFT_SIMD_AVX512
+  #endif
+#elif !defined(WDL_FFT_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64) || (defined(__ARM_NEON) && WDL_FFT_REALSIZE == 4))
+  #define WDL_FFT_SIMD_NEON
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+  // keep GCC from fusing multiplies and adds (or auto-vectorizing into fmaddsub) on FMA-capable targets
+  #define WDL_FFT_NOCONTRACT __attribute__((optimize("fp-contract=off","no-tree-vectorize")))
+#else
+  #define WDL_FFT_NOCONTRACT
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define WDL_FFT_TARGET(x) __attribute__((target(x))) WDL_FFT_NOCONTRACT
+#else
+  #define WDL_FFT_TARGET(x)
+#endif
+
+#ifdef WDL_FFT_SIMD_X86
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+  #include <immintrin.h>
+#elif defined(WDL_FFT_SIMD_NEON)
+  #include <arm_neon.h>
+#endif
+
+typedef void (*WDL_FFT_CMULFUNC)(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const WDL_FFT_COMPLEX *b, int n);
+typedef void (*WDL_FFT_CMULFUNC_F)(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const float *b, int n);
+typedef void (*WDL_FFT_CMULFUNC_SPLIT)(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n);
+
+
+/* scalar */
+
+#define CMUL_SCALAR(OP, bre, bim) { \
+  t1 = a[i].re * (bre); \
+  t2 = a[i].im * (bim); \
+  t3 = a[i].im * (bre); \
+  t4 = a[i].re * (bim); \
+  t1 -= t2; \
+  t3 += t4; \
+  c[i].re OP t1; \
+  c[i].im OP t3; \
+}
+
+#define CMUL_SPLIT_SCALAR(OP) { \
+  t1 = are[i] * bre[i]; \
+  t2 = aim[i] * bim[i]; \
+  t3 = aim[i] * bre[i]; \
+  t4 = are[i] * bim[i]; \
+  t1 -= t2; \
+  t3 += t4; \
+  cre[i] OP t1; \
+  cim[i] OP t3; \
+}
+
+WDL_FFT_NOCONTRACT static void cmul2_c(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const WDL_FFT_COMPLEX *b, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SCALAR(=, b[i].re, b[i].im)
+}
+
+WDL_FFT_NOCONTRACT static void cmul3_c(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const WDL_FFT_COMPLEX *b, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SCALAR(+=, b[i].re, b[i].im)
+}
+
+WDL_FFT_NOCONTRACT static void cmul2f_c(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const float *b, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SCALAR(=, b[i*2], b[i*2+1])
+}
+
+WDL_FFT_NOCONTRACT static void cmul3f_c(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const float *b, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SCALAR(+=, b[i*2], b[i*2+1])
+}
+
+WDL_FFT_NOCONTRACT static void cmul2s_c(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SPLIT_SCALAR(=)
+}
+
+WDL_FFT_NOCONTRACT static void cmul3s_c(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n)
+{
+  WDL_FFT_REAL t1, t2, t3, t4;
+  int i;
+  for (i = 0; i < n; i ++) CMUL_SPLIT_SCALAR(+=)
+}
+
+
+/*
+  each SIMD section below defines, for its instruction set:
+    CMUL_LOAD_B(p) / CMUL_LOAD_BF(p): load CMUL_W complex values of b (WDL_FFT_REAL or float)
+    CMUL_CORE(r,va,vb): r = va*vb, for interleaved complex values
+  and then instantiates the kernels with CMUL_DEFINE_KERNELS(suffix, target)
+*/
+
+#define CMUL_DEFINE_KERNELS(SFX, TGT) \
+WDL_FFT_TARGET(TGT) static void cmul2_##SFX(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const WDL_FFT_COMPLEX *b, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) { CMUL_VEC va=CMUL_LOAD(&a[i].re), vb=CMUL_LOAD_B(&b[i].re), r; CMUL_CORE(r,va,vb); CMUL_STORE(&c[i].re,r); } \
+  for (; i < n; i ++) CMUL_SCALAR(=, b[i].re, b[i].im) \
+} \
+WDL_FFT_TARGET(TGT) static void cmul3_##SFX(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const WDL_FFT_COMPLEX *b, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) { CMUL_VEC va=CMUL_LOAD(&a[i].re), vb=CMUL_LOAD_B(&b[i].re), r; CMUL_CORE(r,va,vb); CMUL_STORE(&c[i].re,CMUL_ADD(CMUL_LOAD(&c[i].re),r)); } \
+  for (; i < n; i ++) CMUL_SCALAR(+=, b[i].re, b[i].im) \
+} \
+WDL_FFT_TARGET(TGT) static void cmul2f_##SFX(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const float *b, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) { CMUL_VEC va=CMUL_LOAD(&a[i].re), vb=CMUL_LOAD_BF(b+i*2), r; CMUL_CORE(r,va,vb); CMUL_STORE(&c[i].re,r); } \
+  for (; i < n; i ++) CMUL_SCALAR(=, b[i*2], b[i*2+1]) \
+} \
+WDL_FFT_TARGET(TGT) static void cmul3f_##SFX(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const float *b, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) { CMUL_VEC va=CMUL_LOAD(&a[i].re), vb=CMUL_LOAD_BF(b+i*2), r; CMUL_CORE(r,va,vb); CMUL_STORE(&c[i].re,CMUL_ADD(CMUL_LOAD(&c[i].re),r)); } \
+  for (; i < n; i ++) CMUL_SCALAR(+=, b[i*2], b[i*2+1]) \
+} \
+WDL_FFT_TARGET(TGT) static void cmul2s_##SFX(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W*2 <= n; i += CMUL_W*2) \
+  { \
+    CMUL_VEC ar=CMUL_LOAD(are+i), ai=CMUL_LOAD(aim+i), br=CMUL_LOAD(bre+i), bi=CMUL_LOAD(bim+i); \
+    CMUL_STORE(cre+i,CMUL_SUB(CMUL_MUL(ar,br),CMUL_MUL(ai,bi))); \
+    CMUL_STORE(cim+i,CMUL_ADD(CMUL_MUL(ai,br),CMUL_MUL(ar,bi))); \
+  } \
+  for (; i < n; i ++) CMUL_SPLIT_SCALAR(=) \
+} \
+WDL_FFT_TARGET(TGT) static void cmul3s_##SFX(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W*2 <= n; i += CMUL_W*2) \
+  { \
+    CMUL_VEC ar=CMUL_LOAD(are+i), ai=CMUL_LOAD(aim+i), br=CMUL_LOAD(bre+i), bi=CMUL_LOAD(bim+i); \
+    CMUL_STORE(cre+i,CMUL_ADD(CMUL_LOAD(cre+i),CMUL_SUB(CMUL_MUL(ar,br),CMUL_MUL(ai,bi)))); \
+    CMUL_STORE(cim+i,CMUL_ADD(CMUL_LOAD(cim+i),CMUL_ADD(CMUL_MUL(ai,br),CMUL_MUL(ar,bi)))); \
+  } \
+  for (; i < n; i ++) CMUL_SPLIT_SCALAR(+=) \
+}
+
+
+#ifdef WDL_FFT_SIMD_X86
+
+/* SSE2: one (double) or two (float) complex values per vector */
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 2
+  #define CMUL_VEC __m128
+  #define CMUL_LOAD(p) _mm_loadu_ps(p)
+  #define CMUL_LOAD_B(p) _mm_loadu_ps(p)
+  #define CMUL_LOAD_BF(p) _mm_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm_mul_ps(x,y)
+  #define CMUL_SIGNMASK _mm_castsi128_ps(_mm_set_epi32(0,(int)0x80000000,0,(int)0x80000000)) // negate real lanes
+  #define CMUL_CORE(r,va,vb) { \
+    const __m128 br=_mm_shuffle_ps(vb,vb,_MM_SHUFFLE(2,2,0,0)), bi=_mm_shuffle_ps(vb,vb,_MM_SHUFFLE(3,3,1,1)); \
+    const __m128 sw=_mm_shuffle_ps(va,va,_MM_SHUFFLE(2,3,0,1)); \
+    r=_mm_add_ps(_mm_mul_ps(va,br),_mm_xor_ps(_mm_mul_ps(sw,bi),CMUL_SIGNMASK)); \
+  }
+#else
+  #define CMUL_W 1
+  #define CMUL_VEC __m128d
+  #define CMUL_LOAD(p) _mm_loadu_pd(p)
+  #define CMUL_LOAD_B(p) _mm_loadu_pd(p)
+  #define CMUL_LOAD_BF(p) _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)(p))))
+  #define CMUL_STORE(p,v) _mm_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm_mul_pd(x,y)
+  #define CMUL_CORE(r,va,vb) { \
+    const __m128d br=_mm_unpacklo_pd(vb,vb), bi=_mm_unpackhi_pd(vb,vb); \
+    const __m128d sw=_mm_shuffle_pd(va,va,1); \
+    r=_mm_add_pd(_mm_mul_pd(va,br),_mm_xor_pd(_mm_mul_pd(sw,bi),_mm_set_pd(0.0,-0.0))); \
+  }
+#endif
+
+CMUL_DEFINE_KERNELS(sse2,"sse2")
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_LOAD_B
+#undef CMUL_LOAD_BF
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef CMUL_CORE
+#undef CMUL_SIGNMASK
+
+
+/* AVX: addsub does the re/im sign handling */
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 4
+  #define CMUL_VEC __m256
+  #define CMUL_LOAD(p) _mm256_loadu_ps(p)
+  #define CMUL_LOAD_B(p) _mm256_loadu_ps(p)
+  #define CMUL_LOAD_BF(p) _mm256_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm256_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm256_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm256_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm256_mul_ps(x,y)
+  #define CMUL_CORE(r,va,vb) { \
+    const __m256 sw=_mm256_permute_ps(va,0xB1); \
+    r=_mm256_addsub_ps(_mm256_mul_ps(va,_mm256_moveldup_ps(vb)),_mm256_mul_ps(sw,_mm256_movehdup_ps(vb))); \
+  }
+#else
+  #define CMUL_W 2
+  #define CMUL_VEC __m256d
+  #define CMUL_LOAD(p) _mm256_loadu_pd(p)
+  #define CMUL_LOAD_B(p) _mm256_loadu_pd(p)
+  #define CMUL_LOAD_BF(p) _mm256_cvtps_pd(_mm_loadu_ps(p))
+  #define CMUL_STORE(p,v) _mm256_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm256_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm256_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm256_mul_pd(x,y)
+  #define CMUL_CORE(r,va,vb) { \
+    const __m256d sw=_mm256_permute_pd(va,0x5); \
+    r=_mm256_addsub_pd(_mm256_mul_pd(va,_mm256_movedup_pd(vb)),_mm256_mul_pd(sw,_mm256_permute_pd(vb,0xF))); \
+  }
+#endif
+
+CMUL_DEFINE_KERNELS(avx,"avx")
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_LOAD_B
+#undef CMUL_LOAD_BF
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef CMUL_CORE
+
+
+#ifdef WDL_FFT_SIMD_AVX512
+/* AVX-512F has no addsub: add, then subtract into the real lanes with a mask */
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 8
+  #define CMUL_VEC __m512
+  #define CMUL_LOAD(p) _mm512_loadu_ps(p)
+  #define CMUL_LOAD_B(p) _mm512_loadu_ps(p)
+  #define CMUL_LOAD_BF(p) _mm512_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm512_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm512_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm512_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm512_mul_ps(x,y)
+  #define CMUL_CORE(r,va,vb) { \
+    const __m512 t=_mm512_mul_ps(va,_mm512_moveldup_ps(vb)); \
+    const __m512 u=_mm512_mul_ps(_mm512_permute_ps(va,0xB1),_mm512_movehdup_ps(vb)); \
+    r=_mm512_mask_sub_ps(_mm512_add_ps(t,u),0x5555,t,u); \
+  }
+#else
+  #define CMUL_W 4
+  #define CMUL_VEC __m512d
+  #define CMUL_LOAD(p) _mm512_loadu_pd(p)
+  #define CMUL_LOAD_B(p) _mm512_loadu_pd(p)
+  #define CMUL_LOAD_BF(p) _mm512_cvtps_pd(_mm256_loadu_ps(p))
+  #define CMUL_STORE(p,v) _mm512_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm512_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm512_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm512_mul_pd(x,y)
+  #define CMUL_CORE(r,va,vb) { \
+    const __m512d t=_mm512_mul_pd(va,_mm512_movedup_pd(vb)); \
+    const __m512d u=_mm512_mul_pd(_mm512_permute_pd(va,0x55),_mm512_permute_pd(vb,0xFF)); \
+    r=_mm512_mask_sub_pd(_mm512_add_pd(t,u),0x55,t,u); \
+  }
+#endif
+
+CMUL_DEFINE_KERNELS(avx512,"avx512f")
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_LOAD_B
+#undef CMUL_LOAD_BF
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef CMUL_CORE
+#endif // WDL_FFT_SIMD_AVX512
+
+static int WDL_fft_cpu_simd_level()
+{
+  unsigned int a=0,b=0,c=0,d=0;
+  unsigned long long xcr0=0;
+  int level=0;
+#ifdef _MSC_VER
+  int r[4];
+  __cpuid(r,1);
+  c=r[2]; d=r[3];
+#else
+  if (!__get_cpuid(1,&a,&b,&c,&d)) return 0;
+#endif
+  if (d & (1<<26)) level=1; // SSE2
+  else return 0;
+
+  if (!(c & (1<<27)) || !(c & (1<<28))) return level; // OSXSAVE, AVX
+#ifdef _MSC_VER
+  xcr0=(unsigned long long)_xgetbv(0);
+#else
+  {
+    unsigned int lo,hi;
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0)); // xgetbv
+    xcr0=((unsigned long long)hi<<32) | lo;
+  }
+#endif
+  if ((xcr0 & 6) != 6) return level; // OS saves SSE/AVX state
+  level=2;
+
+#ifdef WDL_FFT_SIMD_AVX512
+#ifdef _MSC_VER
+  __cpuidex(r,7,0);
+  b=r[1];
+#else
+  b=0;
+  __cpuid_count(7,0,a,b,c,d);
+#endif
+  if ((b & (1<<16)) && (xcr0 & 0xE6) == 0xE6) level=3; // AVX-512F, OS saves opmask/ZMM state
+#endif
+
+  return level;
+}
+
+#elif defined(WDL_FFT_SIMD_NEON)
+
+/* NEON: deinterleaving loads give full-width re/im vectors */
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 4
+  #define CMUL_VEC float32x4_t
+  #define CMUL_VEC2 float32x4x2_t
+  #define CMUL_LOAD(p) vld1q_f32(p)
+  #define CMUL_LOAD2(p) vld2q_f32(p)
+  #define CMUL_LOAD2_F(p) vld2q_f32(p)
+  #define CMUL_STORE(p,v) vst1q_f32(p,v)
+  #define CMUL_STORE2(p,v) vst2q_f32(p,v)
+  #define CMUL_ADD(x,y) vaddq_f32(x,y)
+  #define CMUL_SUB(x,y) vsubq_f32(x,y)
+  #define CMUL_MUL(x,y) vmulq_f32(x,y)
+#else
+  #define CMUL_W 2
+  #define CMUL_VEC float64x2_t
+  #define CMUL_VEC2 float64x2x2_t
+  #define CMUL_LOAD(p) vld1q_f64(p)
+  #define CMUL_LOAD2(p) vld2q_f64(p)
+  #define CMUL_STORE(p,v) vst1q_f64(p,v)
+  #define CMUL_STORE2(p,v) vst2q_f64(p,v)
+  #define CMUL_ADD(x,y) vaddq_f64(x,y)
+  #define CMUL_SUB(x,y) vsubq_f64(x,y)
+  #define CMUL_MUL(x,y) vmulq_f64(x,y)
+  static inline float64x2x2_t CMUL_LOAD2_F(const float *p) 
+  { 
+    const float32x2x2_t f=vld2_f32(p); 
+    float64x2x2_t r;
+    r.val[0]=vcvt_f64_f32(f.val[0]);
+    r.val[1]=vcvt_f64_f32(f.val[1]);
+    return r;
+  }
+#endif
+
+#define CMUL_NEON_CORE(r,va,vb) { \
+  r.val[0]=CMUL_SUB(CMUL_MUL(va.val[0],vb.val[0]),CMUL_MUL(va.val[1],vb.val[1])); \
+  r.val[1]=CMUL_ADD(CMUL_MUL(va.val[1],vb.val[0]),CMUL_MUL(va.val[0],vb.val[1])); \
+}
+
+#define CMUL_NEON_KERNEL(NAME, BTYPE, LOADB, BRE, BIM, ACCUM, OP) \
+WDL_FFT_NOCONTRACT static void NAME(WDL_FFT_COMPLEX *c, const WDL_FFT_COMPLEX *a, const BTYPE *b, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) \
+  { \
+    const CMUL_VEC2 va=CMUL_LOAD2(&a[i].re), vb=LOADB; \
+    CMUL_VEC2 r; \
+    CMUL_NEON_CORE(r,va,vb); \
+    if (ACCUM) \
+    { \
+      const CMUL_VEC2 vc=CMUL_LOAD2(&c[i].re); \
+      r.val[0]=CMUL_ADD(vc.val[0],r.val[0]); \
+      r.val[1]=CMUL_ADD(vc.val[1],r.val[1]); \
+    } \
+    CMUL_STORE2(&c[i].re,r); \
+  } \
+  for (; i < n; i ++) CMUL_SCALAR(OP, BRE, BIM) \
+}
+
+CMUL_NEON_KERNEL(cmul2_neon, WDL_FFT_COMPLEX, CMUL_LOAD2(&b[i].re), b[i].re, b[i].im, 0, =)
+CMUL_NEON_KERNEL(cmul3_neon, WDL_FFT_COMPLEX, CMUL_LOAD2(&b[i].re), b[i].re, b[i].im, 1, +=)
+CMUL_NEON_KERNEL(cmul2f_neon, float, CMUL_LOAD2_F(b+i*2), b[i*2], b[i*2+1], 0, =)
+CMUL_NEON_KERNEL(cmul3f_neon, float, CMUL_LOAD2_F(b+i*2), b[i*2], b[i*2+1], 1, +=)
+
+#define CMUL_NEON_SPLIT_KERNEL(NAME, ACCUM, OP) \
+WDL_FFT_NOCONTRACT static void NAME(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4; \
+  int i; \
+  for (i = 0; i + CMUL_W <= n; i += CMUL_W) \
+  { \
+    const CMUL_VEC ar=CMUL_LOAD(are+i), ai=CMUL_LOAD(aim+i), br=CMUL_LOAD(bre+i), bi=CMUL_LOAD(bim+i); \
+    CMUL_VEC r=CMUL_SUB(CMUL_MUL(ar,br),CMUL_MUL(ai,bi)); \
+    CMUL_VEC im=CMUL_ADD(CMUL_MUL(ai,br),CMUL_MUL(ar,bi)); \
+    if (ACCUM) { r=CMUL_ADD(CMUL_LOAD(cre+i),r); im=CMUL_ADD(CMUL_LOAD(cim+i),im); } \
+    CMUL_STORE(cre+i,r); \
+    CMUL_STORE(cim+i,im); \
+  } \
+  for (; i < n; i ++) CMUL_SPLIT_SCALAR(OP) \
+}
+
+CMUL_NEON_SPLIT_KERNEL(cmul2s_neon, 0, =)
+CMUL_NEON_SPLIT_KERNEL(cmul3s_neon, 1, +=)
+
+#endif // WDL_FFT_SIMD_NEON
+
+
+/*
+  vectorized FFT passes: the twiddled radix-4 butterflies of cpass/cpassbig/upass/upassbig,
+  done CMUL_W bins at a time with per-size twiddle tables (see s_fft_tw), for one or more
+  buffers (bufs[i]+offs) at once. as with complexmul, the operations match
+  TRANSFORM/UNTRANSFORM exactly.
+
+  each section below defines, for interleaved complex vectors:
+    FP_SWAP(v): exchange re/im, FP_DUPRE(v)/FP_DUPIM(v): broadcast re/im within each complex,
+    FP_NEGRE(v)/FP_NEGIM(v): flip the sign of re/im
+  and then instantiates the passes with FFT_DEFINE_PASSES(suffix, attributes)
+*/
+
+// v*w and v*conj(w)
+#define FP_CMUL(v,w) FP_ADD(FP_MUL(v,FP_DUPRE(w)),FP_NEGRE(FP_MUL(FP_SWAP(v),FP_DUPIM(w))))
+#define FP_CMULCONJ(v,w) FP_ADD(FP_MUL(v,FP_DUPRE(w)),FP_NEGIM(FP_MUL(FP_SWAP(v),FP_DUPIM(w))))
+
+#define FFT_DEFINE_PASSES(SFX, ATTR) \
+ATTR static void fpass_##SFX(WDL_FFT_COMPLEX **bufs, int nbufs, unsigned int offs, const WDL_FFT_COMPLEX *tw, unsigned int k, unsigned int kend, unsigned int q) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8; \
+  int i; \
+  for (; k + CMUL_W <= kend; k += CMUL_W) \
+  { \
+    const CMUL_VEC w=CMUL_LOAD(&tw[k].re); \
+    for (i = 0; i < nbufs; i ++) \
+    { \
+      WDL_FFT_COMPLEX *a = bufs[i] + offs + k; \
+      const CMUL_VEC x0=CMUL_LOAD(&a[0].re), x1=CMUL_LOAD(&a[q].re), x2=CMUL_LOAD(&a[2*q].re), x3=CMUL_LOAD(&a[3*q].re); \
+      const CMUL_VEC d02=FP_SUB(x0,x2), d13=FP_SWAP(FP_SUB(x1,x3)); \
+      CMUL_STORE(&a[0].re,FP_ADD(x2,x0)); \
+      CMUL_STORE(&a[q].re,FP_ADD(x3,x1)); \
+      CMUL_STORE(&a[2*q].re,FP_CMUL(FP_ADD(d02,FP_NEGRE(d13)),w)); \
+      CMUL_STORE(&a[3*q].re,FP_CMULCONJ(FP_ADD(d02,FP_NEGIM(d13)),w)); \
+    } \
+  } \
+  for (i = 0; i < nbufs && k < kend; i ++) \
+  { \
+    WDL_FFT_COMPLEX *a = bufs[i] + offs; \
+    unsigned int j; \
+    for (j = k; j < kend; j ++) TRANSFORM(a[j],a[q+j],a[2*q+j],a[3*q+j],tw[j].re,tw[j].im); \
+  } \
+} \
+ATTR static void upass_##SFX(WDL_FFT_COMPLEX **bufs, int nbufs, unsigned int offs, const WDL_FFT_COMPLEX *tw, unsigned int k, unsigned int kend, unsigned int q) \
+{ \
+  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8; \
+  int i; \
+  for (; k + CMUL_W <= kend; k += CMUL_W) \
+  { \
+    const CMUL_VEC w=CMUL_LOAD(&tw[k].re); \
+    for (i = 0; i < nbufs; i ++) \
+    { \
+      WDL_FFT_COMPLEX *a = bufs[i] + offs + k; \
+      const CMUL_VEC x0=CMUL_LOAD(&a[0].re), x1=CMUL_LOAD(&a[q].re); \
+      const CMUL_VEC y2=FP_CMULCONJ(CMUL_LOAD(&a[2*q].re),w), y3=FP_CMUL(CMUL_LOAD(&a[3*q].re),w); \
+      const CMUL_VEC s=FP_ADD(y3,y2), d=FP_SWAP(FP_ADD(FP_NEGRE(y2),FP_NEGIM(y3))); \
+      CMUL_STORE(&a[0].re,FP_ADD(s,x0)); \
+      CMUL_STORE(&a[2*q].re,FP_SUB(x0,s)); \
+      CMUL_STORE(&a[q].re,FP_ADD(d,x1)); \
+      CMUL_STORE(&a[3*q].re,FP_SUB(x1,d)); \
+    } \
+  } \
+  for (i = 0; i < nbufs && k < kend; i ++) \
+  { \
+    WDL_FFT_COMPLEX *a = bufs[i] + offs; \
+    unsigned int j; \
+    for (j = k; j < kend; j ++) UNTRANSFORM(a[j],a[q+j],a[2*q+j],a[3*q+j],tw[j].re,tw[j].im); \
+  } \
+}
+
+#define FP_ADD(x,y) CMUL_ADD(x,y)
+#define FP_SUB(x,y) CMUL_SUB(x,y)
+#define FP_MUL(x,y) CMUL_MUL(x,y)
+
+#ifdef WDL_FFT_SIMD_X86
+
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 2
+  #define CMUL_VEC __m128
+  #define CMUL_LOAD(p) _mm_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm_mul_ps(x,y)
+  #define FP_SWAP(v) _mm_shuffle_ps(v,v,_MM_SHUFFLE(2,3,0,1))
+  #define FP_DUPRE(v) _mm_shuffle_ps(v,v,_MM_SHUFFLE(2,2,0,0))
+  #define FP_DUPIM(v) _mm_shuffle_ps(v,v,_MM_SHUFFLE(3,3,1,1))
+  #define FP_NEGRE(v) _mm_xor_ps(v,_mm_set_ps(0.0f,-0.0f,0.0f,-0.0f))
+  #define FP_NEGIM(v) _mm_xor_ps(v,_mm_set_ps(-0.0f,0.0f,-0.0f,0.0f))
+#else
+  #define CMUL_W 1
+  #define CMUL_VEC __m128d
+  #define CMUL_LOAD(p) _mm_loadu_pd(p)
+  #define CMUL_STORE(p,v) _mm_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm_mul_pd(x,y)
+  #define FP_SWAP(v) _mm_shuffle_pd(v,v,1)
+  #define FP_DUPRE(v) _mm_unpacklo_pd(v,v)
+  #define FP_DUPIM(v) _mm_unpackhi_pd(v,v)
+  #define FP_NEGRE(v) _mm_xor_pd(v,_mm_set_pd(0.0,-0.0))
+  #define FP_NEGIM(v) _mm_xor_pd(v,_mm_set_pd(-0.0,0.0))
+#endif
+
+FFT_DEFINE_PASSES(sse2,WDL_FFT_TARGET("sse2"))
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef FP_SWAP
+#undef FP_DUPRE
+#undef FP_DUPIM
+#undef FP_NEGRE
+#undef FP_NEGIM
+
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 4
+  #define CMUL_VEC __m256
+  #define CMUL_LOAD(p) _mm256_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm256_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm256_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm256_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm256_mul_ps(x,y)
+  #define FP_SWAP(v) _mm256_permute_ps(v,0xB1)
+  #define FP_DUPRE(v) _mm256_moveldup_ps(v)
+  #define FP_DUPIM(v) _mm256_movehdup_ps(v)
+  #define FP_NEGRE(v) _mm256_xor_ps(v,_mm256_castsi256_ps(_mm256_set1_epi64x(0x80000000LL)))
+  #define FP_NEGIM(v) _mm256_xor_ps(v,_mm256_castsi256_ps(_mm256_set1_epi64x((long long)0x8000000000000000ULL)))
+#else
+  #define CMUL_W 2
+  #define CMUL_VEC __m256d
+  #define CMUL_LOAD(p) _mm256_loadu_pd(p)
+  #define CMUL_STORE(p,v) _mm256_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm256_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm256_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm256_mul_pd(x,y)
+  #define FP_SWAP(v) _mm256_permute_pd(v,0x5)
+  #define FP_DUPRE(v) _mm256_movedup_pd(v)
+  #define FP_DUPIM(v) _mm256_permute_pd(v,0xF)
+  #define FP_NEGRE(v) _mm256_xor_pd(v,_mm256_set_pd(0.0,-0.0,0.0,-0.0))
+  #define FP_NEGIM(v) _mm256_xor_pd(v,_mm256_set_pd(-0.0,0.0,-0.0,0.0))
+#endif
+
+FFT_DEFINE_PASSES(avx,WDL_FFT_TARGET("avx"))
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef FP_SWAP
+#undef FP_DUPRE
+#undef FP_DUPIM
+#undef FP_NEGRE
+#undef FP_NEGIM
+
+#ifdef WDL_FFT_SIMD_AVX512
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 8
+  #define CMUL_VEC __m512
+  #define CMUL_LOAD(p) _mm512_loadu_ps(p)
+  #define CMUL_STORE(p,v) _mm512_storeu_ps(p,v)
+  #define CMUL_ADD(x,y) _mm512_add_ps(x,y)
+  #define CMUL_SUB(x,y) _mm512_sub_ps(x,y)
+  #define CMUL_MUL(x,y) _mm512_mul_ps(x,y)
+  #define FP_SWAP(v) _mm512_permute_ps(v,0xB1)
+  #define FP_DUPRE(v) _mm512_moveldup_ps(v)
+  #define FP_DUPIM(v) _mm512_movehdup_ps(v)
+  #define FP_NEGRE(v) _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v),_mm512_set1_epi64(0x80000000LL)))
+  #define FP_NEGIM(v) _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v),_mm512_set1_epi64((long long)0x8000000000000000ULL)))
+#else
+  #define CMUL_W 4
+  #define CMUL_VEC __m512d
+  #define CMUL_LOAD(p) _mm512_loadu_pd(p)
+  #define CMUL_STORE(p,v) _mm512_storeu_pd(p,v)
+  #define CMUL_ADD(x,y) _mm512_add_pd(x,y)
+  #define CMUL_SUB(x,y) _mm512_sub_pd(x,y)
+  #define CMUL_MUL(x,y) _mm512_mul_pd(x,y)
+  #define FP_SWAP(v) _mm512_permute_pd(v,0x55)
+  #define FP_DUPRE(v) _mm512_movedup_pd(v)
+  #define FP_DUPIM(v) _mm512_permute_pd(v,0xFF)
+  #define FP_NEGRE(v) _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(v),_mm512_set_epi64(0,(long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL)))
+  #define FP_NEGIM(v) _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(v),_mm512_set_epi64((long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL,0,(long long)0x8000000000000000ULL,0)))
+#endif
+
+FFT_DEFINE_PASSES(avx512,WDL_FFT_TARGET("avx512f"))
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef FP_SWAP
+#undef FP_DUPRE
+#undef FP_DUPIM
+#undef FP_NEGRE
+#undef FP_NEGIM
+#endif // WDL_FFT_SIMD_AVX512
+
+#elif defined(WDL_FFT_SIMD_NEON)
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+
+#if WDL_FFT_REALSIZE == 4
+  #define CMUL_W 2
+  #define CMUL_VEC float32x4_t
+  #define CMUL_LOAD(p) vld1q_f32(p)
+  #define CMUL_STORE(p,v) vst1q_f32(p,v)
+  #define CMUL_ADD(x,y) vaddq_f32(x,y)
+  #define CMUL_SUB(x,y) vsubq_f32(x,y)
+  #define CMUL_MUL(x,y) vmulq_f32(x,y)
+  #define FP_SWAP(v) vrev64q_f32(v)
+  #define FP_DUPRE(v) vtrnq_f32(v,v).val[0]
+  #define FP_DUPIM(v) vtrnq_f32(v,v).val[1]
+  #define FP_NEGRE(v) vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(v),vreinterpretq_u32_u64(vdupq_n_u64(0x80000000ULL))))
+  #define FP_NEGIM(v) vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(v),vreinterpretq_u32_u64(vdupq_n_u64(0x8000000000000000ULL))))
+#else
+  #define CMUL_W 1
+  #define CMUL_VEC float64x2_t
+  #define CMUL_LOAD(p) vld1q_f64(p)
+  #define CMUL_STORE(p,v) vst1q_f64(p,v)
+  #define CMUL_ADD(x,y) vaddq_f64(x,y)
+  #define CMUL_SUB(x,y) vsubq_f64(x,y)
+  #define CMUL_MUL(x,y) vmulq_f64(x,y)
+  #define FP_SWAP(v) vextq_f64(v,v,1)
+  #define FP_DUPRE(v) vdupq_laneq_f64(v,0)
+  #define FP_DUPIM(v) vdupq_laneq_f64(v,1)
+  #define FP_NEGRE(v) vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(v),vcombine_u64(vcreate_u64(0x8000000000000000ULL),vcreate_u64(0))))
+  #define FP_NEGIM(v) vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(v),vcombine_u64(vcreate_u64(0),vcreate_u64(0x8000000000000000ULL))))
+#endif
+
+FFT_DEFINE_PASSES(neon,WDL_FFT_NOCONTRACT)
+
+#undef CMUL_W
+#undef CMUL_VEC
+#undef CMUL_LOAD
+#undef CMUL_STORE
+#undef CMUL_ADD
+#undef CMUL_SUB
+#undef CMUL_MUL
+#undef FP_SWAP
+#undef FP_DUPRE
+#undef FP_DUPIM
+#undef FP_NEGRE
+#undef FP_NEGIM
+
+#endif // WDL_FFT_SIMD_NEON
+
+
+static WDL_FFT_CMULFUNC s_cmul2 = cmul2_c, s_cmul3 = cmul3_c;
+static WDL_FFT_CMULFUNC_F s_cmul2f = cmul2f_c, s_cmul3f = cmul3f_c;
+static WDL_FFT_CMULFUNC_SPLIT s_cmul2s = cmul2s_c, s_cmul3s = cmul3s_c;
+static int s_simd_level = -1; // detected level, -1 if not yet detected
+
+int WDL_fft_set_simd(int maxlevel)
+{
+  int level;
+  if (s_simd_level < 0)
+  {
+#ifdef WDL_FFT_SIMD_X86
+    s_simd_level = WDL_fft_cpu_simd_level();
+#elif defined(WDL_FFT_SIMD_NEON)
+    s_simd_level = 1;
+#else
+    s_simd_level = 0;
+#endif
+  }
+
+  level = maxlevel < s_simd_level ? maxlevel : s_simd_level;
+  if (level < 0) level = 0;
+
+#define SETCMUL(SFX) { s_cmul2=cmul2_##SFX; s_cmul3=cmul3_##SFX; s_cmul2f=cmul2f_##SFX; s_cmul3f=cmul3f_##SFX; s_cmul2s=cmul2s_##SFX; s_cmul3s=cmul3s_##SFX; }
+#define SETFUNCS(SFX) { SETCMUL(SFX) s_fft_cpass=fpass_##SFX; s_fft_upass=upass_##SFX; }
+  switch (level)
+  {
+#ifdef WDL_FFT_SIMD_X86
+#ifdef WDL_FFT_SIMD_AVX512
+    case 3: SETFUNCS(avx512) break;
+#endif
+    case 2: SETFUNCS(avx) break;
+    case 1: SETFUNCS(sse2) break;
+#elif defined(WDL_FFT_SIMD_NEON)
+    case 1: SETFUNCS(neon) break;
+#endif
+    default: SETCMUL(c) s_fft_cpass=s_fft_upass=0; level=0; break;
+  }
+#undef SETFUNCS
+#undef SETCMUL
+  return level;
+}
+
+
 /* n even, n > 0 */
 void WDL_fft_complexmul(WDL_FFT_COMPLEX *a,WDL_FFT_COMPLEX *b,int n)
 {
-  register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    a[0].re = t1;
-    a[1].re = t5;
-    a[0].im = t3;
-    a[1].im = t7;
-    a += 2;
-    b += 2;
-  } while (n -= 2);
+  s_cmul2(a,a,b,n);
 }
 
 void WDL_fft_complexmul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX *b, int n)
 {
-  register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
-
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re = t1;
-    c[1].re = t5;
-    c[0].im = t3;
-    c[1].im = t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
+  s_cmul2(c,a,b,n);
 }
+
 void WDL_fft_complexmul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX *b, int n)
 {
-  register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
+  s_cmul3(c,a,b,n);
+}
 
-  do {
-    t1 = a[0].re * b[0].re;
-    t2 = a[0].im * b[0].im;
-    t3 = a[0].im * b[0].re;
-    t4 = a[0].re * b[0].im;
-    t5 = a[1].re * b[1].re;
-    t6 = a[1].im * b[1].im;
-    t7 = a[1].im * b[1].re;
-    t8 = a[1].re * b[1].im;
-    t1 -= t2;
-    t3 += t4;
-    t5 -= t6;
-    t7 += t8;
-    c[0].re += t1;
-    c[1].re += t5;
-    c[0].im += t3;
-    c[1].im += t7;
-    a += 2;
-    b += 2;
-    c += 2;
-  } while (n -= 2);
+void WDL_fft_complexmul2_f(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, const float *b, int n)
+{
+  s_cmul2f(c,a,b,n);
+}
+
+void WDL_fft_complexmul3_f(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, const float *b, int n)
+{
+  s_cmul3f(c,a,b,n);
+}
+
+void WDL_fft_complexmul2_split(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n)
+{
+  s_cmul2s(cre,cim,are,aim,bre,bim,n);
+}
+
+void WDL_fft_complexmul3_split(WDL_FFT_REAL *cre, WDL_FFT_REAL *cim, const WDL_FFT_REAL *are, const WDL_FFT_REAL *aim, const WDL_FFT_REAL *bre, const WDL_FFT_REAL *bim, int n)
+{
+  s_cmul3s(cre,cim,are,aim,bre,bim,n);
+}
+
+void WDL_fft_split(WDL_FFT_REAL *re, WDL_FFT_REAL *im, const WDL_FFT_COMPLEX *src, int n)
+{
+  int i;
+  for (i = 0; i < n; i ++)
+  {
+    re[i]=src[i].re;
+    im[i]=src[i].im;
+  }
+}
+
+void WDL_fft_unsplit(WDL_FFT_COMPLEX *dest, const WDL_FFT_REAL *re, const WDL_FFT_REAL *im, int n)
+{
+  int i;
+  for (i = 0; i < n; i ++)
+  {
+    dest[i].re=re[i];
+    dest[i].im=im[i];
+  }
 }
 
 
@@ -803,6 +1560,14 @@ static void upass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   a2 = a + 4 * n;
   a1 = a + 2 * n;
   a3 = a2 + 2 * n;
+
+  if (s_fft_upass)
+  {
+    WDL_FFT_COMPLEX *buf = a;
+    UNTRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
+    s_fft_upass(&buf,1,0,FFT_TW(2*n),1,2*n,2*n);
+    return;
+  }
   n -= 1;
 
   UNTRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
@@ -875,6 +1640,16 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 = a2 + 2 * n;
   k = n - 2;
 
+  if (s_fft_upass)
+  {
+    WDL_FFT_COMPLEX *buf = a;
+    UNTRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
+    s_fft_upass(&buf,1,0,FFT_TW(2*n),1,n,2*n);
+    UNTRANSFORMHALF(a[n],a1[n],a2[n],a3[n]);
+    s_fft_upass(&buf,1,0,FFT_TW(2*n),n+1,2*n,2*n);
+    return;
+  }
+
   UNTRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
   UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
   a += 2;
@@ -985,6 +1760,26 @@ static void __fft_gen(WDL_FFT_COMPLEX *buf, const WDL_FFT_COMPLEX *buf2, int sz,
   }
 }
 
+/* n as passed to cpass/cpassbig */
+static void __fft_tw_gen(const WDL_FFT_COMPLEX *w, unsigned int n, int isbig)
+{
+  WDL_FFT_COMPLEX *tw = FFT_TW(2*n);
+  unsigned int k;
+
+  tw[0].re = 1.0;
+  tw[0].im = 0.0;
+  for (k = 1; k < 2*n; k ++)
+  {
+    if (!isbig || k < n) tw[k] = w[k-1];
+    else if (k == n) tw[k].re = tw[k].im = sqrthalf;
+    else
+    {
+      tw[k].re = w[2*n-k-1].im;
+      tw[k].im = w[2*n-k-1].re;
+    }
+  }
+}
+
 #ifndef WDL_FFT_NO_PERMUTE
 
 static unsigned int fftfreq_c(unsigned int i,unsigned int n)
@@ -1035,6 +1830,8 @@ void WDL_fft_init()
     int i, offs;
   	ffttabinit=1;
 
+    WDL_fft_set_simd(3); // best complexmul kernels this CPU supports
+
 #define fft_gen(x,y,z) __fft_gen(x,y,sizeof(x)/sizeof(x[0]),z)
     fft_gen(d16,0,1);
     fft_gen(d32,d16,1);
@@ -1050,6 +1847,18 @@ void WDL_fft_init()
     fft_gen(d32768,d16384,0);
 #undef fft_gen
 
+    __fft_tw_gen(d32,4,0);
+    __fft_tw_gen(d64,8,0);
+    __fft_tw_gen(d128,16,0);
+    __fft_tw_gen(d256,32,0);
+    __fft_tw_gen(d512,64,0);
+    __fft_tw_gen(d1024,128,1);
+    __fft_tw_gen(d2048,256,1);
+    __fft_tw_gen(d4096,512,1);
+    __fft_tw_gen(d8192,1024,1);
+    __fft_tw_gen(d16384,2048,1);
+    __fft_tw_gen(d32768,4096,1);
+
 #ifndef WDL_FFT_NO_PERMUTE
 	  offs = 0;
 	  for (i = 2; i <= 32768; i *= 2) 
@@ -1086,6 +1895,111 @@ void WDL_fft(WDL_FFT_COMPLEX *buf, int len, int isInverse)
   }
 }
 
+/* batched transforms: the split-radix recursion runs once for a group of buffers, and
+   each pass is applied to every buffer in the group while its twiddles are loaded. groups
+   are split until their data fits in WDL_FFT_BATCH_CACHESIZE, so that the recursion
+   keeps the same cache locality as transforming the buffers one at a time. */
+#ifndef WDL_FFT_BATCH_CACHESIZE
+#define WDL_FFT_BATCH_CACHESIZE 32768
+#endif
+
+static void cbatch(WDL_FFT_COMPLEX **bufs, int nbufs, unsigned int offs, unsigned int len)
+{
+  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
+  const unsigned int n = len/8, q = len/4;
+  int i;
+
+  if (nbufs > 1 && nbufs * len * sizeof(WDL_FFT_COMPLEX) > WDL_FFT_BATCH_CACHESIZE)
+  {
+    cbatch(bufs,nbufs/2,offs,len);
+    cbatch(bufs+nbufs/2,nbufs-nbufs/2,offs,len);
+    return;
+  }
+  if (len <= 16)
+  {
+    for (i = 0; i < nbufs; i ++) WDL_fft(bufs[i]+offs,len,0);
+    return;
+  }
+
+  for (i = 0; i < nbufs; i ++)
+  {
+    WDL_FFT_COMPLEX *a = bufs[i]+offs;
+    TRANSFORMZERO(a[0],a[q],a[2*q],a[3*q]);
+  }
+  if (len < 1024)
+  {
+    s_fft_cpass(bufs,nbufs,offs,FFT_TW(q),1,q,q);
+  }
+  else
+  {
+    s_fft_cpass(bufs,nbufs,offs,FFT_TW(q),1,n,q);
+    for (i = 0; i < nbufs; i ++)
+    {
+      WDL_FFT_COMPLEX *a = bufs[i]+offs+n;
+      TRANSFORMHALF(a[0],a[q],a[2*q],a[3*q]);
+    }
+    s_fft_cpass(bufs,nbufs,offs,FFT_TW(q),n+1,q,q);
+  }
+
+  cbatch(bufs,nbufs,offs+len/2,len/4);
+  cbatch(bufs,nbufs,offs+len/2+len/4,len/4);
+  cbatch(bufs,nbufs,offs,len/2);
+}
+
+static void ubatch(WDL_FFT_COMPLEX **bufs, int nbufs, unsigned int offs, unsigned int len)
+{
+  WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
+  const unsigned int n = len/8, q = len/4;
+  int i;
+
+  if (nbufs > 1 && nbufs * len * sizeof(WDL_FFT_COMPLEX) > WDL_FFT_BATCH_CACHESIZE)
+  {
+    ubatch(bufs,nbufs/2,offs,len);
+    ubatch(bufs+nbufs/2,nbufs-nbufs/2,offs,len);
+    return;
+  }
+  if (len <= 16)
+  {
+    for (i = 0; i < nbufs; i ++) WDL_fft(bufs[i]+offs,len,1);
+    return;
+  }
+
+  ubatch(bufs,nbufs,offs,len/2);
+  ubatch(bufs,nbufs,offs+len/2,len/4);
+  ubatch(bufs,nbufs,offs+len/2+len/4,len/4);
+
+  for (i = 0; i < nbufs; i ++)
+  {
+    WDL_FFT_COMPLEX *a = bufs[i]+offs;
+    UNTRANSFORMZERO(a[0],a[q],a[2*q],a[3*q]);
+  }
+  if (len < 1024)
+  {
+    s_fft_upass(bufs,nbufs,offs,FFT_TW(q),1,q,q);
+  }
+  else
+  {
+    s_fft_upass(bufs,nbufs,offs,FFT_TW(q),1,n,q);
+    for (i = 0; i < nbufs; i ++)
+    {
+      WDL_FFT_COMPLEX *a = bufs[i]+offs+n;
+      UNTRANSFORMHALF(a[0],a[q],a[2*q],a[3*q]);
+    }
+    s_fft_upass(bufs,nbufs,offs,FFT_TW(q),n+1,q,q);
+  }
+}
+
+void WDL_fft_batch(WDL_FFT_COMPLEX **bufs, int nbufs, int len, int isInverse)
+{
+  if (nbufs < 2 || !s_fft_cpass || len < 32 || len > 32768 || (len & (len-1)))
+  {
+    int i;
+    for (i = 0; i < nbufs; i ++) WDL_fft(bufs[i],len,isInverse);
+  }
+  else if (!isInverse) cbatch(bufs,nbufs,0,len);
+  else ubatch(bufs,nbufs,0,len);
+}
+
 static inline void r2(register WDL_FFT_REAL *a)
 {
   register WDL_FFT_REAL t1, t2;
@@ -1106,7 +2020,8 @@ static inline void v2(register WDL_FFT_REAL *a)
   a[1] = t2;
 }
 
-static void two_for_one(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, int isInverse)
+/* the part of two_for_one() between the half-length complex transform and the input/output */
+static void two_for_one_twiddle(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, int isInverse)
 {
   const unsigned int half = (unsigned)len >> 1, quart = half >> 1, eighth = quart >> 1;
   const int *permute = WDL_fft_permute_tab(half);
@@ -1117,7 +2032,6 @@ static void two_for_one(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, in
 
   if (!isInverse)
   {
-  	WDL_fft((WDL_FFT_COMPLEX*)buf, half, isInverse);
   	r2(buf);
   }
   else
@@ -1171,8 +2085,13 @@ static void two_for_one(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, in
   p = (WDL_FFT_COMPLEX*)buf + permute[i];
   p->re *=  2;
   p->im *= -2;
+}
 
-  if (isInverse) WDL_fft((WDL_FFT_COMPLEX*)buf, half, isInverse);
+static void two_for_one(WDL_FFT_REAL* buf, const WDL_FFT_COMPLEX *d, int len, int isInverse)
+{
+  if (!isInverse) WDL_fft((WDL_FFT_COMPLEX*)buf, len/2, isInverse);
+  two_for_one_twiddle(buf, d, len, isInverse);
+  if (isInverse) WDL_fft((WDL_FFT_COMPLEX*)buf, len/2, isInverse);
 }
 
 void WDL_real_fft(WDL_FFT_REAL* buf, int len, int isInverse)
@@ -1197,3 +2116,34 @@ void WDL_real_fft(WDL_FFT_REAL* buf, int len, int isInverse)
 #undef TMP
   }
 }
+
+void WDL_real_fft_batch(WDL_FFT_REAL **bufs, int nbufs, int len, int isInverse)
+{
+  const WDL_FFT_COMPLEX *d;
+  int i;
+  switch (len)
+  {
+#define TMP(x) case x: d = d##x; break;
+    TMP(64)
+    TMP(128)
+    TMP(256)
+    TMP(512)
+    TMP(1024)
+    TMP(2048)
+    TMP(4096)
+    TMP(8192)
+    TMP(16384)
+    TMP(32768)
+#undef TMP
+    default: d = 0; break;
+  }
+  if (!d || nbufs < 2 || !s_fft_cpass)
+  {
+    for (i = 0; i < nbufs; i ++) WDL_real_fft(bufs[i],len,isInverse);
+    return;
+  }
+
+  if (!isInverse) WDL_fft_batch((WDL_FFT_COMPLEX**)bufs,nbufs,len/2,isInverse);
+  for (i = 0; i < nbufs; i ++) two_for_one_twiddle(bufs[i],d,len,isInverse);
+  if (isInverse) WDL_fft_batch((WDL_FFT_COMPLEX**)bufs,nbufs,len/2,isInverse);
+}
@@ -30,6 +30,32 @@
 #ifndef _WDL_FFT_H_
 #define _WDL_FFT_H_
 
+#ifdef WDL_FFT_NAMESUFFIX
+/* fft_f32.c/fft_f64.c build fft.c with a suffix on every symbol, so that float
+and double versions can coexist in one binary (see fft_dual.h) */
+#define WDL_FFT_RENAME2(a,b) a##b
+#define WDL_FFT_RENAME1(a,b) WDL_FFT_RENAME2(a,b)
+#define WDL_FFT_RENAME(a) WDL_FFT_RENAME1(a,WDL_FFT_NAMESUFFIX)
+#define WDL_FFT_COMPLEX WDL_FFT_RENAME(WDL_FFT_COMPLEX)
+#define WDL_fft_init WDL_FFT_RENAME(WDL_fft_init)
+#define WDL_fft_complexmul WDL_FFT_RENAME(WDL_fft_complexmul)
+#define WDL_fft_complexmul2 WDL_FFT_RENAME(WDL_fft_complexmul2)
+#define WDL_fft_complexmul3 WDL_FFT_RENAME(WDL_fft_complexmul3)
+#define WDL_fft_complexmul2_f WDL_FFT_RENAME(WDL_fft_complexmul2_f)
+#define WDL_fft_complexmul3_f WDL_FFT_RENAME(WDL_fft_complexmul3_f)
+#define WDL_fft_complexmul2_split WDL_FFT_RENAME(WDL_fft_complexmul2_split)
+#define WDL_fft_complexmul3_split WDL_FFT_RENAME(WDL_fft_complexmul3_split)
+#define WDL_fft_split WDL_FFT_RENAME(WDL_fft_split)
+#define WDL_fft_unsplit WDL_FFT_RENAME(WDL_fft_unsplit)
+#define WDL_fft_set_simd WDL_FFT_RENAME(WDL_fft_set_simd)
+#define WDL_fft WDL_FFT_RENAME(WDL_fft)
+#define WDL_real_fft WDL_FFT_RENAME(WDL_real_fft)
+#define WDL_fft_batch WDL_FFT_RENAME(WDL_fft_batch)
+#define WDL_real_fft_batch WDL_FFT_RENAME(WDL_real_fft_batch)
+#define WDL_fft_permute WDL_FFT_RENAME(WDL_fft_permute)
+#define WDL_fft_permute_tab WDL_FFT_RENAME(WDL_fft_permute_tab)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,6 +83,26 @@ extern void WDL_fft_complexmul(WDL_FFT_COMPLEX *dest, WDL_FFT_COMPLEX *src, int
 extern void WDL_fft_complexmul2(WDL_FFT_COMPLEX *dest, WDL_FFT_COMPLEX *src, WDL_FFT_COMPLEX *src2, int len);
 extern void WDL_fft_complexmul3(WDL_FFT_COMPLEX *destAdd, WDL_FFT_COMPLEX *src, WDL_FFT_COMPLEX *src2, int len);
 
+/* As complexmul2/3, but src2 is interleaved re/im float pairs (e.g. spectra
+stored at reduced precision when WDL_FFT_REALSIZE is 8). Any len >= 0. */
+extern void WDL_fft_complexmul2_f(WDL_FFT_COMPLEX *dest, WDL_FFT_COMPLEX *src, const float *src2, int len);
+extern void WDL_fft_complexmul3_f(WDL_FFT_COMPLEX *destAdd, WDL_FFT_COMPLEX *src, const float *src2, int len);
+
+/* As complexmul2/3, but with real and imaginary parts in separate arrays,
+which lets every SIMD lane hold a whole product. Any len >= 0. */
+extern void WDL_fft_complexmul2_split(WDL_FFT_REAL *destre, WDL_FFT_REAL *destim, const WDL_FFT_REAL *srcre, const WDL_FFT_REAL *srcim, const WDL_FFT_REAL *src2re, const WDL_FFT_REAL *src2im, int len);
+extern void WDL_fft_complexmul3_split(WDL_FFT_REAL *destAddre, WDL_FFT_REAL *destAddim, const WDL_FFT_REAL *srcre, const WDL_FFT_REAL *srcim, const WDL_FFT_REAL *src2re, const WDL_FFT_REAL *src2im, int len);
+extern void WDL_fft_split(WDL_FFT_REAL *destre, WDL_FFT_REAL *destim, const WDL_FFT_COMPLEX *src, int len);
+extern void WDL_fft_unsplit(WDL_FFT_COMPLEX *dest, const WDL_FFT_REAL *srcre, const WDL_FFT_REAL *srcim, int len);
+
+/* WDL_fft, WDL_real_fft and the complexmul functions use SIMD kernels chosen
+at WDL_fft_init() time: 0=scalar, 1=SSE2/NEON, 2=AVX, 3=AVX-512F.
+WDL_fft_set_simd() limits the level (e.g. for testing), and returns the level
+in effect. Results are bit-identical at every level. Define WDL_FFT_NO_SIMD to
+build scalar only. See fft_bench.c for throughput per size, fft_cmultest.c
+checks the complexmul kernels. */
+extern int WDL_fft_set_simd(int maxlevel);
+
 /* Expects WDL_FFT_COMPLEX input[0..len-1] scaled by 1.0/len, returns
 WDL_FFT_COMPLEX output[0..len-1] order by WDL_fft_permute(len). */
 extern void WDL_fft(WDL_FFT_COMPLEX *, int len, int isInverse);
@@ -67,6 +113,12 @@ WDL_fft_permute(len/2). Note that output[len/2].re is stored in
 output[0].im. */
 extern void WDL_real_fft(WDL_FFT_REAL *, int len, int isInverse);
 
+/* Transform nbufs same-sized buffers in one call, with the same results as
+calling WDL_fft/WDL_real_fft on each. Each pass is applied to all of the
+buffers in turn, sharing twiddle loads and loop overhead. */
+extern void WDL_fft_batch(WDL_FFT_COMPLEX **bufs, int nbufs, int len, int isInverse);
+extern void WDL_real_fft_batch(WDL_FFT_REAL **bufs, int nbufs, int len, int isInverse);
+
 extern int WDL_fft_permute(int fftsize, int idx);
 extern int *WDL_fft_permute_tab(int fftsize);
 
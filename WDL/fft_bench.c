@@ -0,0 +1,94 @@
+/*
+  fft_bench.c: throughput of WDL_fft()/WDL_real_fft() per size at each SIMD level
+
+  gcc -O2 fft_bench.c fft.c -lm -o fft_bench
+  gcc -O2 -DWDL_FFT_REALSIZE=8 fft_bench.c fft.c -lm -o fft_bench
+  cl /O2 fft_bench.c fft.c
+
+  prints, for sizes 16..32768, millions of points per second for a forward+inverse
+  complex transform and a forward+inverse real transform. also checks that every
+  level produces the same output as the scalar code.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fft.h"
+
+#define MAXLEN 32768
+
+static WDL_FFT_REAL src[MAXLEN*2], buf[MAXLEN*2], ref[2][MAXLEN*2];
+
+static double run(int len, int isreal, int reps)
+{
+  clock_t st;
+  int x;
+  st=clock();
+  for (x = 0; x < reps; x ++)
+  {
+    memcpy(buf,src,len*2*sizeof(WDL_FFT_REAL)); // keeps the data from growing without bound
+    if (isreal)
+    {
+      WDL_real_fft(buf,len,0);
+      WDL_real_fft(buf,len,1);
+    }
+    else
+    {
+      WDL_fft((WDL_FFT_COMPLEX*)buf,len,0);
+      WDL_fft((WDL_FFT_COMPLEX*)buf,len,1);
+    }
+  }
+  return (double)(clock()-st)/CLOCKS_PER_SEC;
+}
+
+static int check(int len, int isreal, int level)
+{
+  memcpy(buf,src,len*2*sizeof(WDL_FFT_REAL));
+  if (isreal) WDL_real_fft(buf,len,0);
+  else WDL_fft((WDL_FFT_COMPLEX*)buf,len,0);
+  if (!level)
+  {
+    memcpy(ref[isreal],buf,len*2*sizeof(WDL_FFT_REAL));
+    return 1;
+  }
+  return !memcmp(ref[isreal],buf,(isreal ? len : len*2)*sizeof(WDL_FFT_REAL));
+}
+
+int main()
+{
+  static const char *names[4]={"scalar","sse2/neon","avx","avx512"};
+  int len, x, maxlevel;
+
+  WDL_fft_init();
+  maxlevel=WDL_fft_set_simd(100);
+
+  srand(1);
+  for (x = 0; x < MAXLEN*2; x ++) src[x] = (WDL_FFT_REAL) (rand()/(double)RAND_MAX - 0.5);
+
+  printf("WDL_FFT_REALSIZE=%d, Mpoints/s (forward+inverse)\n\n",WDL_FFT_REALSIZE);
+  printf("%6s","len");
+  for (x = 0; x <= maxlevel; x ++) printf(" %10s %10s",names[x],"(real)");
+  printf("\n");
+
+  for (len = 16; len <= MAXLEN; len *= 2)
+  {
+    const int reps = (1<<22) / len;
+    printf("%6d",len);
+    for (x = 0; x <= maxlevel; x ++)
+    {
+      int isreal;
+      WDL_fft_set_simd(x);
+      for (isreal = 0; isreal < 2; isreal ++)
+      {
+        const double t = run(len,isreal,reps);
+        if (!check(len,isreal,x)) printf(" %10s","MISMATCH");
+        else printf(" %10.1f",t > 0.0 ? (double)len*reps / t * 1.0e-6 : 0.0);
+      }
+    }
+    printf("\n");
+  }
+
+  WDL_fft_set_simd(maxlevel);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+  fft_cmultest.c: checks that the complexmul kernels give bit-identical results at each SIMD level
+
+  gcc -O2 fft_cmultest.c fft.c -lm -o fft_cmultest
+  gcc -O2 -DWDL_FFT_REALSIZE=8 fft_cmultest.c fft.c -lm -o fft_cmultest
+  cl /O2 fft_cmultest.c fft.c
+
+  runs WDL_fft_complexmul, complexmul2/3, their _f and _split variants on random data,
+  for lengths 0..MAXLEN and unaligned buffers, at every level WDL_fft_set_simd() allows,
+  and compares the output with memcmp against the scalar level. prints a line per
+  function and returns nonzero if any level differs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+
+#define MAXLEN 1100
+#define NFUNCS 7
+
+// +1 so that every buffer can also be used one element (half a complex pair) off alignment
+static WDL_FFT_REAL srca[MAXLEN*2+1], srcb[MAXLEN*2+1], srcd[MAXLEN*2+1];
+static float srcf[MAXLEN*2+1];
+static WDL_FFT_REAL out[MAXLEN*2+2], ref[MAXLEN*2+2];
+
+static void run(int func, int len, int offs)
+{
+  WDL_FFT_REAL *d=out+offs;
+  const WDL_FFT_REAL *a=srca+offs, *b=srcb+offs;
+
+  memset(out,0,sizeof(out));
+  if (func == 0 || func == 3 || func == 4 || func == 6) memcpy(d,srcd+offs,len*2*sizeof(WDL_FFT_REAL)); // accumulates or in-place
+
+  switch (func)
+  {
+    case 0: WDL_fft_complexmul((WDL_FFT_COMPLEX*)d,(WDL_FFT_COMPLEX*)b,len); break;
+    case 1: WDL_fft_complexmul2((WDL_FFT_COMPLEX*)d,(WDL_FFT_COMPLEX*)a,(WDL_FFT_COMPLEX*)b,len); break;
+    case 2: WDL_fft_complexmul2_f((WDL_FFT_COMPLEX*)d,(WDL_FFT_COMPLEX*)a,srcf+offs,len); break;
+    case 3: WDL_fft_complexmul3((WDL_FFT_COMPLEX*)d,(WDL_FFT_COMPLEX*)a,(WDL_FFT_COMPLEX*)b,len); break;
+    case 4: WDL_fft_complexmul3_f((WDL_FFT_COMPLEX*)d,(WDL_FFT_COMPLEX*)a,srcf+offs,len); break;
+    case 5: WDL_fft_complexmul2_split(d,d+len,a,a+len,b,b+len,len); break;
+    case 6: WDL_fft_complexmul3_split(d,d+len,a,a+len,b,b+len,len); break;
+  }
+}
+
+int main()
+{
+  static const char *names[4]={"scalar","sse2/neon","avx","avx512"};
+  static const char *funcs[NFUNCS]={
+    "complexmul","complexmul2","complexmul2_f","complexmul3","complexmul3_f","complexmul2_split","complexmul3_split"
+  };
+  int func, x, maxlevel, errors=0;
+
+  WDL_fft_init();
+  maxlevel=WDL_fft_set_simd(100);
+
+  srand(1);
+  for (x = 0; x < MAXLEN*2+1; x ++)
+  {
+    srca[x] = (WDL_FFT_REAL) (rand()/(double)RAND_MAX - 0.5);
+    srcb[x] = (WDL_FFT_REAL) (rand()/(double)RAND_MAX - 0.5);
+    srcd[x] = (WDL_FFT_REAL) (rand()/(double)RAND_MAX - 0.5);
+    srcf[x] = (float) (rand()/(double)RAND_MAX - 0.5);
+  }
+
+  printf("WDL_FFT_REALSIZE=%d, levels 0..%d\n\n",WDL_FFT_REALSIZE,maxlevel);
+
+  for (func = 0; func < NFUNCS; func ++)
+  {
+    int level, len, bad=0;
+    printf("%18s",funcs[func]);
+    for (level = 1; level <= maxlevel; level ++)
+    {
+      int mismatch=0;
+      for (len = 0; len <= MAXLEN && !mismatch; len ++)
+      {
+        int offs;
+        for (offs = 0; offs < 2; offs ++)
+        {
+          WDL_fft_set_simd(0);
+          run(func,len,offs);
+          memcpy(ref,out,sizeof(out));
+
+          WDL_fft_set_simd(level);
+          run(func,len,offs);
+          if (memcmp(ref,out,sizeof(out)))
+          {
+            printf(" %s: MISMATCH (len=%d%s)",names[level],len,offs ? ", unaligned" : "");
+            mismatch=1;
+            break;
+          }
+        }
+      }
+      if (!mismatch) printf(" %s: ok",names[level]);
+      bad+=mismatch;
+    }
+    if (maxlevel < 1) printf(" (scalar only)");
+    printf("\n");
+    errors+=bad;
+  }
+
+  WDL_fft_set_simd(maxlevel);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+  WDL - fft_dual.h
+
+  Float and double versions of the WDL FFT in the same binary, independent of
+  WDL_FFT_REALSIZE. Compile fft_f32.c and/or fft_f64.c (these can be used
+  together with fft.c), then either call the suffixed functions directly:
+
+    WDL_fft_init_f32();
+    WDL_fft_f32(buf, 1024, 0);
+
+  or, from C++, pick the precision with a template parameter:
+
+    WDL_FFT<float>::init();
+    WDL_FFT<float>::real_fft(buf, 1024, 0);
+
+  The functions behave exactly as those in fft.h. The float version has
+  twice as many values per SIMD vector as the double version.
+*/
+
+#ifndef _WDL_FFT_DUAL_H_
+#define _WDL_FFT_DUAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WDL_FFT_DUAL_DECL(T, SFX) \
+  typedef struct { T re; T im; } WDL_FFT_COMPLEX##SFX; \
+  extern void WDL_fft_init##SFX(); \
+  extern int WDL_fft_set_simd##SFX(int maxlevel); \
+  extern void WDL_fft_complexmul##SFX(WDL_FFT_COMPLEX##SFX *dest, WDL_FFT_COMPLEX##SFX *src, int len); \
+  extern void WDL_fft_complexmul2##SFX(WDL_FFT_COMPLEX##SFX *dest, WDL_FFT_COMPLEX##SFX *src, WDL_FFT_COMPLEX##SFX *src2, int len); \
+  extern void WDL_fft_complexmul3##SFX(WDL_FFT_COMPLEX##SFX *destAdd, WDL_FFT_COMPLEX##SFX *src, WDL_FFT_COMPLEX##SFX *src2, int len); \
+  extern void WDL_fft_complexmul2_f##SFX(WDL_FFT_COMPLEX##SFX *dest, WDL_FFT_COMPLEX##SFX *src, const float *src2, int len); \
+  extern void WDL_fft_complexmul3_f##SFX(WDL_FFT_COMPLEX##SFX *destAdd, WDL_FFT_COMPLEX##SFX *src, const float *src2, int len); \
+  extern void WDL_fft_complexmul2_split##SFX(T *destre, T *destim, const T *srcre, const T *srcim, const T *src2re, const T *src2im, int len); \
+  extern void WDL_fft_complexmul3_split##SFX(T *destAddre, T *destAddim, const T *srcre, const T *srcim, const T *src2re, const T *src2im, int len); \
+  extern void WDL_fft_split##SFX(T *destre, T *destim, const WDL_FFT_COMPLEX##SFX *src, int len); \
+  extern void WDL_fft_unsplit##SFX(WDL_FFT_COMPLEX##SFX *dest, const T *srcre, const T *srcim, int len); \
+  extern void WDL_fft##SFX(WDL_FFT_COMPLEX##SFX *, int len, int isInverse); \
+  extern void WDL_real_fft##SFX(T *, int len, int isInverse); \
+  extern void WDL_fft_batch##SFX(WDL_FFT_COMPLEX##SFX **bufs, int nbufs, int len, int isInverse); \
+  extern void WDL_real_fft_batch##SFX(T **bufs, int nbufs, int len, int isInverse); \
+  extern int WDL_fft_permute##SFX(int fftsize, int idx); \
+  extern int *WDL_fft_permute_tab##SFX(int fftsize);
+
+WDL_FFT_DUAL_DECL(float, _f32)
+WDL_FFT_DUAL_DECL(double, _f64)
+
+#undef WDL_FFT_DUAL_DECL
+
+#ifdef __cplusplus
+};
+
+template<class T> class WDL_FFT;
+
+#define WDL_FFT_DUAL_CLASS(T, SFX) \
+template<> class WDL_FFT<T> \
+{ \
+public: \
+  typedef T REAL; \
+  typedef WDL_FFT_COMPLEX##SFX COMPLEX; \
+  static void init() { WDL_fft_init##SFX(); } \
+  static int set_simd(int maxlevel) { return WDL_fft_set_simd##SFX(maxlevel); } \
+  static void fft(COMPLEX *buf, int len, int isInverse) { WDL_fft##SFX(buf,len,isInverse); } \
+  static void real_fft(REAL *buf, int len, int isInverse) { WDL_real_fft##SFX(buf,len,isInverse); } \
+  static void fft_batch(COMPLEX **bufs, int nbufs, int len, int isInverse) { WDL_fft_batch##SFX(bufs,nbufs,len,isInverse); } \
+  static void real_fft_batch(REAL **bufs, int nbufs, int len, int isInverse) { WDL_real_fft_batch##SFX(bufs,nbufs,len,isInverse); } \
+  static void complexmul(COMPLEX *dest, COMPLEX *src, int len) { WDL_fft_complexmul##SFX(dest,src,len); } \
+  static void complexmul2(COMPLEX *dest, COMPLEX *src, COMPLEX *src2, int len) { WDL_fft_complexmul2##SFX(dest,src,src2,len); } \
+  static void complexmul3(COMPLEX *destAdd, COMPLEX *src, COMPLEX *src2, int len) { WDL_fft_complexmul3##SFX(destAdd,src,src2,len); } \
+  static void complexmul2_f(COMPLEX *dest, COMPLEX *src, const float *src2, int len) { WDL_fft_complexmul2_f##SFX(dest,src,src2,len); } \
+  static void complexmul3_f(COMPLEX *destAdd, COMPLEX *src, const float *src2, int len) { WDL_fft_complexmul3_f##SFX(destAdd,src,src2,len); } \
+  static int permute(int fftsize, int idx) { return WDL_fft_permute##SFX(fftsize,idx); } \
+  static int *permute_tab(int fftsize) { return WDL_fft_permute_tab##SFX(fftsize); } \
+};
+
+WDL_FFT_DUAL_CLASS(float, _f32)
+WDL_FFT_DUAL_CLASS(double, _f64)
+
+#undef WDL_FFT_DUAL_CLASS
+
+#endif // __cplusplus
+
+#endif
@@ -0,0 +1,12 @@
+/*
+  WDL - fft_f32.c
+
+  Single precision build of fft.c, with _f32 appended to every symbol (WDL_fft_f32(),
+  WDL_real_fft_f32(), etc). Compile this and/or fft_f64.c alongside (or instead of)
+  fft.c, and use fft_dual.h.
+*/
+
+#undef WDL_FFT_REALSIZE
+#define WDL_FFT_REALSIZE 4
+#define WDL_FFT_NAMESUFFIX _f32
+#include "fft.c"
@@ -0,0 +1,12 @@
+/*
+  WDL - fft_f64.c
+
+  Double precision build of fft.c, with _f64 appended to every symbol (WDL_fft_f64(),
+  WDL_real_fft_f64(), etc). Compile this and/or fft_f32.c alongside (or instead of)
+  fft.c, and use fft_dual.h.
+*/
+
+#undef WDL_FFT_REALSIZE
+#define WDL_FFT_REALSIZE 8
+#define WDL_FFT_NAMESUFFIX _f64
+#include "fft.c"
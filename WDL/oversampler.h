@@ -0,0 +1,505 @@
+/*
+    WDL - oversampler.h
+    Copyright (C) 2026 and later Cockos Incorporated
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would be
+       appreciated but is not required.
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+    3. This notice may not be removed or altered from any source distribution.
+
+
+  Block oversampling for nonlinear processing: a cascade of 2x half-band stages,
+  either linear-phase (polyphase FIR) or minimum-phase-like (polyphase IIR allpass
+  pairs, low latency). Each stage only runs at the rate it needs, and later stages
+  use shorter filters since their transition bands are wider.
+
+  Example:
+
+    WDL_Oversampler os;
+    os.Setup(8, 2); // 8x, stereo, linear-phase
+    latency = os.GetLatency();
+
+    os.Upsample(inputs, nFrames);
+    for (ch = 0; ch < 2; ch ++)
+    {
+      double *buf = os.GetBuf(ch);
+      for (i = 0; i < nFrames*8; i ++) buf[i] = distort(buf[i]);
+    }
+    os.Downsample(outputs, nFrames);
+
+*/
+
+#ifndef _WDL_OVERSAMPLER_H_
+#define _WDL_OVERSAMPLER_H_
+
+#include <math.h>
+#include <string.h>
+#include "heapbuf.h"
+
+#if !defined(WDL_OVERSAMPLER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define WDL_OVERSAMPLER_SSE2
+  #include <emmintrin.h>
+#elif !defined(WDL_OVERSAMPLER_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+  #define WDL_OVERSAMPLER_NEON
+  #include <arm_neon.h>
+#endif
+
+#define WDL_OVERSAMPLER_MAX_STAGES 4 // 16x
+#define WDL_OVERSAMPLER_MAX_COEFS 64 // per stage
+
+
+class WDL_Oversampler
+{
+public:
+  enum { LINEAR_PHASE=0, MINIMUM_PHASE=1 };
+
+  WDL_Oversampler() { m_factor=1; m_nstages=0; m_nch=0; m_mode=LINEAR_PHASE; m_latency=0.0; m_bufsize=0; m_chstate=0; }
+  ~WDL_Oversampler() { }
+
+  // factor is rounded up to 1, 2, 4, 8 or 16. attenuation (dB) is the stopband rejection of each stage,
+  // with a passband up to 0.45*the base samplerate.
+  void Setup(int factor, int nch, int mode=LINEAR_PHASE, double attenuation=100.0)
+  {
+    if (nch < 1) nch=1;
+    m_nch=nch;
+    m_mode=mode;
+    m_factor=1;
+    m_nstages=0;
+    while (m_factor < factor && m_nstages < WDL_OVERSAMPLER_MAX_STAGES) { m_factor*=2; m_nstages++; }
+
+    int statesize=0;
+    m_latency=0.0;
+    int s;
+    for (s = 0; s < m_nstages; s ++)
+    {
+      Stage *st=&m_stages[s];
+      const double fp = 0.45 / (double)(2<<s); // passband edge, relative to this stage's output rate
+
+      double lat; // of the up and down filters combined, at this stage's output rate
+      if (mode == MINIMUM_PHASE)
+      {
+        st->ncoefs=DesignAllpass(st->coefs,attenuation,0.25-fp);
+        st->upstate=st->downstate=st->ncoefs*2;
+        lat=0.0; // at DC, the mean group delay of the two branches, in each direction
+        int x;
+        for (x = 0; x < st->ncoefs; x ++) lat += 2.0*(1.0-st->coefs[x])/(1.0+st->coefs[x]); // each z^-2 allpass
+      }
+      else
+      {
+        st->ncoefs=DesignHalfband(st->coefs,attenuation,0.5-2.0*fp);
+        st->upstate=2*st->ncoefs-1;
+        st->downstate=3*st->ncoefs-1;
+        lat=2.0*(2*st->ncoefs-1);
+      }
+      m_latency += lat / (double)(2<<s);
+
+      st->upofs=statesize;
+      st->downofs=statesize+st->upstate;
+      statesize += st->upstate + st->downstate;
+    }
+    m_chstate=statesize;
+    m_state.Resize(statesize*nch);
+    m_bufsize=0;
+    Reset();
+  }
+
+  void Reset()
+  {
+    memset(m_state.Get(),0,m_state.GetSize()*sizeof(double));
+  }
+
+  void SetMaxBlockSize(int n) { if (n > 0) PrepareBufs(n); } // optional: allocates buffers now rather than in Upsample()
+
+  int GetFactor() const { return m_factor; }
+  double GetLatency() const { return m_latency; } // of Upsample() followed by Downsample(), in base rate samples
+
+  // in[ch][0..n-1] -> GetBuf(ch)[0..n*GetFactor()-1]
+  void Upsample(const double * const *in, int n)
+  {
+    if (n < 1) return;
+    PrepareBufs(n);
+
+    int ch;
+    for (ch = 0; ch < m_nch; ch ++)
+    {
+      double *state=m_state.Get() + ch*m_chstate;
+      const double *src=in[ch];
+      int len=n, s;
+      for (s = 0; s < m_nstages; s ++)
+      {
+        const Stage *st=&m_stages[s];
+        double *dest = s == m_nstages-1 ? GetBuf(ch) : m_tmp[s&1].Get();
+        if (m_mode == MINIMUM_PHASE) UpsampleAllpass(st,state+st->upofs,dest,src,len);
+        else UpsampleHalfband(st,state+st->upofs,dest,src,len);
+        src=dest;
+        len*=2;
+      }
+      if (!m_nstages) memcpy(GetBuf(ch),src,n*sizeof(double));
+    }
+  }
+
+  double *GetBuf(int ch) { return m_bufs.Get() + ch*m_bufsize; }
+
+  // GetBuf(ch)[0..n*GetFactor()-1] -> out[ch][0..n-1]
+  void Downsample(double **out, int n)
+  {
+    if (n < 1 || n*m_factor > m_bufsize) return;
+
+    int ch;
+    for (ch = 0; ch < m_nch; ch ++)
+    {
+      double *state=m_state.Get() + ch*m_chstate;
+      const double *src=GetBuf(ch);
+      int len=n*m_factor, s;
+      for (s = m_nstages-1; s >= 0; s --)
+      {
+        const Stage *st=&m_stages[s];
+        double *dest = s == 0 ? out[ch] : m_tmp[s&1].Get();
+        len/=2;
+        if (m_mode == MINIMUM_PHASE) DownsampleAllpass(st,state+st->downofs,dest,src,len);
+        else DownsampleHalfband(st,state+st->downofs,dest,src,len);
+        src=dest;
+      }
+      if (!m_nstages) memcpy(out[ch],src,n*sizeof(double));
+    }
+  }
+
+
+  // linear-phase half-band lowpass, Kaiser windowed. returns the number of odd taps K+1, where
+  // h[0]=0.5, h[+-(2i+1)]=coefs[i], other taps zero (4K+3 taps in all)
+  static int DesignHalfband(double *coefs, double attenuation, double transition)
+  {
+    if (transition < 0.01) transition=0.01;
+    const double ntaps = (attenuation - 7.95) / (14.36 * transition) + 1.0;
+    int ncoefs = (int) ((ntaps - 3.0) / 4.0 + 1.999);
+    if (ncoefs < 1) ncoefs=1;
+    else if (ncoefs > WDL_OVERSAMPLER_MAX_COEFS) ncoefs=WDL_OVERSAMPLER_MAX_COEFS;
+
+    const double beta = attenuation > 50.0 ? 0.1102 * (attenuation - 8.7) :
+                        attenuation > 21.0 ? 0.5842 * pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0) : 0.0;
+    const double m = 2.0*ncoefs; // window reaches 0 just past the outermost tap
+    double sum=0.0;
+    int i;
+    for (i = 0; i < ncoefs; i ++)
+    {
+      const double j = 2*i+1, r = j/m;
+      const double w = BesselI0(beta*sqrt(1.0-r*r)) / BesselI0(beta);
+      coefs[i] = ((i&1) ? -1.0 : 1.0) / (3.1415926535897932384626433832795 * j) * w;
+      sum += coefs[i];
+    }
+    for (i = 0; i < ncoefs; i ++) coefs[i] *= 0.25/sum; // unity gain at DC
+    return ncoefs;
+  }
+
+  // polyphase IIR half-band (two branches of first order allpasses in z^-2), as described
+  // by Valenzuela and Constantinides. returns an even number of coefficients, alternating
+  // between the branches
+  static int DesignAllpass(double *coefs, double attenuation, double transition)
+  {
+    const double pi = 3.1415926535897932384626433832795;
+    if (transition < 0.001) transition=0.001;
+    else if (transition > 0.45) transition=0.45;
+
+    double k = tan((1.0 - transition*2.0) * pi / 4.0);
+    k *= k;
+    const double kksqrt = pow(1.0 - k*k, 0.25);
+    const double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+    const double e4 = e*e*e*e;
+    const double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+    const double attn = pow(10.0, -attenuation / 10.0);
+    const double a = attn / (1.0 - attn);
+    int order = (int) ceil(log(a*a / 16.0) / log(q));
+    int ncoefs = order < 3 ? 1 : (order-1+1)/2;
+    ncoefs = (ncoefs+1)&~1;
+    if (ncoefs > WDL_OVERSAMPLER_MAX_COEFS) ncoefs=WDL_OVERSAMPLER_MAX_COEFS;
+    order = ncoefs*2 + 1;
+
+    int c;
+    for (c = 1; c <= ncoefs; c ++)
+    {
+      double num=0.0, den=0.0, t;
+      int i=0, sgn=1;
+      do
+      {
+        t = pow(q, i*(i+1)) * sin((i*2+1) * c * pi / order) * sgn;
+        num += t;
+        sgn=-sgn;
+        i++;
+      } while (fabs(t) > 1e-100);
+
+      i=1; sgn=-1;
+      do
+      {
+        t = pow(q, i*i) * cos(i*2 * c * pi / order) * sgn;
+        den += t;
+        sgn=-sgn;
+        i++;
+      } while (fabs(t) > 1e-100);
+
+      const double ww = num * pow(q, 0.25) / (den + 0.5), wwsq = ww*ww;
+      const double x = sqrt((1.0 - wwsq*k) * (1.0 - wwsq/k)) / (1.0 + wwsq);
+      coefs[c-1] = (1.0 - x) / (1.0 + x);
+    }
+    return ncoefs;
+  }
+
+private:
+
+  struct Stage
+  {
+    double coefs[WDL_OVERSAMPLER_MAX_COEFS];
+    int ncoefs;
+    int upstate, downstate; // doubles of state per channel
+    int upofs, downofs; // in each channel's state
+  };
+
+  void PrepareBufs(int n)
+  {
+    const int sz = n*m_factor;
+    if (sz > m_bufsize)
+    {
+      m_bufsize=sz;
+      m_bufs.Resize(sz*m_nch,false);
+      m_tmp[0].Resize(sz/2 > 0 ? sz/2 : 1,false);
+      m_tmp[1].Resize(sz/2 > 0 ? sz/2 : 1,false);
+
+      int hist=0, s;
+      for (s = 0; s < m_nstages; s ++) if (hist < m_stages[s].downstate) hist=m_stages[s].downstate;
+      m_scratch.Resize(sz + 2*hist,false);
+    }
+  }
+
+  // out[i] = sum over k of c[k]*(p[i-K-1-k] + p[i-K+k]), K=nc-1: the odd taps of the half-band filter
+  static void HalfbandFIR(double *out, const double *p, int n, const double *c, int nc)
+  {
+    p -= nc; // p[i-K-1]
+    int i=0, k;
+#if defined(WDL_OVERSAMPLER_SSE2) || defined(WDL_OVERSAMPLER_NEON)
+  #ifdef WDL_OVERSAMPLER_SSE2
+    #define WDL_OS_VEC __m128d
+    #define WDL_OS_ZERO() _mm_setzero_pd()
+    #define WDL_OS_SPLAT(x) _mm_set1_pd(x)
+    #define WDL_OS_LOAD(p) _mm_loadu_pd(p)
+    #define WDL_OS_STORE(p,v) _mm_storeu_pd(p,v)
+    #define WDL_OS_ADD(a,b) _mm_add_pd(a,b)
+    #define WDL_OS_MUL(a,b) _mm_mul_pd(a,b)
+  #else
+    #define WDL_OS_VEC float64x2_t
+    #define WDL_OS_ZERO() vdupq_n_f64(0.0)
+    #define WDL_OS_SPLAT(x) vdupq_n_f64(x)
+    #define WDL_OS_LOAD(p) vld1q_f64(p)
+    #define WDL_OS_STORE(p,v) vst1q_f64(p,v)
+    #define WDL_OS_ADD(a,b) vaddq_f64(a,b)
+    #define WDL_OS_MUL(a,b) vmulq_f64(a,b)
+  #endif
+    #define WDL_OS_TAP(o) WDL_OS_MUL(ck,WDL_OS_ADD(WDL_OS_LOAD(p+i+(o)-k),WDL_OS_LOAD(p+i+(o)+k+1)))
+    for (; i < n-7; i += 8) // four independent sums
+    {
+      WDL_OS_VEC s0=WDL_OS_ZERO(), s1=WDL_OS_ZERO(), s2=WDL_OS_ZERO(), s3=WDL_OS_ZERO();
+      for (k = 0; k < nc; k ++)
+      {
+        const WDL_OS_VEC ck=WDL_OS_SPLAT(c[k]);
+        s0=WDL_OS_ADD(s0,WDL_OS_TAP(0));
+        s1=WDL_OS_ADD(s1,WDL_OS_TAP(2));
+        s2=WDL_OS_ADD(s2,WDL_OS_TAP(4));
+        s3=WDL_OS_ADD(s3,WDL_OS_TAP(6));
+      }
+      WDL_OS_STORE(out+i,s0);
+      WDL_OS_STORE(out+i+2,s1);
+      WDL_OS_STORE(out+i+4,s2);
+      WDL_OS_STORE(out+i+6,s3);
+    }
+    for (; i < n-1; i += 2)
+    {
+      WDL_OS_VEC s0=WDL_OS_ZERO();
+      for (k = 0; k < nc; k ++)
+      {
+        const WDL_OS_VEC ck=WDL_OS_SPLAT(c[k]);
+        s0=WDL_OS_ADD(s0,WDL_OS_TAP(0));
+      }
+      WDL_OS_STORE(out+i,s0);
+    }
+    #undef WDL_OS_TAP
+    #undef WDL_OS_VEC
+    #undef WDL_OS_ZERO
+    #undef WDL_OS_SPLAT
+    #undef WDL_OS_LOAD
+    #undef WDL_OS_STORE
+    #undef WDL_OS_ADD
+    #undef WDL_OS_MUL
+#endif
+    for (; i < n; i ++)
+    {
+      double sum=0.0;
+      for (k = 0; k < nc; k ++) sum += c[k] * (p[i-k] + p[i+k+1]);
+      out[i]=sum;
+    }
+  }
+
+  // FIR state: the last 2K+1 input samples
+  void UpsampleHalfband(const Stage *st, double *state, double *out, const double *in, int n)
+  {
+    const int hist=st->upstate, nc=st->ncoefs;
+    double *p=m_scratch.Get();
+    memcpy(p,state,hist*sizeof(double));
+    memcpy(p+hist,in,n*sizeof(double));
+    p+=hist;
+
+    // even outputs: filtered (with gain 2), odd outputs: the input delayed by K
+    double *even=m_scratch.Get()+hist+n;
+    HalfbandFIR(even,p,n,st->coefs,nc);
+    int i;
+    for (i = 0; i < n; i ++)
+    {
+      out[i*2]=even[i]*2.0;
+      out[i*2+1]=p[i-nc+1];
+    }
+    memcpy(state,p+n-hist,hist*sizeof(double));
+  }
+
+  // FIR state: the last 2K+1 even input samples, then the last K+1 odd input samples
+  void DownsampleHalfband(const Stage *st, double *state, double *out, const double *in, int n)
+  {
+    const int nc=st->ncoefs, ehist=2*nc-1, ohist=nc;
+    double *e=m_scratch.Get(), *o=e+ehist+n;
+    memcpy(e,state,ehist*sizeof(double));
+    memcpy(o,state+ehist,ohist*sizeof(double));
+    int i;
+    for (i = 0; i < n; i ++)
+    {
+      e[ehist+i]=in[i*2];
+      o[ohist+i]=in[i*2+1];
+    }
+    e+=ehist;
+    o+=ohist;
+
+    HalfbandFIR(out,e,n,st->coefs,nc);
+    for (i = 0; i < n; i ++) out[i] += 0.5*o[i-nc];
+
+    memcpy(state,e+n-ehist,ehist*sizeof(double));
+    memcpy(state+ehist,o+n-ohist,ohist*sizeof(double));
+  }
+
+  // allpass state: x,y pairs for each coefficient, in branch pairs (even branch, odd branch).
+  // the two branches run in the two SIMD lanes. y = c*(in-y1)+x1, as c*in + (x1-c*y1) to shorten the dependency chain
+  static void UpsampleAllpass(const Stage *st, double *state, double *out, const double *in, int n)
+  {
+    const int np=st->ncoefs/2;
+    const double *c=st->coefs;
+    int i, j;
+#ifdef WDL_OVERSAMPLER_SSE2
+    for (i = 0; i < n; i ++)
+    {
+      __m128d v=_mm_set1_pd(in[i]);
+      double *sp=state;
+      for (j = 0; j < np; j ++)
+      {
+        const __m128d cj=_mm_loadu_pd(c+j*2);
+        const __m128d t=_mm_add_pd(_mm_mul_pd(v,cj),_mm_sub_pd(_mm_loadu_pd(sp),_mm_mul_pd(_mm_loadu_pd(sp+2),cj)));
+        _mm_storeu_pd(sp,v);
+        _mm_storeu_pd(sp+2,t);
+        v=t;
+        sp+=4;
+      }
+      _mm_storeu_pd(out+i*2,v);
+    }
+#else
+    for (i = 0; i < n; i ++)
+    {
+      double v0=in[i], v1=in[i];
+      double *sp=state;
+      for (j = 0; j < np; j ++)
+      {
+        const double t0=v0*c[j*2]+(sp[0]-sp[2]*c[j*2]), t1=v1*c[j*2+1]+(sp[1]-sp[3]*c[j*2+1]);
+        sp[0]=v0; sp[1]=v1;
+        sp[2]=v0=t0; sp[3]=v1=t1;
+        sp+=4;
+      }
+      out[i*2]=v0;
+      out[i*2+1]=v1;
+    }
+#endif
+    FlushState(state,np*4);
+  }
+
+  static void DownsampleAllpass(const Stage *st, double *state, double *out, const double *in, int n)
+  {
+    const int np=st->ncoefs/2;
+    const double *c=st->coefs;
+    int i, j;
+#ifdef WDL_OVERSAMPLER_SSE2
+    for (i = 0; i < n; i ++)
+    {
+      __m128d v=_mm_shuffle_pd(_mm_loadu_pd(in+i*2),_mm_loadu_pd(in+i*2),1);
+      double *sp=state;
+      for (j = 0; j < np; j ++)
+      {
+        const __m128d cj=_mm_loadu_pd(c+j*2);
+        const __m128d t=_mm_add_pd(_mm_mul_pd(v,cj),_mm_sub_pd(_mm_loadu_pd(sp),_mm_mul_pd(_mm_loadu_pd(sp+2),cj)));
+        _mm_storeu_pd(sp,v);
+        _mm_storeu_pd(sp+2,t);
+        v=t;
+        sp+=4;
+      }
+      out[i]=0.5*(_mm_cvtsd_f64(v)+_mm_cvtsd_f64(_mm_unpackhi_pd(v,v)));
+    }
+#else
+    for (i = 0; i < n; i ++)
+    {
+      double v0=in[i*2+1], v1=in[i*2];
+      double *sp=state;
+      for (j = 0; j < np; j ++)
+      {
+        const double t0=v0*c[j*2]+(sp[0]-sp[2]*c[j*2]), t1=v1*c[j*2+1]+(sp[1]-sp[3]*c[j*2+1]);
+        sp[0]=v0; sp[1]=v1;
+        sp[2]=v0=t0; sp[3]=v1=t1;
+        sp+=4;
+      }
+      out[i]=0.5*(v0+v1);
+    }
+#endif
+    FlushState(state,np*4);
+  }
+
+  // the allpass state decays into denormals after the input goes silent, zero it once per block instead
+  static void FlushState(double *state, int n)
+  {
+    int i;
+    for (i = 0; i < n; i ++) if (fabs(state[i]) < 1.0e-30) state[i]=0.0;
+  }
+
+  static double BesselI0(double x)
+  {
+    double sum=1.0, t=1.0;
+    int k;
+    for (k = 1; k < 64; k ++)
+    {
+      t *= (x*0.5/k)*(x*0.5/k);
+      sum += t;
+      if (t < sum*1.0e-16) break;
+    }
+    return sum;
+  }
+
+  Stage m_stages[WDL_OVERSAMPLER_MAX_STAGES];
+  WDL_TypedBuf<double> m_state; // per channel: stage up states, then stage down states
+  WDL_TypedBuf<double> m_bufs, m_tmp[2], m_scratch;
+  double m_latency;
+  int m_factor, m_nstages, m_nch, m_mode;
+  int m_bufsize; // per channel, in m_bufs
+  int m_chstate; // doubles of m_state per channel
+} WDL_FIXALIGN;
+
+#endif
@@ -26,6 +26,8 @@
 #include <math.h>
 
 #include "denormal.h"
+#include "mutex.h"
+#include "ptrlist.h"
 
 #ifndef PI
 #define PI 3.1415926535897932384626433832795
@@ -91,36 +93,207 @@ private:
 };
 
 
-void inline WDL_Resampler::SincSample(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, int nch, const WDL_SincFilterSample *filter, int filtsz)
-{
-  const int oversize=m_lp_oversize;
+/*
+  multichannel sinc: the two filter phases either side of the fractional position are blended
+  into m_filter_phase once per output sample, and that filter is then applied to every channel,
+  with the channels (which are adjacent in the interleaved input) spread across SIMD lanes.
+  each channel is summed in tap order, so every SIMD level produces the same output.
+*/
 
-  fracpos *= oversize;
-  const int ifpos=(int)fracpos;
-  filter += (oversize-ifpos) * filtsz;
-  fracpos -= ifpos;
+typedef void (*WDL_Resampler_SincDotFunc)(WDL_ResampleSample *out, const WDL_ResampleSample *in, const double *filter, int filtsz, int nch, int span);
 
+static void WDL_Resampler_SincDot_c(WDL_ResampleSample *out, const WDL_ResampleSample *in, const double *filter, int filtsz, int nch, int span)
+{
   int x;
   for (x = 0; x < nch; x ++)
   {
-    double sum=0.0,sum2=0.0;
-    const WDL_SincFilterSample *fptr2=filter;
-    const WDL_SincFilterSample *fptr=fptr2 - filtsz;
-    const WDL_ResampleSample *iptr=inptr+x;
-    int i=filtsz/2;
-    while (i--)
+    double sum=0.0;
+    const WDL_ResampleSample *iptr=in+x;
+    int i;
+    for (i = 0; i < filtsz; i ++)
     {
-      sum += fptr[0]*iptr[0]; 
-      sum2 += fptr2[0]*iptr[0]; 
-      sum += fptr[1]*iptr[nch]; 
-      sum2 += fptr2[1]*iptr[nch]; 
-      iptr+=nch*2;
-      fptr+=2;
-      fptr2+=2;
+      sum += filter[i]*iptr[0];
+      iptr+=span;
     }
-    outptr[x]=sum*fracpos + sum2*(1.0-fracpos);
+    out[x]=sum;
+  }
+}
+
+#if !defined(WDL_RESAMPLE_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+  #define WDL_RESAMPLE_SIMD_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif !defined(WDL_RESAMPLE_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+  #define WDL_RESAMPLE_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define WDL_RESAMPLE_TARGET(x) __attribute__((target(x)))
+#else
+  #define WDL_RESAMPLE_TARGET(x)
+#endif
+
+// SincDot over blocks of 4 vectors of channels, then single vectors, then the remaining channels in scalar code
+#define WDL_RESAMPLE_DEFINE_SINCDOT(SFX, ATTR) \
+ATTR static void WDL_Resampler_SincDot_##SFX(WDL_ResampleSample *out, const WDL_ResampleSample *in, const double *filter, int filtsz, int nch, int span) \
+{ \
+  int x=0, i; \
+  for (; x <= nch - 4*RS_W; x += 4*RS_W) \
+  { \
+    RS_VEC s0=RS_ZERO(), s1=RS_ZERO(), s2=RS_ZERO(), s3=RS_ZERO(); \
+    const WDL_ResampleSample *iptr=in+x; \
+    for (i = 0; i < filtsz; i ++) \
+    { \
+      const RS_VEC f=RS_SPLAT(filter+i); \
+      s0=RS_ADD(s0,RS_MUL(f,RS_LOAD(iptr))); \
+      s1=RS_ADD(s1,RS_MUL(f,RS_LOAD(iptr+RS_W))); \
+      s2=RS_ADD(s2,RS_MUL(f,RS_LOAD(iptr+2*RS_W))); \
+      s3=RS_ADD(s3,RS_MUL(f,RS_LOAD(iptr+3*RS_W))); \
+      iptr+=span; \
+    } \
+    RS_STORE(out+x,s0); \
+    RS_STORE(out+x+RS_W,s1); \
+    RS_STORE(out+x+2*RS_W,s2); \
+    RS_STORE(out+x+3*RS_W,s3); \
+  } \
+  for (; x <= nch - RS_W; x += RS_W) \
+  { \
+    RS_VEC s0=RS_ZERO(); \
+    const WDL_ResampleSample *iptr=in+x; \
+    for (i = 0; i < filtsz; i ++) \
+    { \
+      s0=RS_ADD(s0,RS_MUL(RS_SPLAT(filter+i),RS_LOAD(iptr))); \
+      iptr+=span; \
+    } \
+    RS_STORE(out+x,s0); \
+  } \
+  if (x < nch) WDL_Resampler_SincDot_c(out+x,in+x,filter,filtsz,nch-x,span); \
+}
+
+#ifdef WDL_RESAMPLE_SIMD_X86
+
+// loads/stores convert to/from double when WDL_ResampleSample is float
+WDL_RESAMPLE_TARGET("sse2") static inline __m128d WDL_Resampler_Load2(const double *p) { return _mm_loadu_pd(p); }
+WDL_RESAMPLE_TARGET("sse2") static inline __m128d WDL_Resampler_Load2(const float *p) { return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)p))); }
+WDL_RESAMPLE_TARGET("sse2") static inline void WDL_Resampler_Store2(double *p, __m128d v) { _mm_storeu_pd(p,v); }
+WDL_RESAMPLE_TARGET("sse2") static inline void WDL_Resampler_Store2(float *p, __m128d v) { _mm_store_sd((double *)p,_mm_castps_pd(_mm_cvtpd_ps(v))); }
+WDL_RESAMPLE_TARGET("avx") static inline __m256d WDL_Resampler_Load4(const double *p) { return _mm256_loadu_pd(p); }
+WDL_RESAMPLE_TARGET("avx") static inline __m256d WDL_Resampler_Load4(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+WDL_RESAMPLE_TARGET("avx") static inline void WDL_Resampler_Store4(double *p, __m256d v) { _mm256_storeu_pd(p,v); }
+WDL_RESAMPLE_TARGET("avx") static inline void WDL_Resampler_Store4(float *p, __m256d v) { _mm_storeu_ps(p,_mm256_cvtpd_ps(v)); }
+
+#define RS_W 2
+#define RS_VEC __m128d
+#define RS_ZERO() _mm_setzero_pd()
+#define RS_SPLAT(p) _mm_set1_pd(*(p))
+#define RS_LOAD(p) WDL_Resampler_Load2(p)
+#define RS_STORE(p,v) WDL_Resampler_Store2(p,v)
+#define RS_ADD(a,b) _mm_add_pd(a,b)
+#define RS_MUL(a,b) _mm_mul_pd(a,b)
+WDL_RESAMPLE_DEFINE_SINCDOT(sse2,WDL_RESAMPLE_TARGET("sse2"))
+#undef RS_W
+#undef RS_VEC
+#undef RS_ZERO
+#undef RS_SPLAT
+#undef RS_LOAD
+#undef RS_STORE
+#undef RS_ADD
+#undef RS_MUL
+
+#define RS_W 4
+#define RS_VEC __m256d
+#define RS_ZERO() _mm256_setzero_pd()
+#define RS_SPLAT(p) _mm256_broadcast_sd(p)
+#define RS_LOAD(p) WDL_Resampler_Load4(p)
+#define RS_STORE(p,v) WDL_Resampler_Store4(p,v)
+#define RS_ADD(a,b) _mm256_add_pd(a,b)
+#define RS_MUL(a,b) _mm256_mul_pd(a,b)
+WDL_RESAMPLE_DEFINE_SINCDOT(avx,WDL_RESAMPLE_TARGET("avx"))
+#undef RS_W
+#undef RS_VEC
+#undef RS_ZERO
+#undef RS_SPLAT
+#undef RS_LOAD
+#undef RS_STORE
+#undef RS_ADD
+#undef RS_MUL
+
+static WDL_Resampler_SincDotFunc WDL_Resampler_GetSincDot()
+{
+#ifdef _MSC_VER
+  int r[4];
+  __cpuid(r,1);
+  if ((r[2] & (1<<27)) && (r[2] & (1<<28)) && (_xgetbv(0) & 6) == 6) return WDL_Resampler_SincDot_avx; // OSXSAVE, AVX, OS saves AVX state
+  if (r[3] & (1<<26)) return WDL_Resampler_SincDot_sse2;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) return WDL_Resampler_SincDot_avx;
+  if (__builtin_cpu_supports("sse2")) return WDL_Resampler_SincDot_sse2;
+#endif
+  return WDL_Resampler_SincDot_c;
+}
+
+#elif defined(WDL_RESAMPLE_SIMD_NEON)
+
+static inline float64x2_t WDL_Resampler_Load2(const double *p) { return vld1q_f64(p); }
+static inline float64x2_t WDL_Resampler_Load2(const float *p) { return vcvt_f64_f32(vld1_f32(p)); }
+static inline void WDL_Resampler_Store2(double *p, float64x2_t v) { vst1q_f64(p,v); }
+static inline void WDL_Resampler_Store2(float *p, float64x2_t v) { vst1_f32(p,vcvt_f32_f64(v)); }
+
+#define RS_W 2
+#define RS_VEC float64x2_t
+#define RS_ZERO() vdupq_n_f64(0.0)
+#define RS_SPLAT(p) vld1q_dup_f64(p)
+#define RS_LOAD(p) WDL_Resampler_Load2(p)
+#define RS_STORE(p,v) WDL_Resampler_Store2(p,v)
+#define RS_ADD(a,b) vaddq_f64(a,b)
+#define RS_MUL(a,b) vmulq_f64(a,b)
+WDL_RESAMPLE_DEFINE_SINCDOT(neon,)
+#undef RS_W
+#undef RS_VEC
+#undef RS_ZERO
+#undef RS_SPLAT
+#undef RS_LOAD
+#undef RS_STORE
+#undef RS_ADD
+#undef RS_MUL
+
+static WDL_Resampler_SincDotFunc WDL_Resampler_GetSincDot() { return WDL_Resampler_SincDot_neon; }
+
+#else
+
+static WDL_Resampler_SincDotFunc WDL_Resampler_GetSincDot() { return WDL_Resampler_SincDot_c; }
+
+#endif
+
+static WDL_Resampler_SincDotFunc s_sincdot; // set by the first WDL_Resampler constructed
+
+
+// the filter for fracpos, interpolated between the two nearest oversampled phases
+static void inline WDL_Resampler_SincPhase(double *out, double fracpos, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  fracpos *= oversize;
+  const int ifpos=(int)fracpos;
+  fracpos -= ifpos;
+
+  const WDL_SincFilterSample *fptr2=filter + (oversize-ifpos) * filtsz;
+  const WDL_SincFilterSample *fptr=fptr2 - filtsz;
+  const double ifracpos=1.0-fracpos;
+  int i;
+  for (i = 0; i < filtsz; i ++)
+  {
+    out[i] = fptr[i]*fracpos + fptr2[i]*ifracpos;
   }
+}
 
+void inline WDL_Resampler::SincSample(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, int nch, const WDL_SincFilterSample *filter, int filtsz)
+{
+  double *phase=m_filter_phase.Get();
+  WDL_Resampler_SincPhase(phase,fracpos,filter,filtsz,m_lp_oversize);
+  s_sincdot(outptr,inptr,phase,filtsz,nch,nch);
 }
 
 void inline WDL_Resampler::SincSample1(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz)
@@ -185,6 +358,154 @@ void inline WDL_Resampler::SincSample2(WDL_ResampleSample *outptr, const WDL_Res
 
 
 
+static WDL_PtrList<WDL_Resampler_FilterBank> s_filterbanks; // most recently used last
+static WDL_Mutex s_filterbanks_mutex;
+
+bool WDL_Resampler_FilterBank::Build()
+{
+  const int wantsize=m_size;
+  const int wantinterp=m_oversize;
+
+  if (m_den) // phases 0/den..(den-1)/den, as WDL_Resampler::SincSample computes them
+  {
+    WDL_Resampler_FilterBank *src=Get(m_size,m_oversize,m_filtpos,0);
+    if (!src) return false;
+
+    double *out=m_phases.Resize(m_den*wantsize,false);
+    const bool ok = m_phases.GetSize()==m_den*wantsize;
+    int x;
+    for (x = 0; ok && x < m_den; x ++)
+    {
+      WDL_Resampler_SincPhase(out + x*wantsize, x/(double)m_den, src->m_coeffs.Get(), wantsize, wantinterp);
+    }
+    Release(src);
+    return ok;
+  }
+
+  // build lowpass filter
+  const int allocsize = wantsize*(wantinterp+1);
+  WDL_SincFilterSample *cfout=m_coeffs.Resize(allocsize);
+  if (m_coeffs.GetSize()!=allocsize) return false;
+
+  const double filtpos=m_filtpos;
+  const double dwindowpos = 2.0 * PI/(double)wantsize;
+  const double dsincpos  = PI * filtpos; // filtpos is outrate/inrate, i.e. 0.5 is going to half rate
+  const int hwantsize=wantsize/2;
+
+  double filtpower=0.0;
+  WDL_SincFilterSample *ptrout = cfout;
+  int slice;
+  for (slice=0;slice<=wantinterp;slice++)
+  {
+    const double frac = slice / (double)wantinterp;
+    const int center_x = slice == 0 ? hwantsize : slice == wantinterp ? hwantsize-1 : -1;
+
+    int x;
+    for (x=0;x<wantsize;x++)
+    {          
+      if (x==center_x) 
+      {
+        // we know this will be 1.0
+        *ptrout++ = 1.0;
+      }
+      else
+      {
+        const double xfrac = frac + x;
+        const double windowpos = dwindowpos * xfrac;
+        const double sincpos = dsincpos * (xfrac - hwantsize);
+
+        // blackman-harris * sinc
+        const double val = (0.35875 - 0.48829 * cos(windowpos) + 0.14128 * cos(2*windowpos) - 0.01168 * cos(3*windowpos)) * sin(sincpos) / sincpos; 
+        if (slice<wantinterp) filtpower+=val;        
+        *ptrout++ = (WDL_SincFilterSample)val;
+      }
+
+    }
+  }
+
+  filtpower = wantinterp/(filtpower+1.0);
+  int x;
+  for (x = 0; x < allocsize; x ++) 
+  {
+    cfout[x] = (WDL_SincFilterSample) (cfout[x]*filtpower);
+  }
+  return true;
+}
+
+WDL_Resampler_FilterBank *WDL_Resampler_FilterBank::Get(int size, int oversize, double filtpos, int den)
+{
+  int x;
+  s_filterbanks_mutex.Enter();
+  for (x = 0; x < s_filterbanks.GetSize(); x ++)
+  {
+    WDL_Resampler_FilterBank *fb=s_filterbanks.Get(x);
+    if (fb->m_size == size && fb->m_oversize == oversize && fb->m_filtpos == filtpos && fb->m_den == den)
+    {
+      fb->m_refcnt++;
+      s_filterbanks_mutex.Leave();
+      return fb;
+    }
+  }
+  s_filterbanks_mutex.Leave();
+
+  // build without holding the lock, other resamplers may be fetching their banks
+  WDL_Resampler_FilterBank *fb=new WDL_Resampler_FilterBank;
+  fb->m_size=size;
+  fb->m_oversize=oversize;
+  fb->m_filtpos=filtpos;
+  fb->m_den=den;
+  fb->m_refcnt=0;
+  if (!fb->Build())
+  {
+    delete fb;
+    return NULL;
+  }
+
+  WDL_MutexLock lock(&s_filterbanks_mutex);
+  for (x = 0; x < s_filterbanks.GetSize(); x ++) // another thread may have built the same bank meanwhile
+  {
+    WDL_Resampler_FilterBank *ex=s_filterbanks.Get(x);
+    if (ex->m_size == size && ex->m_oversize == oversize && ex->m_filtpos == filtpos && ex->m_den == den)
+    {
+      delete fb;
+      ex->m_refcnt++;
+      return ex;
+    }
+  }
+  fb->m_refcnt=1;
+  s_filterbanks.Add(fb);
+  return fb;
+}
+
+void WDL_Resampler_FilterBank::Release(WDL_Resampler_FilterBank *fb)
+{
+  if (!fb) return;
+  WDL_MutexLock lock(&s_filterbanks_mutex);
+  if (--fb->m_refcnt > 0) return;
+
+  // keep it around in case it is wanted again (voices restarting, pitch returning to a previous value)
+  s_filterbanks.Delete(s_filterbanks.Find(fb));
+  s_filterbanks.Add(fb);
+
+  int x, unused=0;
+  for (x = s_filterbanks.GetSize()-1; x >= 0; x --)
+  {
+    WDL_Resampler_FilterBank *p=s_filterbanks.Get(x);
+    if (p->m_refcnt < 1 && ++unused > WDL_RESAMPLE_FILTERBANK_CACHE)
+    {
+      s_filterbanks.Delete(x);
+      delete p;
+    }
+  }
+}
+
+int WDL_Resampler_FilterBank::GetCacheSize()
+{
+  WDL_MutexLock lock(&s_filterbanks_mutex);
+  return s_filterbanks.GetSize();
+}
+
+
 WDL_Resampler::WDL_Resampler()
 {
   m_filterq=0.707f;
@@ -201,15 +522,21 @@ WDL_Resampler::WDL_Resampler()
   m_sratein=44100.0; 
   m_srateout=44100.0; 
   m_ratio=1.0; 
+  m_ratio_num=m_ratio_den=1;
+  m_filterbank=m_ratiobank=NULL;
   m_filter_ratio=-1.0; 
   m_iirfilter=0;
 
+  if (!s_sincdot) s_sincdot=WDL_Resampler_GetSincDot();
+
   Reset(); 
 }
 
 WDL_Resampler::~WDL_Resampler()
 {
   delete m_iirfilter;
+  WDL_Resampler_FilterBank::Release(m_filterbank);
+  WDL_Resampler_FilterBank::Release(m_ratiobank);
 }
 
 void WDL_Resampler::Reset(double fracpos)
@@ -234,7 +561,10 @@ void WDL_Resampler::SetMode(bool interp, int filtercnt, bool sinc, int sinc_size
 
   if (!m_sincsize) 
   {
-    m_filter_coeffs.Resize(0);
+    WDL_Resampler_FilterBank::Release(m_filterbank);
+    WDL_Resampler_FilterBank::Release(m_ratiobank);
+    m_filterbank=m_ratiobank=NULL;
+    m_filter_phase.Resize(0);
     m_filter_coeffs_size=0;
   }
   if (!m_filtercnt) 
@@ -253,6 +583,20 @@ void WDL_Resampler::SetRates(double rate_in, double rate_out)
     m_sratein=rate_in; 
     m_srateout=rate_out;  
     m_ratio=m_sratein / m_srateout;
+
+    m_ratio_num=m_ratio_den=0;
+    if (m_sratein == floor(m_sratein) && m_srateout == floor(m_srateout) && 
+        m_sratein < 2147483647.0 && m_srateout < 2147483647.0)
+    {
+      const int in=(int)m_sratein, out=(int)m_srateout;
+      int a=in, b=out;
+      while (b) { const int t=a%b; a=b; b=t; } // gcd
+      if (out/a <= WDL_RESAMPLE_MAX_RATIO_DEN)
+      {
+        m_ratio_num=in/a;
+        m_ratio_den=out/a;
+      }
+    }
   }
 }
 
@@ -269,60 +613,30 @@ void WDL_Resampler::BuildLowPass(double filtpos) // only called in sinc modes
     m_lp_oversize = wantinterp;
     m_filter_ratio=filtpos;
 
-    // build lowpass filter
-    const int allocsize = wantsize*(m_lp_oversize+1);
-    WDL_SincFilterSample *cfout=m_filter_coeffs.Resize(allocsize);
-    if (m_filter_coeffs.GetSize()==allocsize)
-    {
-      m_filter_coeffs_size=wantsize;
-
-      const double dwindowpos = 2.0 * PI/(double)wantsize;
-      const double dsincpos  = PI * filtpos; // filtpos is outrate/inrate, i.e. 0.5 is going to half rate
-      const int hwantsize=wantsize/2;
-
-      double filtpower=0.0;
-      WDL_SincFilterSample *ptrout = cfout;
-      int slice;
-      for (slice=0;slice<=wantinterp;slice++)
-      {
-        const double frac = slice / (double)wantinterp;
-        const int center_x = slice == 0 ? hwantsize : slice == wantinterp ? hwantsize-1 : -1;
-
-        int x;
-        for (x=0;x<wantsize;x++)
-        {          
-          if (x==center_x) 
-          {
-            // we know this will be 1.0
-            *ptrout++ = 1.0;
-          }
-          else
-          {
-            const double xfrac = frac + x;
-            const double windowpos = dwindowpos * xfrac;
-            const double sincpos = dsincpos * (xfrac - hwantsize);
-
-            // blackman-harris * sinc
-            const double val = (0.35875 - 0.48829 * cos(windowpos) + 0.14128 * cos(2*windowpos) - 0.01168 * cos(3*windowpos)) * sin(sincpos) / sincpos; 
-            if (slice<wantinterp) filtpower+=val;        
-            *ptrout++ = (WDL_SincFilterSample)val;
-          }
-
-        }
-      }
+    WDL_Resampler_FilterBank *fb=WDL_Resampler_FilterBank::Get(wantsize,wantinterp,filtpos,0);
+    WDL_Resampler_FilterBank::Release(m_filterbank);
+    WDL_Resampler_FilterBank::Release(m_ratiobank);
+    m_filterbank=fb;
+    m_ratiobank=NULL;
 
-      filtpower = wantinterp/(filtpower+1.0);
-      int x;
-      for (x = 0; x < allocsize; x ++) 
-      {
-        cfout[x] = (WDL_SincFilterSample) (cfout[x]*filtpower);
-      }
-    }
-    else m_filter_coeffs_size=0;
+    m_filter_phase.Resize(wantsize);
+    m_filter_coeffs_size = fb && m_filter_phase.GetSize()==wantsize ? wantsize : 0;
 
   }
 }
 
+bool WDL_Resampler::BuildRatioFilters(int filtsz)
+{
+  const int den=m_ratio_den;
+  if (m_ratiobank && m_ratiobank->m_den == den) return true;
+  if (!m_filterbank || den*filtsz > (1<<18)) return false; // too large, use the arbitrary-ratio path
+
+  WDL_Resampler_FilterBank *fb=WDL_Resampler_FilterBank::Get(filtsz,m_lp_oversize,m_filter_ratio,den);
+  WDL_Resampler_FilterBank::Release(m_ratiobank);
+  m_ratiobank=fb;
+  return fb != NULL;
+}
+
 double WDL_Resampler::GetCurrentLatency() 
 { 
   double v=((double)m_samples_in_rsinbuf-m_filtlatency)/m_sratein;
@@ -333,6 +647,24 @@ double WDL_Resampler::GetCurrentLatency()
 
 int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample **inbuffer) 
 {   
+  return PrepareInput(m_ratio * out_samples, out_samples, nch, inbuffer);
+}
+
+int WDL_Resampler::ResamplePrepareVarying(int out_samples, int nch, WDL_ResampleSample **inbuffer, const double *ratios, int ratio_step)
+{
+  double adv=0.0;
+  int x;
+  if (ratio_step<1) ratio_step=1;
+  for (x = 0; x < out_samples; x += ratio_step)
+  {
+    adv += wdl_max(ratios[x/ratio_step],0.0) * wdl_min(ratio_step,out_samples-x);
+  }
+  return PrepareInput(adv, out_samples, nch, inbuffer);
+}
+
+// in_needed: input samples consumed by out_samples of output (not used in feed mode)
+int WDL_Resampler::PrepareInput(double in_needed, int out_samples, int nch, WDL_ResampleSample **inbuffer)
+{
   if (nch > WDL_RESAMPLE_MAX_NCH || nch < 1) return 0;
 
   int fsize=0;
@@ -354,7 +686,7 @@ int WDL_Resampler::ResamplePrepare(int out_samples, int nch, WDL_ResampleSample
 
   int sreq = 0;
     
-  if (!m_feedmode) sreq = (int)(m_ratio * out_samples) + 4 + fsize - m_samples_in_rsinbuf;
+  if (!m_feedmode) sreq = (int)in_needed + 4 + fsize - m_samples_in_rsinbuf;
   else sreq = out_samples;
 
   if (sreq<0)sreq=0;
@@ -383,17 +715,43 @@ again:
 
 
 int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch)
+{
+  return ResampleOutInt(out, nsamples_in, nsamples_out, nch, NULL, 1);
+}
+
+int WDL_Resampler::ResampleOutVarying(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch, const double *ratios, int ratio_step)
+{
+  return ResampleOutInt(out, nsamples_in, nsamples_out, nch, ratios, ratio_step<1 ? 1 : ratio_step);
+}
+
+// ratios: if non-NULL, output sample i advances by ratios[i/ratio_step] rather than m_ratio
+int WDL_Resampler::ResampleOutInt(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch, const double *ratios, int ratio_step)
 {
   if (nch > WDL_RESAMPLE_MAX_NCH || nch < 1) return 0;
 
+  // range of ratios in this block, for the anti-aliasing filters
+  double ratio_lo=m_ratio, ratio_hi=m_ratio;
+  if (ratios && nsamples_out > 0)
+  {
+    int x;
+    ratio_lo=ratio_hi=wdl_max(ratios[0],0.0);
+    for (x = ratio_step; x < nsamples_out; x += ratio_step)
+    {
+      const double r=wdl_max(ratios[x/ratio_step],0.0);
+      if (r < ratio_lo) ratio_lo=r;
+      else if (r > ratio_hi) ratio_hi=r;
+    }
+    if (ratio_lo < 0.01) ratio_lo=0.01;
+  }
+
   if (m_filtercnt>0)
   {
-    if (m_ratio > 1.0 && nsamples_in > 0) // filter input
+    if (ratio_hi > 1.0 && nsamples_in > 0) // filter input
     {
       if (!m_iirfilter) m_iirfilter = new WDL_Resampler_IIRFilter;
 
       int n=m_filtercnt;
-      m_iirfilter->setParms((1.0/m_ratio)*m_filterpos,m_filterq);
+      m_iirfilter->setParms((1.0/ratio_hi)*m_filterpos,m_filterq);
 
       WDL_ResampleSample *buf=(WDL_ResampleSample *)m_rsinbuf.Get() + m_samples_in_rsinbuf*nch;
       int a,x;
@@ -435,15 +793,57 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
 
   if (m_sincsize) // sinc interpolating
   {
-    if (m_ratio > 1.0) BuildLowPass(1.0 / (m_ratio*1.03));
+    if (ratio_hi > 1.0) 
+    {
+      // a curve's sinc lowpass is rounded up to 1/8 octave steps, so a sweep reuses a few filter banks
+      const double lp_ratio = ratios ? pow(2.0,ceil(log(ratio_hi)/log(2.0)*8.0)/8.0) : ratio_hi;
+      BuildLowPass(1.0 / (lp_ratio*1.03));
+    }
     else BuildLowPass(1.0);
 
     int filtsz=m_filter_coeffs_size;
     int filtlen = rsinbuf_availtemp - filtsz;
     outlatadj=filtsz/2-1;
-    WDL_SincFilterSample *filter=m_filter_coeffs.Get();   
+    const WDL_SincFilterSample *filter=m_filterbank ? m_filterbank->m_coeffs.Get() : NULL;
+
+    const int den=ratios ? 0 : m_ratio_den;
+    const int phase0=(int)(srcpos*den+0.5);
+    if (ratios)
+    {
+      while (ns--)
+      {
+        int ipos = (int)srcpos;
+
+        if (ipos >= filtlen-1)  break; // quit decoding, not enough input samples
+
+        SincSample(outptr,localin + ipos*nch,srcpos-ipos,nch,filter,filtsz);
+        outptr += nch;
+        srcpos += wdl_max(ratios[ret/ratio_step],0.0);
+        ret++;
+      }
+    }
+    else if (den && fabs(srcpos*den-phase0) < 0.000001 && BuildRatioFilters(filtsz))
+    {
+      // rational ratio: integer position and phase, no accumulated rounding
+      const double *phasefilt=m_ratiobank->m_phases.Get();
+      const int istep=m_ratio_num/den, pstep=m_ratio_num%den;
+      int ipos=0, phase=phase0;
+      if (phase >= den) { phase-=den; ipos++; }
+
+      while (ns--)
+      {
+        if (ipos >= filtlen-1)  break; // quit decoding, not enough input samples
 
-    if (nch == 1)
+        s_sincdot(outptr,localin + ipos*nch,phasefilt + phase*filtsz,filtsz,nch,nch);
+        outptr += nch;
+        ipos+=istep;
+        phase+=pstep;
+        if (phase >= den) { phase-=den; ipos++; }
+        ret++;
+      }
+      srcpos = ipos + phase/(double)den;
+    }
+    else if (nch == 1)
     {
       while (ns--)
       {
@@ -488,7 +888,20 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
   }
   else if (!m_interp) // point sampling
   {
-    if (nch == 1)
+    if (ratios)
+    {
+      while (ns--)
+      {
+        int ipos = (int)srcpos;
+        if (ipos >= rsinbuf_availtemp)  break; // quit decoding, not enough input samples
+
+        memcpy(outptr,localin + ipos*nch,nch*sizeof(WDL_ResampleSample));
+        outptr += nch;
+        srcpos += wdl_max(ratios[ret/ratio_step],0.0);
+        ret++;
+      }
+    }
+    else if (nch == 1)
     {
       while (ns--)
       {
@@ -530,7 +943,31 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
   }
   else // linear interpolation
   {
-    if (nch == 1)
+    if (ratios)
+    {
+      while (ns--)
+      {
+        int ipos = (int)srcpos;
+        double fracpos=srcpos-ipos; 
+
+        if (ipos >= rsinbuf_availtemp-1) 
+        {
+          break; // quit decoding, not enough input samples
+        }
+
+        double ifracpos=1.0-fracpos;
+        int ch=nch;
+        WDL_ResampleSample *inptr = localin + ipos*nch;
+        while (ch--)
+        {
+          *outptr++ = inptr[0]*(ifracpos) + inptr[nch]*(fracpos);
+          inptr++;
+        }
+        srcpos += wdl_max(ratios[ret/ratio_step],0.0);
+        ret++;
+      }
+    }
+    else if (nch == 1)
     {
       while (ns--)
       {
@@ -599,11 +1036,11 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
 
   if (m_filtercnt>0)
   {
-    if (m_ratio < 1.0 && ret>0) // filter output
+    if (ratio_lo < 1.0 && ret>0) // filter output
     {
       if (!m_iirfilter) m_iirfilter = new WDL_Resampler_IIRFilter;
       int n=m_filtercnt;
-      m_iirfilter->setParms(m_ratio*m_filterpos,m_filterq);
+      m_iirfilter->setParms(ratio_lo*m_filterpos,m_filterq);
 
       int x,a;
       int offs=0;
@@ -615,6 +1052,8 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
 
   
 
+  if (ratios) drspos = ret>0 ? wdl_max(ratios[(ret-1)/ratio_step],0.01) : 1.0;
+
   if (ret>0 && rsinbuf_availtemp>m_samples_in_rsinbuf) // we had to pad!!
   {
     // check for the case where rsinbuf_availtemp>m_samples_in_rsinbuf, decrease ret down to actual valid samples
@@ -53,6 +53,40 @@ typedef double WDL_ResampleSample;
 #define WDL_RESAMPLE_MAX_NCH 64
 #endif
 
+// in sinc mode, integer rates with rate_in/rate_out == n/d, d <= this, step through a table of d filter phases
+#ifndef WDL_RESAMPLE_MAX_RATIO_DEN
+#define WDL_RESAMPLE_MAX_RATIO_DEN 1024
+#endif
+
+// number of filter banks kept cached after their last resampler lets go of them
+#ifndef WDL_RESAMPLE_FILTERBANK_CACHE
+#define WDL_RESAMPLE_FILTERBANK_CACHE 16
+#endif
+
+
+// windowed-sinc filter tables. Read-only once built, and shared by all resamplers which use
+// the same sinc size, oversampling and cutoff (and for the phase tables, ratio denominator).
+class WDL_Resampler_FilterBank
+{
+public:
+  WDL_TypedBuf<WDL_SincFilterSample> m_coeffs; // if !m_den: (m_oversize+1) filters of m_size, by fractional position
+  WDL_TypedBuf<double> m_phases; // if m_den: m_den filters of m_size, for positions 0/m_den..(m_den-1)/m_den
+
+  // cache key
+  double m_filtpos;
+  int m_size, m_oversize, m_den;
+
+  // Get() builds the bank if not cached (NULL if out of memory), and adds a reference which must be released with Release()
+  static WDL_Resampler_FilterBank *Get(int size, int oversize, double filtpos, int den);
+  static void Release(WDL_Resampler_FilterBank *fb);
+
+  static int GetCacheSize(); // number of distinct banks currently held
+
+private:
+  bool Build();
+  int m_refcnt;
+};
+
 
 class WDL_Resampler
 {
@@ -66,7 +100,7 @@ public:
   void SetFeedMode(bool wantInputDriven) { m_feedmode=wantInputDriven; } // if true, that means the first parameter to ResamplePrepare will specify however much input you have, not how much you want
 
   void Reset(double fracpos=0.0);
-  void SetRates(double rate_in, double rate_out);
+  void SetRates(double rate_in, double rate_out); // integer rates with a small ratio (e.g. 44100->48000 = 147/160) use exact phase stepping in sinc mode
 
   double GetCurrentLatency(); // amount of input that has been received but not yet converted to output, in seconds
 
@@ -82,9 +116,20 @@ public:
   int ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch);
 
 
+  // time-varying ratio (vibrato, tape stop, doppler etc): use these in place of ResamplePrepare()/ResampleOut(), 
+  // passing the same curve to both. output sample i advances the input by ratios[i/ratio_step] input samples 
+  // (rate_in/rate_out, 0 or more), so ratios needs (nsamples_out+ratio_step-1)/ratio_step entries. 
+  // the anti-aliasing filters follow the largest/smallest ratio in each block. not for input-driven mode.
+  int ResamplePrepareVarying(int out_samples, int nch, WDL_ResampleSample **inbuffer, const double *ratios, int ratio_step=1);
+  int ResampleOutVarying(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch, const double *ratios, int ratio_step=1);
+
+
 
 private:
+  int PrepareInput(double in_needed, int out_samples, int nch, WDL_ResampleSample **inbuffer);
+  int ResampleOutInt(WDL_ResampleSample *out, int nsamples_in, int nsamples_out, int nch, const double *ratios, int ratio_step);
   void BuildLowPass(double filtpos);
+  bool BuildRatioFilters(int filtsz);
   void inline SincSample(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, int nch, const WDL_SincFilterSample *filter, int filtsz);
   void inline SincSample1(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz);
   void inline SincSample2(WDL_ResampleSample *outptr, const WDL_ResampleSample *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz);
@@ -96,7 +141,9 @@ private:
   double m_filter_ratio;
   float m_filterq, m_filterpos;
   WDL_TypedBuf<WDL_ResampleSample> m_rsinbuf;
-  WDL_TypedBuf<WDL_SincFilterSample> m_filter_coeffs;
+  WDL_Resampler_FilterBank *m_filterbank;
+  WDL_Resampler_FilterBank *m_ratiobank; // phases for m_ratio_den, if in use
+  WDL_TypedBuf<double> m_filter_phase; // for nch>2, the filter for the current output sample
 
   class WDL_Resampler_IIRFilter;
   WDL_Resampler_IIRFilter *m_iirfilter;
@@ -106,6 +153,7 @@ private:
   int m_filtlatency;
   int m_samples_in_rsinbuf;
   int m_lp_oversize;
+  int m_ratio_num, m_ratio_den; // m_ratio == m_ratio_num/m_ratio_den, or 0 if not a small rational
 
   int m_sincsize;
   int m_filtercnt;
@@ -1,6 +1,22 @@
 #ifndef _WDL_SINEWAVEGEN_H_
 #define _WDL_SINEWAVEGEN_H_
 
+#include <math.h>
+#include <string.h>
+#include "heapbuf.h"
+
+// WDL_SineWaveBank runs its partials in SIMD vectors (AVX, SSE2 or NEON).
+// Define WDL_SINEWAVEGEN_NO_SIMD to disable.
+#if !defined(WDL_SINEWAVEGEN_NO_SIMD) && defined(__AVX__)
+  #define WDL_SINEBANK_AVX
+  #include <immintrin.h>
+#elif !defined(WDL_SINEWAVEGEN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define WDL_SINEBANK_SSE2
+  #include <emmintrin.h>
+#elif !defined(WDL_SINEWAVEGEN_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+  #define WDL_SINEBANK_NEON
+  #include <arm_neon.h>
+#endif
 
 // note: calling new WDL_SineWaveGenerator isnt strictly necessary, you can also do WDL_SineWaveGenerator *gens = (WDL_SineWaveGenerator *)malloc(512*sizeof(WDL_SineWaveGenerator));
 // as long as you call Reset() and SetFreq() it should be fine.
@@ -56,4 +72,264 @@ public:
 
 };
 
+
+// WDL_SineWaveBank: many sine oscillators, summed. Each partial is a unit
+// phasor rotated by a step phasor every sample, and the partials are stored
+// structure-of-arrays so a vector of them advances per instruction.
+// SetTarget() glides frequency and amplitude linearly over the next Gen()
+// (the step phasor is itself rotated each sample). Phasors are renormalized
+// every WDL_SINEBANK_RENORM samples, so the amplitude doesn't drift.
+
+#if defined(WDL_SINEBANK_AVX)
+  #define WDL_SINEBANK_W 4
+  #define WDL_SINEBANK_VEC __m256d
+  #define WDL_SINEBANK_ZERO() _mm256_setzero_pd()
+  #define WDL_SINEBANK_SPLAT(x) _mm256_set1_pd(x)
+  #define WDL_SINEBANK_LOAD(p) _mm256_loadu_pd(p)
+  #define WDL_SINEBANK_STORE(p,v) _mm256_storeu_pd(p,v)
+  #define WDL_SINEBANK_ADD(a,b) _mm256_add_pd(a,b)
+  #define WDL_SINEBANK_SUB(a,b) _mm256_sub_pd(a,b)
+  #define WDL_SINEBANK_MUL(a,b) _mm256_mul_pd(a,b)
+#elif defined(WDL_SINEBANK_SSE2)
+  #define WDL_SINEBANK_W 2
+  #define WDL_SINEBANK_VEC __m128d
+  #define WDL_SINEBANK_ZERO() _mm_setzero_pd()
+  #define WDL_SINEBANK_SPLAT(x) _mm_set1_pd(x)
+  #define WDL_SINEBANK_LOAD(p) _mm_loadu_pd(p)
+  #define WDL_SINEBANK_STORE(p,v) _mm_storeu_pd(p,v)
+  #define WDL_SINEBANK_ADD(a,b) _mm_add_pd(a,b)
+  #define WDL_SINEBANK_SUB(a,b) _mm_sub_pd(a,b)
+  #define WDL_SINEBANK_MUL(a,b) _mm_mul_pd(a,b)
+#elif defined(WDL_SINEBANK_NEON)
+  #define WDL_SINEBANK_W 2
+  #define WDL_SINEBANK_VEC float64x2_t
+  #define WDL_SINEBANK_ZERO() vdupq_n_f64(0.0)
+  #define WDL_SINEBANK_SPLAT(x) vdupq_n_f64(x)
+  #define WDL_SINEBANK_LOAD(p) vld1q_f64(p)
+  #define WDL_SINEBANK_STORE(p,v) vst1q_f64(p,v)
+  #define WDL_SINEBANK_ADD(a,b) vaddq_f64(a,b)
+  #define WDL_SINEBANK_SUB(a,b) vsubq_f64(a,b)
+  #define WDL_SINEBANK_MUL(a,b) vmulq_f64(a,b)
+#else
+  #define WDL_SINEBANK_W 1
+  #define WDL_SINEBANK_VEC double
+  #define WDL_SINEBANK_ZERO() 0.0
+  #define WDL_SINEBANK_SPLAT(x) (x)
+  #define WDL_SINEBANK_LOAD(p) (*(p))
+  #define WDL_SINEBANK_STORE(p,v) (*(p)=(v))
+  #define WDL_SINEBANK_ADD(a,b) ((a)+(b))
+  #define WDL_SINEBANK_SUB(a,b) ((a)-(b))
+  #define WDL_SINEBANK_MUL(a,b) ((a)*(b))
+#endif
+
+#ifndef WDL_SINEBANK_RENORM
+#define WDL_SINEBANK_RENORM 256 // samples between renormalizations, also Gen()'s internal block size
+#endif
+
+class WDL_SineWaveBank
+{
+public:
+  WDL_SineWaveBank() { m_n=0; m_ramping=false; }
+  ~WDL_SineWaveBank() { }
+
+  void SetNumPartials(int n) // existing partials are kept, new ones are silent
+  {
+    if (n < 0) n=0;
+    const int oldsz=m_state.GetSize(), sz=(n+WDL_SINEBANK_W-1)/WDL_SINEBANK_W * WDL_SINEBANK_W*NFIELDS;
+    double *st=m_state.Resize(sz);
+    m_params.Resize(n*NPARAMS);
+    if (m_state.GetSize() != sz || m_params.GetSize() != n*NPARAMS) { m_n=0; return; }
+
+    const int oldn=m_n;
+    m_n=n;
+    int x;
+    for (x = oldsz; x < sz; x ++) st[x]=0.0;
+    for (x = oldn; x < n; x ++) SetPartial(x,0.0,0.0);
+    // padding past n must stay silent
+    for (x = n; x < sz/NFIELDS; x ++) *Field(x,AMP)=*Field(x,DAMP)=0.0;
+  }
+  int GetNumPartials() const { return m_n; }
+
+  void Reset() // silences all partials
+  {
+    int x;
+    for (x = 0; x < m_n; x ++) SetPartial(x,0.0,0.0);
+    m_ramping=false;
+  }
+
+  // freq is frequency/(samplerate*0.5), as WDL_SineWaveGenerator::SetFreq().
+  // phase is in radians, 0 starts the sine at 0. takes effect immediately
+  void SetPartial(int idx, double freq, double amp, double phase=0.0)
+  {
+    if (idx < 0 || idx >= m_n) return;
+    const double w=freq*3.1415926535897932384626433832795;
+    *Field(idx,RE)=cos(phase);
+    *Field(idx,IM)=sin(phase);
+    *Field(idx,SRE)=cos(w);
+    *Field(idx,SIM)=sin(w);
+    *Field(idx,DRE)=1.0;
+    *Field(idx,DIM)=0.0;
+    *Field(idx,AMP)=amp;
+    *Field(idx,DAMP)=0.0;
+    double *p=m_params.Get()+idx*NPARAMS;
+    p[P_W]=p[P_TW]=w;
+    p[P_AMP]=p[P_TAMP]=amp;
+  }
+
+  // glide to freq and amp over the next Gen() call
+  void SetTarget(int idx, double freq, double amp)
+  {
+    if (idx < 0 || idx >= m_n) return;
+    double *p=m_params.Get()+idx*NPARAMS;
+    p[P_TW]=freq*3.1415926535897932384626433832795;
+    p[P_TAMP]=amp;
+    m_ramping=true;
+  }
+
+  double GetFreq(int idx) const { return idx >= 0 && idx < m_n ? m_params.Get()[idx*NPARAMS+P_W] / 3.1415926535897932384626433832795 : 0.0; }
+  double GetAmp(int idx) const { return idx >= 0 && idx < m_n ? m_params.Get()[idx*NPARAMS+P_AMP] : 0.0; }
+
+  void Gen(double *out, int length, bool addToOutput=false) // writes (or adds) the sum of all partials
+  {
+    if (length < 1) return;
+    const int nvec=(m_n+WDL_SINEBANK_W-1)/WDL_SINEBANK_W;
+    double *st=m_state.Get();
+    const bool ramp=m_ramping;
+    int x;
+
+    if (ramp)
+    {
+      const double *p=m_params.Get();
+      const double il=1.0/length;
+      for (x = 0; x < m_n; x ++, p+=NPARAMS)
+      {
+        const double dw=(p[P_TW]-p[P_W])*il;
+        *Field(x,DRE)=cos(dw);
+        *Field(x,DIM)=sin(dw);
+        *Field(x,DAMP)=(p[P_TAMP]-p[P_AMP])*il;
+      }
+    }
+
+    double acc[WDL_SINEBANK_RENORM*WDL_SINEBANK_W];
+    while (length > 0)
+    {
+      const int len=wdl_min(length,WDL_SINEBANK_RENORM);
+      memset(acc,0,len*WDL_SINEBANK_W*sizeof(double));
+
+      int v=0;
+      if (ramp)
+      {
+        for (; v+4 <= nvec; v+=4) GenVecs<4,true>(st+v*WDL_SINEBANK_W*NFIELDS,acc,len);
+        for (; v < nvec; v ++) GenVecs<1,true>(st+v*WDL_SINEBANK_W*NFIELDS,acc,len);
+      }
+      else
+      {
+        for (; v+4 <= nvec; v+=4) GenVecs<4,false>(st+v*WDL_SINEBANK_W*NFIELDS,acc,len);
+        for (; v < nvec; v ++) GenVecs<1,false>(st+v*WDL_SINEBANK_W*NFIELDS,acc,len);
+      }
+
+      for (x = 0; x < len; x ++)
+      {
+        double s=acc[x*WDL_SINEBANK_W];
+        int l;
+        for (l = 1; l < WDL_SINEBANK_W; l ++) s+=acc[x*WDL_SINEBANK_W+l];
+        if (addToOutput) out[x]+=s;
+        else out[x]=s;
+      }
+      out+=len;
+      length-=len;
+    }
+
+    if (ramp)
+    {
+      // land exactly on the targets
+      double *p=m_params.Get();
+      for (x = 0; x < m_n; x ++, p+=NPARAMS)
+      {
+        p[P_W]=p[P_TW];
+        p[P_AMP]=p[P_TAMP];
+        *Field(x,SRE)=cos(p[P_W]);
+        *Field(x,SIM)=sin(p[P_W]);
+        *Field(x,DRE)=1.0;
+        *Field(x,DIM)=0.0;
+        *Field(x,AMP)=p[P_AMP];
+        *Field(x,DAMP)=0.0;
+      }
+      m_ramping=false;
+    }
+  }
+
+private:
+  // m_state is, per vector of WDL_SINEBANK_W partials, each field's WDL_SINEBANK_W values
+  enum { RE, IM, SRE, SIM, DRE, DIM, AMP, DAMP, NFIELDS };
+  // m_params is, per partial, current and target frequency (radians/sample) and amplitude
+  enum { P_W, P_TW, P_AMP, P_TAMP, NPARAMS };
+
+  double *Field(int idx, int f) { return m_state.Get() + (idx/WDL_SINEBANK_W)*WDL_SINEBANK_W*NFIELDS + f*WDL_SINEBANK_W + idx%WDL_SINEBANK_W; }
+
+  // K vectors at a time, to have independent recurrences in flight
+  template<int K, bool RAMP> static void GenVecs(double *st, double *acc, int len)
+  {
+    WDL_SINEBANK_VEC re[K], im[K], sre[K], sim[K], dre[K], dim[K], amp[K], damp[K];
+    const int stride=WDL_SINEBANK_W*NFIELDS;
+    int v, x;
+    for (v = 0; v < K; v ++)
+    {
+      const double *p=st+v*stride;
+      re[v]=WDL_SINEBANK_LOAD(p+RE*WDL_SINEBANK_W);
+      im[v]=WDL_SINEBANK_LOAD(p+IM*WDL_SINEBANK_W);
+      sre[v]=WDL_SINEBANK_LOAD(p+SRE*WDL_SINEBANK_W);
+      sim[v]=WDL_SINEBANK_LOAD(p+SIM*WDL_SINEBANK_W);
+      amp[v]=WDL_SINEBANK_LOAD(p+AMP*WDL_SINEBANK_W);
+      if (RAMP)
+      {
+        dre[v]=WDL_SINEBANK_LOAD(p+DRE*WDL_SINEBANK_W);
+        dim[v]=WDL_SINEBANK_LOAD(p+DIM*WDL_SINEBANK_W);
+        damp[v]=WDL_SINEBANK_LOAD(p+DAMP*WDL_SINEBANK_W);
+      }
+    }
+
+    for (x = 0; x < len; x ++)
+    {
+      WDL_SINEBANK_VEC sum=WDL_SINEBANK_LOAD(acc+x*WDL_SINEBANK_W);
+      for (v = 0; v < K; v ++)
+      {
+        sum=WDL_SINEBANK_ADD(sum,WDL_SINEBANK_MUL(im[v],amp[v]));
+        const WDL_SINEBANK_VEC t=WDL_SINEBANK_SUB(WDL_SINEBANK_MUL(re[v],sre[v]),WDL_SINEBANK_MUL(im[v],sim[v]));
+        im[v]=WDL_SINEBANK_ADD(WDL_SINEBANK_MUL(re[v],sim[v]),WDL_SINEBANK_MUL(im[v],sre[v]));
+        re[v]=t;
+        if (RAMP)
+        {
+          const WDL_SINEBANK_VEC ts=WDL_SINEBANK_SUB(WDL_SINEBANK_MUL(sre[v],dre[v]),WDL_SINEBANK_MUL(sim[v],dim[v]));
+          sim[v]=WDL_SINEBANK_ADD(WDL_SINEBANK_MUL(sre[v],dim[v]),WDL_SINEBANK_MUL(sim[v],dre[v]));
+          sre[v]=ts;
+          amp[v]=WDL_SINEBANK_ADD(amp[v],damp[v]);
+        }
+      }
+      WDL_SINEBANK_STORE(acc+x*WDL_SINEBANK_W,sum);
+    }
+
+    // one Newton step of 1/sqrt(|z|^2) pulls the phasors back to unit length
+    const WDL_SINEBANK_VEC c15=WDL_SINEBANK_SPLAT(1.5), c05=WDL_SINEBANK_SPLAT(0.5);
+    for (v = 0; v < K; v ++)
+    {
+      double *p=st+v*stride;
+      WDL_SINEBANK_VEC g=WDL_SINEBANK_SUB(c15,WDL_SINEBANK_MUL(c05,WDL_SINEBANK_ADD(WDL_SINEBANK_MUL(re[v],re[v]),WDL_SINEBANK_MUL(im[v],im[v]))));
+      WDL_SINEBANK_STORE(p+RE*WDL_SINEBANK_W,WDL_SINEBANK_MUL(re[v],g));
+      WDL_SINEBANK_STORE(p+IM*WDL_SINEBANK_W,WDL_SINEBANK_MUL(im[v],g));
+      if (RAMP)
+      {
+        g=WDL_SINEBANK_SUB(c15,WDL_SINEBANK_MUL(c05,WDL_SINEBANK_ADD(WDL_SINEBANK_MUL(sre[v],sre[v]),WDL_SINEBANK_MUL(sim[v],sim[v]))));
+        WDL_SINEBANK_STORE(p+SRE*WDL_SINEBANK_W,WDL_SINEBANK_MUL(sre[v],g));
+        WDL_SINEBANK_STORE(p+SIM*WDL_SINEBANK_W,WDL_SINEBANK_MUL(sim[v],g));
+        WDL_SINEBANK_STORE(p+AMP*WDL_SINEBANK_W,amp[v]);
+      }
+    }
+  }
+
+  WDL_TypedBuf<double> m_state, m_params;
+  int m_n;
+  bool m_ramping;
+};
+
 #endif
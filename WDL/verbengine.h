@@ -31,11 +31,22 @@
 */
 
 
+#include <math.h>
 #include "heapbuf.h"
 
 
 #include "denormal.h"
 
+// WDL_ReverbEngineMulti runs its combs in pairs in SSE2/NEON vectors. Define
+// WDL_VERB_NO_SIMD to disable.
+#if !defined(WDL_VERB_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define WDL_VERB_SSE2
+  #include <emmintrin.h>
+#elif !defined(WDL_VERB_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+  #define WDL_VERB_NEON
+  #include <arm_neon.h>
+#endif
+
 class WDL_ReverbAllpass
 {
 public:
@@ -295,4 +306,324 @@ private:
 };
 
 
-#endif
\ No newline at end of file
+
+/*
+  WDL_ReverbEngineMulti<T>: the same reverb for any number of channels, each
+  with its own comb/allpass lengths (spread by wdl_verb__stereospread per
+  channel, so 2 channels sound like WDL_ReverbEngine). T is the delay memory
+  type: float halves memory use and traffic, processing is always double.
+
+  All delay lines of an instance are in one allocation, and are processed in
+  runs up to the next wraparound: the combs of a channel in one loop, two per
+  SIMD vector, then each allpass over the whole run.
+
+    WDL_ReverbEngineMulti<float> verb;
+    verb.SetNumChannels(6);
+    verb.SetSampleRate(48000.0);
+    verb.SetRoomSize(0.8);
+    verb.Reset(true);
+    verb.ProcessSampleBlock(inputs, outputs, nframes); // in-place is OK
+*/
+
+#define WDL_VERB_NCOMBS ((int) (sizeof(wdl_verb__combtunings)/sizeof(wdl_verb__combtunings[0])))
+#define WDL_VERB_NALLPASSES ((int) (sizeof(wdl_verb__allpasstunings)/sizeof(wdl_verb__allpasstunings[0])))
+#define WDL_VERB_NLINES (WDL_VERB_NCOMBS+WDL_VERB_NALLPASSES) // delay lines per channel
+#define WDL_VERB_FLUSH 1.0e-30 // state below this is zeroed, long before it could be denormal (in float or double)
+
+typedef char wdl_verb__combpairs_check[WDL_VERB_NCOMBS==10 ? 1 : -1]; // ProcessCombs() has the SIMD comb pairs written out
+
+#if defined(WDL_VERB_SSE2)
+  #define WDL_VERB_VEC __m128d
+  #define WDL_VERB_ZERO() _mm_setzero_pd()
+  #define WDL_VERB_SPLAT(x) _mm_set1_pd(x)
+  #define WDL_VERB_SET(a,b) _mm_set_pd(b,a)
+  #define WDL_VERB_GET(v,i) (i ? _mm_cvtsd_f64(_mm_unpackhi_pd(v,v)) : _mm_cvtsd_f64(v))
+  #define WDL_VERB_LOAD(p) _mm_loadu_pd(p)
+  #define WDL_VERB_STORE(p,v) _mm_storeu_pd(p,v)
+  #define WDL_VERB_ADD(a,b) _mm_add_pd(a,b)
+  #define WDL_VERB_SUB(a,b) _mm_sub_pd(a,b)
+  #define WDL_VERB_MUL(a,b) _mm_mul_pd(a,b)
+  #define WDL_VERB_FLUSHV(v,thr) _mm_and_pd(v,_mm_cmpge_pd(_mm_andnot_pd(_mm_set1_pd(-0.0),v),thr))
+  static inline __m128d wdl_verb_load2(const double *a, const double *b) { return _mm_loadh_pd(_mm_load_sd(a),b); }
+  static inline __m128d wdl_verb_load2(const float *a, const float *b) { return _mm_cvtps_pd(_mm_unpacklo_ps(_mm_load_ss(a),_mm_load_ss(b))); }
+  static inline void wdl_verb_store2(double *a, double *b, __m128d v) { _mm_storel_pd(a,v); _mm_storeh_pd(b,v); }
+  static inline void wdl_verb_store2(float *a, float *b, __m128d v) { const __m128 f=_mm_cvtpd_ps(v); _mm_store_ss(a,f); _mm_store_ss(b,_mm_shuffle_ps(f,f,1)); }
+  static inline __m128d wdl_verb_load2(const double *a) { return _mm_loadu_pd(a); }
+  static inline __m128d wdl_verb_load2(const float *a) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)a))); }
+  static inline void wdl_verb_store2(double *a, __m128d v) { _mm_storeu_pd(a,v); }
+  static inline void wdl_verb_store2(float *a, __m128d v) { _mm_storel_epi64((__m128i *)a,_mm_castps_si128(_mm_cvtpd_ps(v))); }
+#elif defined(WDL_VERB_NEON)
+  #define WDL_VERB_VEC float64x2_t
+  #define WDL_VERB_ZERO() vdupq_n_f64(0.0)
+  #define WDL_VERB_SPLAT(x) vdupq_n_f64(x)
+  #define WDL_VERB_SET(a,b) vcombine_f64(vdup_n_f64(a),vdup_n_f64(b))
+  #define WDL_VERB_GET(v,i) (i ? vgetq_lane_f64(v,1) : vgetq_lane_f64(v,0))
+  #define WDL_VERB_LOAD(p) vld1q_f64(p)
+  #define WDL_VERB_STORE(p,v) vst1q_f64(p,v)
+  #define WDL_VERB_ADD(a,b) vaddq_f64(a,b)
+  #define WDL_VERB_SUB(a,b) vsubq_f64(a,b)
+  #define WDL_VERB_MUL(a,b) vmulq_f64(a,b)
+  #define WDL_VERB_FLUSHV(v,thr) vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(v),vcageq_f64(v,thr)))
+  static inline float64x2_t wdl_verb_load2(const double *a, const double *b) { return vcombine_f64(vld1_f64(a),vld1_f64(b)); }
+  static inline float64x2_t wdl_verb_load2(const float *a, const float *b) { return vcvt_f64_f32(vset_lane_f32(*b,vdup_n_f32(*a),1)); }
+  static inline void wdl_verb_store2(double *a, double *b, float64x2_t v) { vst1q_lane_f64(a,v,0); vst1q_lane_f64(b,v,1); }
+  static inline void wdl_verb_store2(float *a, float *b, float64x2_t v) { const float32x2_t f=vcvt_f32_f64(v); vst1_lane_f32(a,f,0); vst1_lane_f32(b,f,1); }
+  static inline float64x2_t wdl_verb_load2(const double *a) { return vld1q_f64(a); }
+  static inline float64x2_t wdl_verb_load2(const float *a) { return vcvt_f64_f32(vld1_f32(a)); }
+  static inline void wdl_verb_store2(double *a, float64x2_t v) { vst1q_f64(a,v); }
+  static inline void wdl_verb_store2(float *a, float64x2_t v) { vst1_f32(a,vcvt_f32_f64(v)); }
+#endif
+
+template<class T> class WDL_ReverbEngineMulti
+{
+public:
+  WDL_ReverbEngineMulti()
+  {
+    m_srate=44100.0;
+    m_roomsize=0.5;
+    m_damp=0.5;
+    m_nch=0;
+    SetWidth(1.0);
+    SetNumChannels(2);
+  }
+  ~WDL_ReverbEngineMulti()
+  {
+  }
+
+  void SetNumChannels(int nch)
+  {
+    if (nch<1) nch=1;
+    if (m_nch!=nch)
+    {
+      m_nch=nch;
+      Reset(true);
+    }
+  }
+  int GetNumChannels() const { return m_nch; }
+
+  void SetSampleRate(double srate)
+  {
+    if (m_srate!=srate)
+    {
+      m_srate=srate;
+      Reset(true);
+    }
+  }
+
+  // in[ch] and out[ch] for GetNumChannels() channels, out may be the same as in
+  void ProcessSampleBlock(double **in, double **out, int ns)
+  {
+    int ch, x, i;
+    if (ns<1) return;
+
+    for (ch = 0; ch < m_nch; ch ++)
+    {
+      ProcessCombs(ch,in[ch],out[ch],ns);
+      for (x = 0; x < WDL_VERB_NALLPASSES; x ++) ProcessAllpass(ch*WDL_VERB_NLINES+WDL_VERB_NCOMBS+x,out[ch],ns);
+    }
+
+    if (m_nch<2) return;
+
+    // width: each channel against the mean of the other channels (for 2
+    // channels, exactly as WDL_ReverbEngine)
+    const double m = m_wid<0 ? -m_wid : m_wid;
+    const double wown = m_wid<0 ? 1.0-m : m, woth = (m_wid<0 ? m : 1.0-m) / (m_nch-1);
+    for (i = 0; i < ns; i ++)
+    {
+      double sum=0.0;
+      for (ch = 0; ch < m_nch; ch ++) sum+=out[ch][i];
+      for (ch = 0; ch < m_nch; ch ++)
+      {
+        const double a=out[ch][i];
+        out[ch][i] = a*wown + (sum-a)*woth;
+      }
+    }
+  }
+
+  void Reset(bool doclear=false) // call this after changing roomsize or dampening
+  {
+    int ch, x;
+    const double sc=m_srate / 44100.0;
+    const int nlines=m_nch*WDL_VERB_NLINES;
+
+    bool changed=false;
+    if (m_size.GetSize()!=nlines)
+    {
+      m_size.Resize(nlines);
+      m_ofs.Resize(nlines);
+      m_pos.Resize(nlines);
+      m_filterstore.Resize(m_nch*WDL_VERB_NCOMBS);
+      changed=true;
+    }
+
+    int *size=m_size.Get(), *ofs=m_ofs.Get(), tot=0;
+    for (ch = 0; ch < m_nch; ch ++)
+    {
+      for (x = 0; x < WDL_VERB_NLINES; x ++)
+      {
+        const int tun = x < WDL_VERB_NCOMBS ? wdl_verb__combtunings[x] : wdl_verb__allpasstunings[x-WDL_VERB_NCOMBS];
+        int sz=(int) ((tun+ch*wdl_verb__stereospread) * sc);
+        if (sz<1) sz=1;
+        if (size[ch*WDL_VERB_NLINES+x]!=sz) { size[ch*WDL_VERB_NLINES+x]=sz; changed=true; }
+        ofs[ch*WDL_VERB_NLINES+x]=tot;
+        tot+=sz;
+      }
+    }
+
+    if (changed)
+    {
+      m_mem.Resize(tot,false);
+      doclear=true;
+    }
+
+    if (doclear)
+    {
+      memset(m_mem.Get(),0,m_mem.GetSize()*sizeof(T));
+      memset(m_pos.Get(),0,m_pos.GetSize()*sizeof(int));
+      memset(m_filterstore.Get(),0,m_filterstore.GetSize()*sizeof(double));
+    }
+  }
+
+  void SetRoomSize(double sz) { m_roomsize=sz; } // 0.3..0.99 or so
+  void SetDampening(double dmp) { m_damp=dmp; } // 0..1
+  void SetWidth(double wid)
+  {
+    if (wid<-1) wid=-1;
+    else if (wid>1) wid=1;
+    wid*=0.5;
+    if (wid>=0.0) wid+=0.5;
+    else wid-=0.5;
+    m_wid=wid;
+  } // -1..1
+
+private:
+  void ProcessCombs(int ch, const double *in, double *out, int ns)
+  {
+    const int *size=m_size.Get()+ch*WDL_VERB_NLINES, *ofs=m_ofs.Get()+ch*WDL_VERB_NLINES;
+    int *pos=m_pos.Get()+ch*WDL_VERB_NLINES;
+    double *fsp=m_filterstore.Get()+ch*WDL_VERB_NCOMBS;
+    const double damp=m_damp*0.4, damp1=1.0-damp, fb=m_roomsize;
+    T *p[WDL_VERB_NCOMBS];
+    double fsl[WDL_VERB_NCOMBS];
+    int x, i;
+
+    for (x = 0; x < WDL_VERB_NCOMBS; x ++) fsl[x]=fsp[x];
+
+#if defined(WDL_VERB_SSE2) || defined(WDL_VERB_NEON)
+    const WDL_VERB_VEC vdamp=WDL_VERB_SPLAT(damp), vdamp1=WDL_VERB_SPLAT(damp1), vfb=WDL_VERB_SPLAT(fb), thr=WDL_VERB_SPLAT(WDL_VERB_FLUSH);
+    WDL_VERB_VEC fs[WDL_VERB_NCOMBS/2];
+    for (x = 0; x+1 < WDL_VERB_NCOMBS; x += 2) fs[x/2]=WDL_VERB_SET(fsl[x],fsl[x+1]);
+#endif
+
+    while (ns > 0)
+    {
+      // run up to the first comb reaching the end of its buffer
+      int n=ns;
+      for (x = 0; x < WDL_VERB_NCOMBS; x ++)
+      {
+        if (size[x]-pos[x] < n) n=size[x]-pos[x];
+        p[x]=m_mem.Get()+ofs[x]+pos[x];
+      }
+
+      for (i = 0; i < n; i ++)
+      {
+        const double inp=in[i] * 0.015;
+        double sum=0.0;
+        x=0;
+#if defined(WDL_VERB_SSE2) || defined(WDL_VERB_NEON)
+        // written out for the 5 pairs of wdl_verb__combtunings, so that the
+        // state and pointers stay in registers
+        const WDL_VERB_VEC vinp=WDL_VERB_SPLAT(inp);
+        WDL_VERB_VEC vsum;
+        #define WDL_VERB_COMBPAIR(a) { \
+          const WDL_VERB_VEC o=wdl_verb_load2(p[a]+i,p[a+1]+i); \
+          const WDL_VERB_VEC f=WDL_VERB_FLUSHV(WDL_VERB_ADD(WDL_VERB_MUL(o,vdamp1),WDL_VERB_MUL(fs[a/2],vdamp)),thr); \
+          wdl_verb_store2(p[a]+i,p[a+1]+i,WDL_VERB_ADD(vinp,WDL_VERB_MUL(f,vfb))); \
+          fs[a/2]=f; \
+          vsum=(a) ? WDL_VERB_ADD(vsum,o) : o; \
+        }
+        WDL_VERB_COMBPAIR(0) WDL_VERB_COMBPAIR(2) WDL_VERB_COMBPAIR(4) WDL_VERB_COMBPAIR(6) WDL_VERB_COMBPAIR(8)
+        #undef WDL_VERB_COMBPAIR
+        sum=WDL_VERB_GET(vsum,0)+WDL_VERB_GET(vsum,1);
+        x=WDL_VERB_NCOMBS;
+#endif
+        for (; x < WDL_VERB_NCOMBS; x ++)
+        {
+          const double o=p[x][i];
+          double f=o*damp1 + fsl[x]*damp;
+          fsl[x]=f=fabs(f)>=WDL_VERB_FLUSH ? f : 0.0;
+          p[x][i]=(T) (inp + f*fb);
+          sum+=o;
+        }
+        out[i]=sum;
+      }
+
+      for (x = 0; x < WDL_VERB_NCOMBS; x ++)
+      {
+        if ((pos[x]+=n) >= size[x]) pos[x]=0;
+      }
+      in+=n;
+      out+=n;
+      ns-=n;
+    }
+
+#if defined(WDL_VERB_SSE2) || defined(WDL_VERB_NEON)
+    for (x = 0; x+1 < WDL_VERB_NCOMBS; x += 2)
+    {
+      fsl[x]=WDL_VERB_GET(fs[x/2],0);
+      fsl[x+1]=WDL_VERB_GET(fs[x/2],1);
+    }
+#endif
+    for (x = 0; x < WDL_VERB_NCOMBS; x ++) fsp[x]=fsl[x];
+  }
+
+  // the allpass only reads samples older than its length, so a run up to the
+  // end of its buffer has no dependencies between samples
+  void ProcessAllpass(int line, double *p, int ns)
+  {
+    const int size=m_size.Get()[line];
+    int pos=m_pos.Get()[line];
+    T *buf=m_mem.Get()+m_ofs.Get()[line];
+
+    while (ns > 0)
+    {
+      int i, n=size-pos;
+      if (n > ns) n=ns;
+      T *b=buf+pos;
+      i=0;
+#if defined(WDL_VERB_SSE2) || defined(WDL_VERB_NEON)
+      const WDL_VERB_VEC half=WDL_VERB_SPLAT(0.5), thr=WDL_VERB_SPLAT(WDL_VERB_FLUSH);
+      for (; i+1 < n; i += 2)
+      {
+        const WDL_VERB_VEC bufout=wdl_verb_load2(b+i), inp=WDL_VERB_LOAD(p+i);
+        WDL_VERB_STORE(p+i,WDL_VERB_SUB(bufout,inp));
+        wdl_verb_store2(b+i,WDL_VERB_FLUSHV(WDL_VERB_ADD(inp,WDL_VERB_MUL(bufout,half)),thr));
+      }
+#endif
+      for (; i < n; i ++)
+      {
+        const double bufout=b[i], inp=p[i];
+        const double v=inp + bufout*0.5;
+        p[i]=bufout - inp;
+        b[i]=(T) (fabs(v)>=WDL_VERB_FLUSH ? v : 0.0);
+      }
+      if ((pos+=n) >= size) pos=0;
+      p+=n;
+      ns-=n;
+    }
+    m_pos.Get()[line]=pos;
+  }
+
+  double m_wid;
+  double m_roomsize;
+  double m_damp;
+  double m_srate;
+  int m_nch;
+
+  WDL_TypedBuf<T> m_mem; // all delay lines, [ch][combs then allpasses]
+  WDL_TypedBuf<int> m_size, m_ofs, m_pos; // per delay line
+  WDL_TypedBuf<double> m_filterstore; // [ch][comb]
+};
+
+
+#endif
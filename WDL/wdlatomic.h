@@ -3,20 +3,34 @@
 
 #ifdef _WIN32
 
-static int wdl_atomic_incr(int *v) { return (int) InterlockedIncrement((LONG *)v); }
-static int wdl_atomic_decr(int *v) { return (int) InterlockedDecrement((LONG *)v); }
+static inline int wdl_atomic_incr(int *v) { return (int) InterlockedIncrement((LONG *)v); }
+static inline int wdl_atomic_decr(int *v) { return (int) InterlockedDecrement((LONG *)v); }
+static inline void *wdl_atomic_swap_ptr(void **v, void *nv) { return InterlockedExchangePointer(v,nv); }
+static inline void wdl_memory_barrier() { MemoryBarrier(); }
+static inline int wdl_atomic_cas_int(int *v, int oldv, int newv) { return InterlockedCompareExchange((LONG *)v,newv,oldv)==oldv; }
 
 #elif !defined(__ppc__) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 2))))
 
-static int wdl_atomic_incr(int *v) { return __sync_add_and_fetch(v,1); }
-static int wdl_atomic_decr(int *v) { return __sync_add_and_fetch(v,~0); }
+static inline int wdl_atomic_incr(int *v) { return __sync_add_and_fetch(v,1); }
+static inline int wdl_atomic_decr(int *v) { return __sync_add_and_fetch(v,~0); }
+static inline void *wdl_atomic_swap_ptr(void **v, void *nv) { __sync_synchronize(); return __sync_lock_test_and_set(v,nv); }
+static inline void wdl_memory_barrier() { __sync_synchronize(); }
+static inline int wdl_atomic_cas_int(int *v, int oldv, int newv) { return __sync_bool_compare_and_swap(v,oldv,newv); }
 
 #elif defined(__APPLE__)
 // used by GCC < 4.2 on OSX
 #include <libkern/OSAtomic.h>
 
-static int wdl_atomic_incr(int *v) { return (int) OSAtomicIncrement32Barrier((int32_t*)v); }
-static int wdl_atomic_decr(int *v) { return (int) OSAtomicDecrement32Barrier((int32_t*)v); }
+static inline int wdl_atomic_incr(int *v) { return (int) OSAtomicIncrement32Barrier((int32_t*)v); }
+static inline int wdl_atomic_decr(int *v) { return (int) OSAtomicDecrement32Barrier((int32_t*)v); }
+static inline void *wdl_atomic_swap_ptr(void **v, void *nv) 
+{ 
+  void *ov;
+  do { ov=*(void * volatile *)v; } while (!OSAtomicCompareAndSwapPtrBarrier(ov,nv,v));
+  return ov;
+}
+static inline void wdl_memory_barrier() { OSMemoryBarrier(); }
+static inline int wdl_atomic_cas_int(int *v, int oldv, int newv) { return OSAtomicCompareAndSwap32Barrier(oldv,newv,(int32_t*)v); }
 #else
 
 // unsupported! 